@@ -58,6 +58,7 @@ COUCHBASE_FILES=" \
     src/couchbase/classic_authenticator.c \
     src/couchbase/password_authenticator.c \
     src/couchbase/base36.c \
+    src/couchbase/batch.c \
     src/couchbase/pool.c \
     src/couchbase/log_formatter.c \
     src/couchbase/bucket.c \
@@ -82,12 +83,18 @@ COUCHBASE_FILES=" \
     src/couchbase/cluster_manager/user_settings.c \
     src/couchbase/document.c \
     src/couchbase/document_fragment.c \
+    src/couchbase/future.c \
+    src/couchbase/get_many_iterator.c \
+    src/couchbase/io.c \
+    src/couchbase/json.c \
     src/couchbase/lookup_in_builder.c \
+    src/couchbase/metrics.c \
     src/couchbase/mutate_in_builder.c \
     src/couchbase/mutation_state.c \
     src/couchbase/mutation_token.c \
     src/couchbase/n1ql_index.c \
     src/couchbase/n1ql_query.c \
+    src/couchbase/n1ql_query_stream.c \
     src/couchbase/search_query.c \
     src/couchbase/search/query_part.c \
     src/couchbase/search/boolean_field_query.c \
@@ -117,15 +124,37 @@ COUCHBASE_FILES=" \
     src/couchbase/view_query.c \
     src/couchbase/view_query_encodable.c \
     src/couchbase/spatial_view_query.c \
+    src/couchbase/zstd.c \
     transcoding.c \
 "
 
+  PHP_CHECK_LIBRARY(pthread, pthread_atfork, [
+    PHP_ADD_LIBRARY(pthread, 1, COUCHBASE_SHARED_LIBADD)])
+
   AC_CHECK_HEADERS([zlib.h])
   PHP_CHECK_LIBRARY(z, compress, [
     AC_DEFINE(HAVE_COUCHBASE_ZLIB,1,[Whether zlib compressor is enabled])
     PHP_ADD_LIBRARY(z, 1, COUCHBASE_SHARED_LIBADD)],
     [AC_MSG_WARN(zlib library not found)])
 
+  AC_CHECK_HEADERS([zstd.h])
+  PHP_CHECK_LIBRARY(zstd, ZSTD_compress_usingCDict, [
+    AC_DEFINE(HAVE_COUCHBASE_ZSTD,1,[Whether zstd compressor is enabled])
+    PHP_ADD_LIBRARY(zstd, 1, COUCHBASE_SHARED_LIBADD)],
+    [AC_MSG_WARN(zstd library not found)])
+
+  AC_CHECK_HEADERS([lz4.h])
+  PHP_CHECK_LIBRARY(lz4, LZ4_compress_HC, [
+    AC_DEFINE(HAVE_COUCHBASE_LZ4,1,[Whether lz4 compressor is enabled])
+    PHP_ADD_LIBRARY(lz4, 1, COUCHBASE_SHARED_LIBADD)],
+    [AC_MSG_WARN(lz4 library not found)])
+
+  AC_CHECK_HEADERS([yyjson.h])
+  PHP_CHECK_LIBRARY(yyjson, yyjson_read_opts, [
+    AC_DEFINE(HAVE_COUCHBASE_YYJSON,1,[Whether yyjson parser is enabled])
+    PHP_ADD_LIBRARY(yyjson, 1, COUCHBASE_SHARED_LIBADD)],
+    [AC_MSG_WARN(yyjson library not found)])
+
   if test "$PHP_SYSTEM_FASTLZ" != "no"; then
     AC_CHECK_HEADERS([fastlz.h])
     PHP_CHECK_LIBRARY(fastlz, fastlz_compress,
@@ -27,6 +27,11 @@
 #include <zlib.h>
 #endif
 
+#if HAVE_COUCHBASE_LZ4
+#include <lz4.h>
+#include <lz4hc.h>
+#endif
+
 #if HAVE_COUCHBASE_IGBINARY
 #include <ext/igbinary/igbinary.h>
 #endif
@@ -53,6 +58,9 @@ ZEND_DECLARE_MODULE_GLOBALS(couchbase)
 #define COUCHBASE_CMPRTYPE_NONE 0
 #define COUCHBASE_CMPRTYPE_ZLIB 1
 #define COUCHBASE_CMPRTYPE_FASTLZ 2
+#define COUCHBASE_CMPRTYPE_ZSTD 3
+#define COUCHBASE_CMPRTYPE_LZ4 4
+#define COUCHBASE_CMPRTYPE_LZ4HC 5
 #define DEFAULT_COUCHBASE_CMPRTYPE COUCHBASE_CMPRTYPE_NONE
 
 #define DEFAULT_COUCHBASE_CMPRTHRESH 0
@@ -71,6 +79,8 @@ ZEND_DECLARE_MODULE_GLOBALS(couchbase)
 #define COUCHBASE_COMPRESSION_NONE 0x00 << 5
 #define COUCHBASE_COMPRESSION_ZLIB 0x01 << 5
 #define COUCHBASE_COMPRESSION_FASTLZ 0x02 << 5
+#define COUCHBASE_COMPRESSION_ZSTD 0x03 << 5
+#define COUCHBASE_COMPRESSION_LZ4 0x04 << 5
 #define COUCHBASE_COMPRESSION_MCISCOMPRESSED 0x01 << 4
 
 #define COUCHBASE_CFFMT_MASK 0xFF << 24
@@ -82,8 +92,6 @@ ZEND_DECLARE_MODULE_GLOBALS(couchbase)
 
 #define DEFAULT_COUCHBASE_JSONASSOC 0
 
-extern struct pcbc_logger_st pcbc_logger;
-
 static PHP_INI_MH(OnUpdateLogLevel)
 {
     const char *str_val =
@@ -92,21 +100,29 @@ static PHP_INI_MH(OnUpdateLogLevel)
 #else
         new_value;
 #endif
-    if (!new_value) {
-        pcbc_logger.minlevel = LCB_LOG_WARN;
-    } else if (!strcmp(str_val, "TRACE") || !strcmp(str_val, "TRAC")) {
-        pcbc_logger.minlevel = LCB_LOG_TRACE;
-    } else if (!strcmp(str_val, "DEBUG") || !strcmp(str_val, "DEBG")) {
-        pcbc_logger.minlevel = LCB_LOG_DEBUG;
-    } else if (!strcmp(str_val, "INFO")) {
-        pcbc_logger.minlevel = LCB_LOG_INFO;
-    } else if (!strcmp(str_val, "WARN")) {
-        pcbc_logger.minlevel = LCB_LOG_WARN;
-    } else if (!strcmp(str_val, "ERROR") || !strcmp(str_val, "EROR")) {
-        pcbc_logger.minlevel = LCB_LOG_ERROR;
-    } else if (!strcmp(str_val, "FATAL") || !strcmp(str_val, "FATL")) {
-        pcbc_logger.minlevel = LCB_LOG_FATAL;
-    } else {
+    int level = new_value ? pcbc_log_parse_level(str_val) : LCB_LOG_WARN;
+
+    if (level < 0) {
+        return FAILURE;
+    }
+    pcbc_log_set_level(level);
+
+#if PHP_VERSION_ID >= 70000
+    return OnUpdateString(entry, new_value, mh_arg1, mh_arg2, mh_arg3, stage);
+#else
+    return OnUpdateString(entry, new_value, new_value_length, mh_arg1, mh_arg2, mh_arg3, stage TSRMLS_CC);
+#endif
+}
+
+static PHP_INI_MH(OnUpdateLogSubsystemLevels)
+{
+    const char *str_val =
+#if PHP_VERSION_ID >= 70000
+        new_value ? ZSTR_VAL(new_value) : NULL;
+#else
+        new_value;
+#endif
+    if (pcbc_log_set_subsystem_levels(str_val) == FAILURE) {
         return FAILURE;
     }
 
@@ -165,6 +181,73 @@ static PHP_INI_MH(OnUpdateCmpr)
 #endif
     } else if (!strcmp(str_val, "fastlz") || !strcmp(str_val, "FASTLZ")) {
         PCBCG(enc_cmpr_i) = COUCHBASE_CMPRTYPE_FASTLZ;
+#if HAVE_COUCHBASE_ZSTD
+    } else if (!strcmp(str_val, "zstd") || !strcmp(str_val, "ZSTD")) {
+        PCBCG(enc_cmpr_i) = COUCHBASE_CMPRTYPE_ZSTD;
+#endif
+#if HAVE_COUCHBASE_LZ4
+    } else if (!strcmp(str_val, "lz4") || !strcmp(str_val, "LZ4")) {
+        PCBCG(enc_cmpr_i) = COUCHBASE_CMPRTYPE_LZ4;
+    } else if (!strcmp(str_val, "lz4hc") || !strcmp(str_val, "LZ4HC")) {
+        PCBCG(enc_cmpr_i) = COUCHBASE_CMPRTYPE_LZ4HC;
+#endif
+    } else {
+        return FAILURE;
+    }
+
+#if PHP_VERSION_ID >= 70000
+    return OnUpdateString(entry, new_value, mh_arg1, mh_arg2, mh_arg3, stage);
+#else
+    return OnUpdateString(entry, new_value, new_value_length, mh_arg1, mh_arg2, mh_arg3, stage TSRMLS_CC);
+#endif
+}
+static PHP_INI_MH(OnUpdateJsonParser)
+{
+    const char *str_val =
+#if PHP_VERSION_ID >= 70000
+        ZSTR_VAL(new_value);
+#else
+        new_value;
+#endif
+    if (!new_value) {
+        PCBCG(dec_json_parser_i) = PCBC_JSON_PARSER_PHP;
+    } else if (!strcmp(str_val, "php") || !strcmp(str_val, "PHP")) {
+        PCBCG(dec_json_parser_i) = PCBC_JSON_PARSER_PHP;
+#if HAVE_COUCHBASE_YYJSON && PHP_VERSION_ID >= 70000
+    } else if (!strcmp(str_val, "yyjson") || !strcmp(str_val, "YYJSON")) {
+        PCBCG(dec_json_parser_i) = PCBC_JSON_PARSER_YYJSON;
+#endif
+    } else {
+        return FAILURE;
+    }
+
+#if PHP_VERSION_ID >= 70000
+    return OnUpdateString(entry, new_value, mh_arg1, mh_arg2, mh_arg3, stage);
+#else
+    return OnUpdateString(entry, new_value, new_value_length, mh_arg1, mh_arg2, mh_arg3, stage TSRMLS_CC);
+#endif
+}
+
+static PHP_INI_MH(OnUpdateNetCmpr)
+{
+    const char *str_val =
+#if PHP_VERSION_ID >= 70000
+        ZSTR_VAL(new_value);
+#else
+        new_value;
+#endif
+    if (!new_value || str_val[0] == '\0') {
+        PCBCG(net_cmpr_i) = -1;
+    } else if (!strcmp(str_val, "off") || !strcmp(str_val, "OFF")) {
+        PCBCG(net_cmpr_i) = LCB_COMPRESS_NONE;
+    } else if (!strcmp(str_val, "on") || !strcmp(str_val, "ON")) {
+        PCBCG(net_cmpr_i) = LCB_COMPRESS_INOUT;
+    } else if (!strcmp(str_val, "inflate_only") || !strcmp(str_val, "INFLATE_ONLY")) {
+        PCBCG(net_cmpr_i) = LCB_COMPRESS_IN;
+    } else if (!strcmp(str_val, "deflate_only") || !strcmp(str_val, "DEFLATE_ONLY")) {
+        PCBCG(net_cmpr_i) = LCB_COMPRESS_OUT;
+    } else if (!strcmp(str_val, "force") || !strcmp(str_val, "FORCE")) {
+        PCBCG(net_cmpr_i) = LCB_COMPRESS_INOUT | LCB_COMPRESS_FORCE;
     } else {
         return FAILURE;
     }
@@ -175,15 +258,45 @@ static PHP_INI_MH(OnUpdateCmpr)
     return OnUpdateString(entry, new_value, new_value_length, mh_arg1, mh_arg2, mh_arg3, stage TSRMLS_CC);
 #endif
 }
+
 // clang-format off
 PHP_INI_BEGIN()
 STD_PHP_INI_ENTRY("couchbase.log_level",                     "WARN", PHP_INI_ALL, OnUpdateLogLevel,   log_level,           zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.log_subsystem_levels",          "",     PHP_INI_ALL, OnUpdateLogSubsystemLevels, log_subsystem_levels, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.log_target",                    "",     PHP_INI_SYSTEM, OnUpdateString,  log_target,          zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.log_buffer_size",               "65536", PHP_INI_SYSTEM, OnUpdateLongGEZero, log_buffer_size, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.log_flush_interval_ms",         "1000", PHP_INI_ALL, OnUpdateLongGEZero, log_flush_interval,  zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.log_rate_limit",                "0",    PHP_INI_ALL, OnUpdateLongGEZero, log_rate_limit,      zend_couchbase_globals, couchbase_globals)
 STD_PHP_INI_ENTRY("couchbase.encoder.format",                "json", PHP_INI_ALL, OnUpdateFormat,     enc_format,          zend_couchbase_globals, couchbase_globals)
 STD_PHP_INI_ENTRY("couchbase.encoder.compression",           "off",  PHP_INI_ALL, OnUpdateCmpr,       enc_cmpr ,           zend_couchbase_globals, couchbase_globals)
 STD_PHP_INI_ENTRY("couchbase.encoder.compression_threshold", "0",    PHP_INI_ALL, OnUpdateLongGEZero, enc_cmpr_threshold,  zend_couchbase_globals, couchbase_globals)
 STD_PHP_INI_ENTRY("couchbase.encoder.compression_factor",    "0.0",  PHP_INI_ALL, OnUpdateReal,       enc_cmpr_factor,     zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.encoder.compression_adaptive",  "0",    PHP_INI_ALL, OnUpdateBool,       enc_cmpr_adaptive,   zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.encoder.compression_probe_interval", "100", PHP_INI_ALL, OnUpdateLongGEZero, enc_cmpr_probe_interval, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.encoder.zstd_level",            "3",    PHP_INI_ALL, OnUpdateLong,       enc_zstd_level,      zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.encoder.zstd_dictionary",       "",     PHP_INI_SYSTEM, OnUpdateString,  enc_zstd_dictionary, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.encoder.lz4hc_level",           "9",    PHP_INI_ALL, OnUpdateLong,       enc_lz4hc_level,     zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.decoder.zstd_dictionaries",     "",     PHP_INI_SYSTEM, OnUpdateString,  dec_zstd_dictionaries, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.network.compression",           "",     PHP_INI_ALL, OnUpdateNetCmpr,    net_cmpr,            zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.network.compression_min_size",  "0",    PHP_INI_ALL, OnUpdateLongGEZero, net_cmpr_min_size,   zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.network.compression_min_ratio", "0.0",  PHP_INI_ALL, OnUpdateReal,       net_cmpr_min_ratio,  zend_couchbase_globals, couchbase_globals)
 STD_PHP_INI_ENTRY("couchbase.decoder.json_arrays",           "0",    PHP_INI_ALL, OnUpdateBool,       dec_json_array,      zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.decoder.json_parser",           "php",  PHP_INI_ALL, OnUpdateJsonParser, dec_json_parser,     zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.decoder.lazy",                  "1",    PHP_INI_ALL, OnUpdateBool,       dec_lazy,            zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.n1ql.stream_max_buffered",      "10000", PHP_INI_ALL, OnUpdateLongGEZero, n1ql_stream_max_buffered, zend_couchbase_globals, couchbase_globals)
 STD_PHP_INI_ENTRY("couchbase.pool.max_idle_time_sec",        "60",   PHP_INI_ALL, OnUpdateLongGEZero, pool_max_idle_time,  zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.pool.max_instances_per_key",    "1",    PHP_INI_ALL, OnUpdateLongGEZero, pool_max_instances,  zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.pool.health_check_idle_sec",    "30",   PHP_INI_ALL, OnUpdateLongGEZero, pool_health_check_idle, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.pool.health_check_timeout_ms",  "500",  PHP_INI_ALL, OnUpdateLongGEZero, pool_health_check_timeout, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.pool.prewarm",                  "",     PHP_INI_SYSTEM, OnUpdateString,  pool_prewarm,        zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.pool.config_cache",             "",     PHP_INI_SYSTEM, OnUpdateString,  pool_config_cache,   zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.pool.config_cache_ttl_sec",     "300",  PHP_INI_ALL, OnUpdateLongGEZero, pool_config_cache_ttl, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.tracing.interval_sec",          "10",   PHP_INI_ALL, OnUpdateLongGEZero, tracing_interval,    zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.tracing.sample_size",           "10",   PHP_INI_ALL, OnUpdateLongGEZero, tracing_sample_size, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.tracing.threshold_kv_ms",       "500",  PHP_INI_ALL, OnUpdateLongGEZero, tracing_threshold_kv, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.tracing.threshold_query_ms",    "1000", PHP_INI_ALL, OnUpdateLongGEZero, tracing_threshold_query, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.tracing.threshold_view_ms",     "1000", PHP_INI_ALL, OnUpdateLongGEZero, tracing_threshold_view, zend_couchbase_globals, couchbase_globals)
+STD_PHP_INI_ENTRY("couchbase.tracing.threshold_search_ms",   "1000", PHP_INI_ALL, OnUpdateLongGEZero, tracing_threshold_search, zend_couchbase_globals, couchbase_globals)
 PHP_INI_END()
 // clang-format on
 
@@ -206,19 +319,94 @@ static void php_extname_init_globals(zend_couchbase_globals *couchbase_globals)
     ZEND_TSRMLS_CACHE_UPDATE();
 #endif
 
+    couchbase_globals->log_subsystem_levels = NULL;
+    couchbase_globals->log_target = NULL;
+    couchbase_globals->log_buffer_size = 65536;
+    couchbase_globals->log_flush_interval = 1000;
+    couchbase_globals->log_rate_limit = 0;
+    couchbase_globals->log_sink = NULL;
     couchbase_globals->enc_format = "json";
     couchbase_globals->enc_format_i = COUCHBASE_SERTYPE_JSON;
     couchbase_globals->enc_cmpr = "off";
     couchbase_globals->enc_cmpr_i = COUCHBASE_CMPRTYPE_NONE;
     couchbase_globals->enc_cmpr_threshold = 0;
     couchbase_globals->enc_cmpr_factor = 0.0;
+    couchbase_globals->enc_cmpr_adaptive = 0;
+    couchbase_globals->enc_cmpr_probe_interval = 100;
+    couchbase_globals->enc_cmpr_stats = NULL;
+    couchbase_globals->enc_cmpr_skips = 0;
+    couchbase_globals->enc_zstd_level = 3;
+    couchbase_globals->enc_zstd_dictionary = NULL;
+    couchbase_globals->dec_zstd_dictionaries = NULL;
+    couchbase_globals->zstd_ctx = NULL;
+    couchbase_globals->enc_lz4hc_level = 9;
+    couchbase_globals->net_cmpr = NULL;
+    couchbase_globals->net_cmpr_i = -1;
+    couchbase_globals->net_cmpr_min_size = 0;
+    couchbase_globals->net_cmpr_min_ratio = 0.0;
     couchbase_globals->dec_json_array = 0;
+    couchbase_globals->dec_lazy = 1;
+    couchbase_globals->dec_json_parser = "php";
+    couchbase_globals->dec_json_parser_i = PCBC_JSON_PARSER_PHP;
+    couchbase_globals->n1ql_stream_max_buffered = 10000;
     couchbase_globals->pool_max_idle_time = 60;
+    couchbase_globals->pool_max_instances = 1;
+    couchbase_globals->pool_hits = 0;
+    couchbase_globals->pool_misses = 0;
+    couchbase_globals->pool_evictions = 0;
+    couchbase_globals->pool_reconnects = 0;
+    couchbase_globals->pool_health_check_idle = 30;
+    couchbase_globals->pool_health_check_timeout = 500;
+    couchbase_globals->pool_prewarm = NULL;
+    couchbase_globals->pool_prewarmed = 0;
+    couchbase_globals->pool_config_cache = NULL;
+    couchbase_globals->pool_config_cache_ttl = 300;
+    couchbase_globals->pool_config_cache_hits = 0;
+    couchbase_globals->pool_network_bootstraps = 0;
+    couchbase_globals->io = NULL;
+    couchbase_globals->io_watchers = NULL;
+    couchbase_globals->connstr_memo = NULL;
+    couchbase_globals->metrics = NULL;
+    couchbase_globals->tracer = NULL;
+    couchbase_globals->tracing_interval = 10;
+    couchbase_globals->tracing_sample_size = 10;
+    couchbase_globals->tracing_threshold_kv = 500;
+    couchbase_globals->tracing_threshold_query = 1000;
+    couchbase_globals->tracing_threshold_view = 1000;
+    couchbase_globals->tracing_threshold_search = 1000;
+}
+
+static void php_extname_destroy_globals(zend_couchbase_globals *couchbase_globals)
+{
+    pcbc_connstr_memo_destroy(couchbase_globals->connstr_memo);
+    couchbase_globals->connstr_memo = NULL;
+    pcbc_metrics_destroy(couchbase_globals->metrics);
+    couchbase_globals->metrics = NULL;
+    pcbc_tracer_destroy(couchbase_globals->tracer);
+    couchbase_globals->tracer = NULL;
+    pcbc_log_sink_destroy(couchbase_globals->log_sink);
+    couchbase_globals->log_sink = NULL;
+    if (couchbase_globals->enc_cmpr_stats) {
+        pefree(couchbase_globals->enc_cmpr_stats, 1);
+        couchbase_globals->enc_cmpr_stats = NULL;
+    }
+#if HAVE_COUCHBASE_ZSTD
+    pcbc_zstd_ctx_destroy(couchbase_globals->zstd_ctx);
+    couchbase_globals->zstd_ctx = NULL;
+#endif
+    // persistent connections of the thread are destroyed at this point already (at module shutdown, or with the
+    // executor globals of the thread in ZTS builds), so nothing uses its IO plugin anymore
+    if (couchbase_globals->io) {
+        pcbc_io_destroy(couchbase_globals->io, couchbase_globals->io_watchers);
+        couchbase_globals->io = NULL;
+        couchbase_globals->io_watchers = NULL;
+    }
 }
 
 PHP_MINIT_FUNCTION(couchbase)
 {
-    ZEND_INIT_MODULE_GLOBALS(couchbase, php_extname_init_globals, NULL);
+    pcbc_log_startup();
+    ZEND_INIT_MODULE_GLOBALS(couchbase, php_extname_init_globals, php_extname_destroy_globals);
     REGISTER_INI_ENTRIES();
 
 #if PHP_VERSION_ID < 70000
@@ -272,6 +460,9 @@ PHP_MINIT_FUNCTION(couchbase)
     PHP_MINIT(ClusterManager)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(UserSettings)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(Bucket)(INIT_FUNC_ARGS_PASSTHRU);
+    PHP_MINIT(Future)(INIT_FUNC_ARGS_PASSTHRU);
+    PHP_MINIT(Metrics)(INIT_FUNC_ARGS_PASSTHRU);
+    PHP_MINIT(Batch)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(BucketManager)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(Authenticator)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(ClassicAuthenticator)(INIT_FUNC_ARGS_PASSTHRU);
@@ -283,6 +474,8 @@ PHP_MINIT_FUNCTION(couchbase)
     PHP_MINIT(SpatialViewQuery)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(AnalyticsQuery)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(N1qlQuery)(INIT_FUNC_ARGS_PASSTHRU);
+    PHP_MINIT(N1qlQueryStream)(INIT_FUNC_ARGS_PASSTHRU);
+    PHP_MINIT(GetManyIterator)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(N1qlIndex)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(LookupInBuilder)(INIT_FUNC_ARGS_PASSTHRU);
     PHP_MINIT(MutateInBuilder)(INIT_FUNC_ARGS_PASSTHRU);
@@ -386,6 +579,8 @@ PHP_MINIT_FUNCTION(couchbase)
     PCBC_REGISTER_CONST_RAW(COUCHBASE_COMPRESSION_NONE);
     PCBC_REGISTER_CONST_RAW(COUCHBASE_COMPRESSION_ZLIB);
     PCBC_REGISTER_CONST_RAW(COUCHBASE_COMPRESSION_FASTLZ);
+    PCBC_REGISTER_CONST_RAW(COUCHBASE_COMPRESSION_ZSTD);
+    PCBC_REGISTER_CONST_RAW(COUCHBASE_COMPRESSION_LZ4);
     PCBC_REGISTER_CONST_RAW(COUCHBASE_COMPRESSION_MCISCOMPRESSED);
 
     PCBC_REGISTER_CONST_RAW(COUCHBASE_SERTYPE_JSON);
@@ -394,6 +589,9 @@ PHP_MINIT_FUNCTION(couchbase)
     PCBC_REGISTER_CONST_RAW(COUCHBASE_CMPRTYPE_NONE);
     PCBC_REGISTER_CONST_RAW(COUCHBASE_CMPRTYPE_ZLIB);
     PCBC_REGISTER_CONST_RAW(COUCHBASE_CMPRTYPE_FASTLZ);
+    PCBC_REGISTER_CONST_RAW(COUCHBASE_CMPRTYPE_ZSTD);
+    PCBC_REGISTER_CONST_RAW(COUCHBASE_CMPRTYPE_LZ4);
+    PCBC_REGISTER_CONST_RAW(COUCHBASE_CMPRTYPE_LZ4HC);
 
     PCBC_REGISTER_CONST_RAW(COUCHBASE_CFFMT_MASK);
     PCBC_REGISTER_CONST_RAW(COUCHBASE_CFFMT_PRIVATE);
@@ -412,6 +610,12 @@ PHP_MINIT_FUNCTION(couchbase)
                               CONST_CS | CONST_PERSISTENT);
     REGISTER_NS_LONG_CONSTANT("Couchbase", "ENCODER_COMPRESSION_FASTLZ", COUCHBASE_CMPRTYPE_FASTLZ,
                               CONST_CS | CONST_PERSISTENT);
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "ENCODER_COMPRESSION_ZSTD", COUCHBASE_CMPRTYPE_ZSTD,
+                              CONST_CS | CONST_PERSISTENT);
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "ENCODER_COMPRESSION_LZ4", COUCHBASE_CMPRTYPE_LZ4,
+                              CONST_CS | CONST_PERSISTENT);
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "ENCODER_COMPRESSION_LZ4HC", COUCHBASE_CMPRTYPE_LZ4HC,
+                              CONST_CS | CONST_PERSISTENT);
 
 #ifdef HAVE_COUCHBASE_IGBINARY
     REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_IGBINARY", 1, CONST_CS | CONST_PERSISTENT);
@@ -426,6 +630,27 @@ PHP_MINIT_FUNCTION(couchbase)
     REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_ZLIB", 0, CONST_CS | CONST_PERSISTENT);
     pcbc_log(LOGARGS(WARN), "zlib compressor is not found");
 #endif
+
+#ifdef HAVE_COUCHBASE_ZSTD
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_ZSTD", 1, CONST_CS | CONST_PERSISTENT);
+    pcbc_zstd_init(TSRMLS_C);
+#else
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_ZSTD", 0, CONST_CS | CONST_PERSISTENT);
+    pcbc_log(LOGARGS(INFO), "zstd compressor is not found");
+#endif
+
+#if HAVE_COUCHBASE_YYJSON && PHP_VERSION_ID >= 70000
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_YYJSON", 1, CONST_CS | CONST_PERSISTENT);
+#else
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_YYJSON", 0, CONST_CS | CONST_PERSISTENT);
+#endif
+
+#ifdef HAVE_COUCHBASE_LZ4
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_LZ4", 1, CONST_CS | CONST_PERSISTENT);
+#else
+    REGISTER_NS_LONG_CONSTANT("Couchbase", "HAVE_LZ4", 0, CONST_CS | CONST_PERSISTENT);
+    pcbc_log(LOGARGS(INFO), "lz4 compressor is not found");
+#endif
     return SUCCESS;
 }
 
@@ -433,6 +658,14 @@ PHP_MSHUTDOWN_FUNCTION(couchbase)
 {
     UNREGISTER_INI_ENTRIES();
 
+#ifndef ZTS
+    // in ZTS builds the destructor is invoked for each thread by TSRM
+    php_extname_destroy_globals(&couchbase_globals);
+#endif
+#if HAVE_COUCHBASE_ZSTD
+    pcbc_zstd_shutdown();
+#endif
+
     return SUCCESS;
 }
 
@@ -443,20 +676,55 @@ PHP_RSHUTDOWN_FUNCTION(couchbase)
 #else
     pcbc_connection_cleanup(TSRMLS_C);
 #endif
+    pcbc_tracer_flush(0 TSRMLS_CC);
+    pcbc_log_flush(TSRMLS_C);
     return SUCCESS;
 }
 
 PHP_RINIT_FUNCTION(couchbase)
 {
+    // connections are opened on the first request instead of MINIT, because the SAPI might fork workers after MINIT,
+    // and the sockets must not be shared between processes
+    if (!PCBCG(pool_prewarmed)) {
+        PCBCG(pool_prewarmed) = 1;
+        pcbc_connection_prewarm(TSRMLS_C);
+    }
     return SUCCESS;
 }
 
-static void basic_encoder_v1(zval *value, int sertype, int cmprtype, long cmprthresh, double cmprfactor,
-                             zval *return_value TSRMLS_DC)
+/* values are classified by the type and the order of magnitude of their size */
+#define PCBC_CMPR_STATS_TYPES 8
+#define PCBC_CMPR_STATS_SIZES 32
+/* the class is not skipped until it has enough attempts, and the recent ones rarely made the value smaller */
+#define PCBC_CMPR_STATS_MIN_ATTEMPTS 8
+#define PCBC_CMPR_STATS_MIN_GAIN 0.1
+
+struct pcbc_cmpr_stat {
+    lcb_U32 attempts; // saturates at PCBC_CMPR_STATS_MIN_ATTEMPTS
+    lcb_U32 skipped;  // since the last attempt
+    double gain;      // moving average of the attempts, which made the value smaller
+};
+
+static pcbc_cmpr_stat_t *pcbc_cmpr_stat(unsigned int flags, size_t datalen TSRMLS_DC)
+{
+    int size_class = 0;
+
+    if (PCBCG(enc_cmpr_stats) == NULL) {
+        PCBCG(enc_cmpr_stats) =
+            pecalloc(PCBC_CMPR_STATS_TYPES * PCBC_CMPR_STATS_SIZES, sizeof(pcbc_cmpr_stat_t), 1);
+    }
+    while (datalen > 1 && size_class < PCBC_CMPR_STATS_SIZES - 1) {
+        datalen >>= 1;
+        size_class++;
+    }
+    return &PCBCG(enc_cmpr_stats)[(flags & (PCBC_CMPR_STATS_TYPES - 1)) * PCBC_CMPR_STATS_SIZES + size_class];
+}
+
+/* encodes the value into the string, and returns it in res_out, along with the flags */
+static void basic_encoder_v1_ex(zval *value, int sertype, int cmprtype, long cmprthresh, double cmprfactor,
+                                PCBC_ZVAL *res_out, unsigned int *flags_out TSRMLS_DC)
 {
     PCBC_ZVAL res;
-    PCBC_ZVAL flg;
-    PCBC_ZVAL dtype;
     unsigned int flags = 0;
 
 #ifndef HAVE_COUCHBASE_IGBINARY
@@ -578,10 +846,21 @@ static void basic_encoder_v1(zval *value, int sertype, int cmprtype, long cmprth
 
     do {
         size_t datalen = 0;
+        pcbc_cmpr_stat_t *stat = NULL;
         datalen = PCBC_STRLEN_P(res);
         if (datalen < cmprthresh) {
             cmprtype = COUCHBASE_CMPRTYPE_NONE;
         }
+        if (cmprtype != COUCHBASE_CMPRTYPE_NONE && PCBCG(enc_cmpr_adaptive)) {
+            stat = pcbc_cmpr_stat(flags, datalen TSRMLS_CC);
+            if (stat->attempts >= PCBC_CMPR_STATS_MIN_ATTEMPTS && stat->gain < PCBC_CMPR_STATS_MIN_GAIN &&
+                ++stat->skipped < PCBCG(enc_cmpr_probe_interval)) {
+                PCBCG(enc_cmpr_skips)++;
+                break;
+            }
+            /* either compression pays off, or it is time to check whether it has started to */
+            stat->skipped = 0;
+        }
         if (cmprtype != COUCHBASE_CMPRTYPE_NONE) {
             int cmprflags = COUCHBASE_COMPRESSION_NONE;
             PCBC_ZVAL compressed;
@@ -634,11 +913,73 @@ static void basic_encoder_v1(zval *value, int sertype, int cmprtype, long cmprth
                 PCBC_ZVAL_ALLOC(compressed);
                 PCBC_STRINGL(compressed, output, output_size);
                 efree(output);
+            } else if (cmprtype == COUCHBASE_CMPRTYPE_ZSTD) {
+#if HAVE_COUCHBASE_ZSTD
+                char *output;
+                size_t output_size;
+
+                if (pcbc_zstd_compress(PCBC_STRVAL_P(res), datalen, &output, &output_size TSRMLS_CC) != SUCCESS) {
+                    break;
+                }
+                cmprflags = COUCHBASE_COMPRESSION_ZSTD;
+                PCBC_ZVAL_ALLOC(compressed);
+                PCBC_STRINGL(compressed, output, output_size);
+                efree(output);
+#else
+                pcbc_log(LOGARGS(WARN), "The zstd library was not available when the couchbase extension was built.");
+                break;
+#endif
+            } else if (cmprtype == COUCHBASE_CMPRTYPE_LZ4 || cmprtype == COUCHBASE_CMPRTYPE_LZ4HC) {
+#if HAVE_COUCHBASE_LZ4
+                char *output;
+                int input_size, output_size;
+
+                if (datalen > LZ4_MAX_INPUT_SIZE) {
+                    pcbc_log(LOGARGS(WARN), "Value is too large to compress with lz4: %d bytes", (int)datalen);
+                    break;
+                }
+                input_size = (int)datalen;
+                output_size = LZ4_compressBound(input_size);
+                /* 4 bytes for original size in preamble and 1 byte for zero terminator */
+                output = emalloc(4 + output_size + 1);
+                if (cmprtype == COUCHBASE_CMPRTYPE_LZ4HC) {
+                    output_size = LZ4_compress_HC(PCBC_STRVAL_P(res), output + 4, input_size, output_size,
+                                                  (int)PCBCG(enc_lz4hc_level));
+                } else {
+                    output_size = LZ4_compress_default(PCBC_STRVAL_P(res), output + 4, input_size, output_size);
+                }
+                if (output_size <= 0) {
+                    efree(output);
+                    pcbc_log(LOGARGS(WARN), "Failed to compress data with lz4");
+                    break;
+                }
+                *(uint32_t *)output = input_size;
+                output_size += 4;
+                output[output_size] = '\0';
+                /* LZ4 and LZ4HC produce the same format, so the decoder does not need to distinguish them */
+                cmprflags = COUCHBASE_COMPRESSION_LZ4;
+                PCBC_ZVAL_ALLOC(compressed);
+                PCBC_STRINGL(compressed, output, output_size);
+                efree(output);
+#else
+                pcbc_log(LOGARGS(WARN), "The lz4 library was not available when the couchbase extension was built.");
+                break;
+#endif
             } else {
                 pcbc_log(LOGARGS(WARN), "Unsupported compression method: %d", cmprtype);
                 break;
             }
             if (cmprflags != COUCHBASE_COMPRESSION_NONE) {
+                if (stat) {
+                    int helped = PCBC_STRLEN_P(compressed) * (cmprfactor > 1.0 ? cmprfactor : 1.0) <
+                                 PCBC_STRLEN_P(res);
+                    if (stat->attempts < PCBC_CMPR_STATS_MIN_ATTEMPTS) {
+                        stat->gain = (stat->gain * stat->attempts + helped) / (stat->attempts + 1);
+                        stat->attempts++;
+                    } else {
+                        stat->gain = stat->gain * 0.875 + (helped ? 0.125 : 0.0);
+                    }
+                }
                 if (PCBC_STRLEN_P(res) > PCBC_STRLEN_P(compressed) * cmprfactor) {
                     zval_dtor(PCBC_P(res));
 #if PHP_VERSION_ID < 70000
@@ -662,6 +1003,20 @@ static void basic_encoder_v1(zval *value, int sertype, int cmprtype, long cmprth
         }
     } while (0);
 
+    *res_out = res;
+    *flags_out = flags;
+}
+
+static void basic_encoder_v1(zval *value, int sertype, int cmprtype, long cmprthresh, double cmprfactor,
+                             zval *return_value TSRMLS_DC)
+{
+    PCBC_ZVAL res;
+    PCBC_ZVAL flg;
+    PCBC_ZVAL dtype;
+    unsigned int flags = 0;
+
+    basic_encoder_v1_ex(value, sertype, cmprtype, cmprthresh, cmprfactor, &res, &flags TSRMLS_CC);
+
     array_init_size(return_value, 3);
     add_index_zval(return_value, 0, PCBC_P(res));
 
@@ -674,7 +1029,27 @@ static void basic_encoder_v1(zval *value, int sertype, int cmprtype, long cmprth
     add_index_zval(return_value, 2, PCBC_P(dtype));
 }
 
-static void basic_decoder_v1(char *bytes, int bytes_len, unsigned long flags, unsigned long datatype,
+/* source is optional PHP string, which holds the bytes. When it is given, the decoder avoids copying the bytes */
+#if HAVE_COUCHBASE_LZ4
+/* reads the original size from the preamble of the lz4 value, and checks it before the buffer is allocated: lz4 cannot
+ * expand the payload more than 255 times, so the corrupted or hostile preamble is detected here. Returns -1 when the
+ * preamble is invalid */
+static int pcbc_lz4_original_size(const char *bytes, size_t bytes_len)
+{
+    uint32_t size;
+
+    if (bytes_len < 4) {
+        return -1;
+    }
+    memcpy(&size, bytes, 4);
+    if (size == 0 || size > LZ4_MAX_INPUT_SIZE || (lcb_U64)size > (lcb_U64)(bytes_len - 4) * 255) {
+        return -1;
+    }
+    return (int)size;
+}
+#endif
+
+static void basic_decoder_v1(char *bytes, int bytes_len, zval *source, unsigned long flags, unsigned long datatype,
                              zend_bool jsonassoc, zval *return_value TSRMLS_DC)
 {
     PCBC_ZVAL res;
@@ -698,12 +1073,28 @@ static void basic_decoder_v1(char *bytes, int bytes_len, unsigned long flags, un
         if (jsonassoc) {                                                                                               \
             options |= PHP_JSON_OBJECT_AS_ARRAY;                                                                       \
         }                                                                                                              \
-        PCBC_JSON_COPY_DECODE(PCBC_P(res), bytes, bytes_len, options, last_error);                                     \
+        if (source) {                                                                                                  \
+            PCBC_JSON_DECODE(PCBC_P(res), bytes, bytes_len, options, last_error);                                      \
+        } else {                                                                                                       \
+            PCBC_JSON_COPY_DECODE(PCBC_P(res), bytes, bytes_len, options, last_error);                                 \
+        }                                                                                                              \
         if (last_error != 0) {                                                                                         \
             pcbc_log(LOGARGS(WARN), "Failed to decode value as JSON: json_last_error=%d", last_error);                 \
             ZVAL_NULL(PCBC_P(res));                                                                                    \
         }                                                                                                              \
     } while (0)
+#if PHP_VERSION_ID >= 70000
+#define DECODE_STRING                                                                                                  \
+    do {                                                                                                               \
+        if (source) {                                                                                                  \
+            ZVAL_COPY(&res, source);                                                                                   \
+        } else {                                                                                                       \
+            PCBC_STRINGL(res, bytes, bytes_len);                                                                       \
+        }                                                                                                              \
+    } while (0)
+#else
+#define DECODE_STRING PCBC_STRINGL(res, bytes, bytes_len)
+#endif
 
     switch (cffmt) {
     case COUCHBASE_CFFMT_PRIVATE:
@@ -723,6 +1114,7 @@ static void basic_decoder_v1(char *bytes, int bytes_len, unsigned long flags, un
                 need_free = 1;
                 bytes = output;
                 bytes_len = output_size;
+                source = NULL;
 #else
                 pcbc_log(LOGARGS(WARN), "The zlib library was not available when the couchbase extension was built.");
                 break;
@@ -739,6 +1131,47 @@ static void basic_decoder_v1(char *bytes, int bytes_len, unsigned long flags, un
                 need_free = 1;
                 bytes = output;
                 bytes_len = output_size;
+                source = NULL;
+            } else if (cmprtype == COUCHBASE_COMPRESSION_ZSTD) {
+#if HAVE_COUCHBASE_ZSTD
+                char *output;
+                size_t output_size;
+
+                if (pcbc_zstd_decompress(bytes, bytes_len, &output, &output_size TSRMLS_CC) != SUCCESS) {
+                    break;
+                }
+                need_free = 1;
+                bytes = output;
+                bytes_len = output_size;
+                source = NULL;
+#else
+                pcbc_log(LOGARGS(WARN), "The zstd library was not available when the couchbase extension was built.");
+                break;
+#endif
+            } else if (cmprtype == COUCHBASE_COMPRESSION_LZ4) {
+#if HAVE_COUCHBASE_LZ4
+                int output_size = pcbc_lz4_original_size(bytes, bytes_len);
+                char *output;
+
+                if (output_size < 0) {
+                    pcbc_log(LOGARGS(WARN), "Failed to uncompress data with lz4: invalid preamble");
+                    break;
+                }
+                output = emalloc(output_size);
+                output_size = LZ4_decompress_safe(bytes + 4, output, bytes_len - 4, output_size);
+                if (output_size < 0) {
+                    efree(output);
+                    pcbc_log(LOGARGS(WARN), "Failed to uncompress data with lz4. rv=%d", output_size);
+                    break;
+                }
+                need_free = 1;
+                bytes = output;
+                bytes_len = output_size;
+                source = NULL;
+#else
+                pcbc_log(LOGARGS(WARN), "The lz4 library was not available when the couchbase extension was built.");
+                break;
+#endif
             } else if (cmprtype != 0) {
                 pcbc_log(LOGARGS(WARN), "Unsupported compression method: %d", cmprtype);
                 RETURN_NULL();
@@ -754,19 +1187,28 @@ static void basic_decoder_v1(char *bytes, int bytes_len, unsigned long flags, un
                 if (jsonassoc) {
                     options |= PHP_JSON_OBJECT_AS_ARRAY;
                 }
-                PCBC_JSON_COPY_DECODE(PCBC_P(res), bytes, bytes_len, options, last_error);
+                if (source) {
+                    PCBC_JSON_DECODE(PCBC_P(res), bytes, bytes_len, options, last_error);
+                } else {
+                    PCBC_JSON_COPY_DECODE(PCBC_P(res), bytes, bytes_len, options, last_error);
+                }
                 if (last_error == 0) {
                     break;
                 }
             }
-            PCBC_STRINGL(res, bytes, bytes_len);
+            DECODE_STRING;
             break;
         case COUCHBASE_VAL_IS_LONG:
-            ZVAL_LONG(PCBC_P(res), strtol(bytes, NULL, 10));
-            break;
-        case COUCHBASE_VAL_IS_DOUBLE:
-            ZVAL_DOUBLE(PCBC_P(res), zend_strtod(bytes, NULL));
-            break;
+        case COUCHBASE_VAL_IS_DOUBLE: {
+            /* the bytes might point directly to the network buffer, which is not zero-terminated */
+            char num[64] = {0};
+            memcpy(num, bytes, bytes_len < (int)sizeof(num) ? bytes_len : (int)sizeof(num) - 1);
+            if (sertype == COUCHBASE_VAL_IS_LONG) {
+                ZVAL_LONG(PCBC_P(res), strtol(num, NULL, 10));
+            } else {
+                ZVAL_DOUBLE(PCBC_P(res), zend_strtod(num, NULL));
+            }
+        } break;
         case COUCHBASE_VAL_IS_BOOL:
             if (bytes_len == 0) {
                 ZVAL_FALSE(PCBC_P(res));
@@ -812,13 +1254,14 @@ static void basic_decoder_v1(char *bytes, int bytes_len, unsigned long flags, un
         break;
     case COUCHBASE_CFFMT_STRING:
     case COUCHBASE_CFFMT_RAW:
-        PCBC_STRINGL(res, bytes, bytes_len);
+        DECODE_STRING;
         break;
     default:
         pcbc_log(LOGARGS(WARN), "Unknown format specification: %d", cffmt);
         ZVAL_NULL(PCBC_P(res));
     }
 #undef DECODE_JSON
+#undef DECODE_STRING
     if (need_free) {
         efree(bytes);
     }
@@ -860,7 +1303,7 @@ PHP_FUNCTION(basicEncoderV1)
         }
         if (php_array_existsc(options, "cmprtype")) {
             long tmp = php_array_fetchc_long(options, "cmprtype");
-            if (tmp >= COUCHBASE_CMPRTYPE_NONE && tmp <= COUCHBASE_CMPRTYPE_FASTLZ) {
+            if (tmp >= COUCHBASE_CMPRTYPE_NONE && tmp <= COUCHBASE_CMPRTYPE_LZ4HC) {
                 cmprtype = tmp;
             }
         }
@@ -898,7 +1341,7 @@ PHP_FUNCTION(basicDecoderV1)
         json_array = php_array_fetchc_bool(options, "jsonassoc");
     }
 
-    basic_decoder_v1(bytes, bytes_len, flags, datatype, json_array, return_value TSRMLS_CC);
+    basic_decoder_v1(bytes, bytes_len, NULL, flags, datatype, json_array, return_value TSRMLS_CC);
 }
 
 /* {{{ proto \Couchbase\couchbase_passthru_encoder(string $value)
@@ -969,7 +1412,42 @@ PHP_FUNCTION(defaultDecoder)
         RETURN_NULL();
     }
 
-    basic_decoder_v1(bytes, bytes_len, flags, datatype, PCBCG(dec_json_array), return_value TSRMLS_CC);
+    basic_decoder_v1(bytes, bytes_len, NULL, flags, datatype, PCBCG(dec_json_array), return_value TSRMLS_CC);
+}
+
+/**
+ * Native equivalent of defaultEncoder(), used by the buckets with the default transcoder
+ * to avoid calling PHP function and packing result into array.
+ *
+ * @internal
+ */
+int pcbc_default_encode(zval *value, PCBC_ZVAL *bytes, lcb_uint32_t *flags, lcb_uint8_t *datatype TSRMLS_DC)
+{
+    PCBC_ZVAL res;
+    unsigned int res_flags = 0;
+
+    basic_encoder_v1_ex(value, PCBCG(enc_format_i), PCBCG(enc_cmpr_i), PCBCG(enc_cmpr_threshold),
+                        PCBCG(enc_cmpr_factor), &res, &res_flags TSRMLS_CC);
+    if (Z_TYPE_P(PCBC_P(res)) != IS_STRING) {
+        zval_ptr_dtor(&res);
+        return FAILURE;
+    }
+    // the encoded string is handed over to the caller as is, large documents are not copied once more
+    *bytes = res;
+    *flags = res_flags;
+    *datatype = 0;
+    return SUCCESS;
+}
+
+/**
+ * Native equivalent of defaultDecoder()
+ *
+ * @internal
+ */
+void pcbc_default_decode(zval *return_value, zval *bytes, lcb_U32 flags, lcb_datatype_t datatype TSRMLS_DC)
+{
+    basic_decoder_v1(Z_STRVAL_P(bytes), Z_STRLEN_P(bytes), bytes, flags, datatype, PCBCG(dec_json_array),
+                     return_value TSRMLS_CC);
 }
 
 PHP_FUNCTION(zlibCompress)
@@ -1015,7 +1493,11 @@ PHP_FUNCTION(zlibDecompress)
 
     dataIn = PCBC_STRVAL_ZP(zdata);
     dataSize = PCBC_STRLEN_ZP(zdata);
-    dataOutSize = *(uint32_t *)dataIn;
+    dataOutSize = pcbc_lz4_original_size(dataIn, dataSize);
+    if (dataOutSize < 0) {
+        pcbc_log(LOGARGS(WARN), "Failed to uncompress data with lz4: invalid preamble");
+        RETURN_NULL();
+    }
     dataOut = emalloc(dataOutSize);
     uncompress(dataOut, &dataOutSize, (uint8_t *)dataIn + 4, dataSize - 4);
 
@@ -1069,7 +1551,11 @@ PHP_FUNCTION(fastlzDecompress)
 
     dataIn = PCBC_STRVAL_ZP(zdata);
     dataSize = PCBC_STRLEN_ZP(zdata);
-    dataOutSize = *(uint32_t *)dataIn;
+    dataOutSize = pcbc_lz4_original_size(dataIn, dataSize);
+    if (dataOutSize < 0) {
+        pcbc_log(LOGARGS(WARN), "Failed to uncompress data with lz4: invalid preamble");
+        RETURN_NULL();
+    }
     dataOut = emalloc(dataOutSize);
     dataOutSize = fastlz_decompress((uint8_t *)dataIn + 4, dataSize - 4, dataOut, dataOutSize);
 
@@ -1082,6 +1568,137 @@ PHP_FUNCTION(fastlzDecompress)
     efree(dataOut);
 }
 
+PHP_FUNCTION(zstdCompress)
+{
+#if HAVE_COUCHBASE_ZSTD
+    zval *zdata;
+    char *dataOut;
+    size_t dataOutSize;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zdata) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if (pcbc_zstd_compress(PCBC_STRVAL_ZP(zdata), PCBC_STRLEN_ZP(zdata), &dataOut, &dataOutSize TSRMLS_CC) !=
+        SUCCESS) {
+        RETURN_NULL();
+    }
+#if PHP_VERSION_ID >= 70000
+    ZVAL_STRINGL(return_value, dataOut, dataOutSize);
+#else
+    ZVAL_STRINGL(return_value, dataOut, dataOutSize, 1);
+#endif
+    efree(dataOut);
+#else
+    zend_throw_exception(NULL, "The zstd library was not available when the couchbase extension was built.",
+                         0 TSRMLS_CC);
+#endif
+}
+
+PHP_FUNCTION(zstdDecompress)
+{
+#if HAVE_COUCHBASE_ZSTD
+    zval *zdata;
+    char *dataOut;
+    size_t dataOutSize;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zdata) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if (pcbc_zstd_decompress(PCBC_STRVAL_ZP(zdata), PCBC_STRLEN_ZP(zdata), &dataOut, &dataOutSize TSRMLS_CC) !=
+        SUCCESS) {
+        RETURN_NULL();
+    }
+#if PHP_VERSION_ID >= 70000
+    ZVAL_STRINGL(return_value, dataOut, dataOutSize);
+#else
+    ZVAL_STRINGL(return_value, dataOut, dataOutSize, 1);
+#endif
+    efree(dataOut);
+#else
+    zend_throw_exception(NULL, "The zstd library was not available when the couchbase extension was built.",
+                         0 TSRMLS_CC);
+#endif
+}
+
+PHP_FUNCTION(lz4Compress)
+{
+#if HAVE_COUCHBASE_LZ4
+    zval *zdata;
+    char *dataIn, *dataOut;
+    int dataSize, dataOutSize;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zdata) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    if (PCBC_STRLEN_ZP(zdata) > LZ4_MAX_INPUT_SIZE) {
+        pcbc_log(LOGARGS(WARN), "Value is too large to compress with lz4: %lu bytes",
+                 (unsigned long)PCBC_STRLEN_ZP(zdata));
+        RETURN_NULL();
+    }
+    dataIn = PCBC_STRVAL_ZP(zdata);
+    dataSize = PCBC_STRLEN_ZP(zdata);
+    dataOutSize = LZ4_compressBound(dataSize);
+    dataOut = emalloc(4 + dataOutSize);
+    dataOutSize = LZ4_compress_default(dataIn, dataOut + 4, dataSize, dataOutSize);
+    if (dataOutSize <= 0) {
+        efree(dataOut);
+        pcbc_log(LOGARGS(WARN), "Failed to compress data with lz4");
+        RETURN_NULL();
+    }
+    *(uint32_t *)dataOut = dataSize;
+
+#if PHP_VERSION_ID >= 70000
+    ZVAL_STRINGL(return_value, dataOut, 4 + dataOutSize);
+#else
+    ZVAL_STRINGL(return_value, dataOut, 4 + dataOutSize, 1);
+#endif
+    efree(dataOut);
+#else
+    zend_throw_exception(NULL, "The lz4 library was not available when the couchbase extension was built.",
+                         0 TSRMLS_CC);
+#endif
+}
+
+PHP_FUNCTION(lz4Decompress)
+{
+#if HAVE_COUCHBASE_LZ4
+    zval *zdata;
+    char *dataIn, *dataOut;
+    int dataSize, dataOutSize;
+
+    if (zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z", &zdata) == FAILURE) {
+        RETURN_NULL();
+    }
+
+    dataIn = PCBC_STRVAL_ZP(zdata);
+    dataSize = PCBC_STRLEN_ZP(zdata);
+    dataOutSize = pcbc_lz4_original_size(dataIn, dataSize);
+    if (dataOutSize < 0) {
+        pcbc_log(LOGARGS(WARN), "Failed to uncompress data with lz4: invalid preamble");
+        RETURN_NULL();
+    }
+    dataOut = emalloc(dataOutSize);
+    dataOutSize = LZ4_decompress_safe(dataIn + 4, dataOut, dataSize - 4, dataOutSize);
+    if (dataOutSize < 0) {
+        efree(dataOut);
+        RETURN_NULL();
+    }
+
+#if PHP_VERSION_ID >= 70000
+    ZVAL_STRINGL(return_value, dataOut, dataOutSize);
+#else
+    ZVAL_STRINGL(return_value, dataOut, dataOutSize, 1);
+#endif
+    efree(dataOut);
+#else
+    zend_throw_exception(NULL, "The lz4 library was not available when the couchbase extension was built.",
+                         0 TSRMLS_CC);
+#endif
+}
+
 static PHP_MINFO_FUNCTION(couchbase)
 {
     char buf[128];
@@ -1109,6 +1726,40 @@ static PHP_MINFO_FUNCTION(couchbase)
 #else
     php_info_print_table_row(2, "zlib compressor", "disabled (install zlib headers and rebuild pecl/couchbase)");
 #endif
+#ifdef HAVE_COUCHBASE_ZSTD
+    php_info_print_table_row(2, "zstd compressor", "enabled");
+    if (pcbc_zstd_dictionary_id()) {
+        ap_php_snprintf(buf, sizeof(buf), "%u", pcbc_zstd_dictionary_id());
+        php_info_print_table_row(2, "zstd dictionary id", buf);
+    }
+#else
+    php_info_print_table_row(2, "zstd compressor", "disabled (install zstd headers and rebuild pecl/couchbase)");
+#endif
+#if HAVE_COUCHBASE_YYJSON && PHP_VERSION_ID >= 70000
+    php_info_print_table_row(2, "yyjson parser", "enabled");
+#else
+    php_info_print_table_row(2, "yyjson parser", "disabled (install yyjson headers and rebuild pecl/couchbase)");
+#endif
+#ifdef HAVE_COUCHBASE_LZ4
+    php_info_print_table_row(2, "lz4 compressor", "enabled");
+#else
+    php_info_print_table_row(2, "lz4 compressor", "disabled (install lz4 headers and rebuild pecl/couchbase)");
+#endif
+    // counters of the current process
+    ap_php_snprintf(buf, sizeof(buf), "%ld", PCBCG(pool_hits));
+    php_info_print_table_row(2, "pooled connections reused", buf);
+    ap_php_snprintf(buf, sizeof(buf), "%ld", PCBCG(pool_misses));
+    php_info_print_table_row(2, "pooled connections opened", buf);
+    ap_php_snprintf(buf, sizeof(buf), "%ld", PCBCG(pool_evictions));
+    php_info_print_table_row(2, "pooled connections evicted", buf);
+    ap_php_snprintf(buf, sizeof(buf), "%ld", PCBCG(pool_reconnects));
+    php_info_print_table_row(2, "pooled connections reconnected", buf);
+    ap_php_snprintf(buf, sizeof(buf), "%ld", PCBCG(pool_config_cache_hits));
+    php_info_print_table_row(2, "bootstraps from config cache", buf);
+    ap_php_snprintf(buf, sizeof(buf), "%ld", PCBCG(pool_network_bootstraps));
+    php_info_print_table_row(2, "bootstraps from network", buf);
+    ap_php_snprintf(buf, sizeof(buf), "%ld", PCBCG(enc_cmpr_skips));
+    php_info_print_table_row(2, "compressions skipped by adaptive mode", buf);
     php_info_print_table_end();
     DISPLAY_INI_ENTRIES();
 }
@@ -1149,6 +1800,10 @@ static zend_function_entry couchbase_functions[] = {
     ZEND_NS_FE("Couchbase", fastlzDecompress, ai_Couchbase_decompress)
     ZEND_NS_FE("Couchbase", zlibCompress, ai_Couchbase_compress)
     ZEND_NS_FE("Couchbase", zlibDecompress, ai_Couchbase_decompress)
+    ZEND_NS_FE("Couchbase", zstdCompress, ai_Couchbase_compress)
+    ZEND_NS_FE("Couchbase", zstdDecompress, ai_Couchbase_decompress)
+    ZEND_NS_FE("Couchbase", lz4Compress, ai_Couchbase_compress)
+    ZEND_NS_FE("Couchbase", lz4Decompress, ai_Couchbase_decompress)
     ZEND_NS_FE("Couchbase", passthruEncoder, ai_Couchbase_passthruEncoder)
     ZEND_NS_FE("Couchbase", passthruDecoder, ai_Couchbase_passthruDecoder)
     ZEND_NS_FE("Couchbase", defaultEncoder, ai_Couchbase_passthruEncoder)
@@ -1160,6 +1815,10 @@ static zend_function_entry couchbase_functions[] = {
     PHP_FALIAS(couchbase_fastlz_decompress, fastlzDecompress, ai_Couchbase_decompress)
     PHP_FALIAS(couchbase_zlib_compress, zlibCompress, ai_Couchbase_compress)
     PHP_FALIAS(couchbase_zlib_decompress, zlibDecompress, ai_Couchbase_decompress)
+    PHP_FALIAS(couchbase_zstd_compress, zstdCompress, ai_Couchbase_compress)
+    PHP_FALIAS(couchbase_zstd_decompress, zstdDecompress, ai_Couchbase_decompress)
+    PHP_FALIAS(couchbase_lz4_compress, lz4Compress, ai_Couchbase_compress)
+    PHP_FALIAS(couchbase_lz4_decompress, lz4Decompress, ai_Couchbase_decompress)
     PHP_FALIAS(couchbase_passthru_encoder, passthruEncoder, ai_Couchbase_passthruEncoder)
     PHP_FALIAS(couchbase_passthru_decoder, passthruDecoder, ai_Couchbase_passthruDecoder)
     PHP_FALIAS(couchbase_default_encoder, defaultEncoder, ai_Couchbase_passthruEncoder)
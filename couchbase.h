@@ -74,6 +74,75 @@ enum pcbc_constants {
     REPLICATETO_THREE = 4 << 4
 };
 
+/* latency histogram with microsecond resolution. Like in HdrHistogram, every power of two is split into 32 linear
+ * sub-buckets, which keeps relative error of the percentiles about 3% */
+#define PCBC_HISTOGRAM_SUB_BITS 6
+#define PCBC_HISTOGRAM_MAX_BITS 35 /* values are capped at 2^35 us, about 9.5 hours */
+#define PCBC_HISTOGRAM_SIZE ((PCBC_HISTOGRAM_MAX_BITS - PCBC_HISTOGRAM_SUB_BITS + 2) << (PCBC_HISTOGRAM_SUB_BITS - 1))
+
+typedef struct {
+    lcb_U64 count;
+    lcb_U64 sum;
+    lcb_U64 min;
+    lcb_U64 max;
+    lcb_U64 buckets[PCBC_HISTOGRAM_SIZE];
+} pcbc_histogram_t;
+
+typedef enum {
+    PCBC_OP_GET = 0,
+    PCBC_OP_GET_REPLICA,
+    PCBC_OP_STORE,
+    PCBC_OP_UNLOCK,
+    PCBC_OP_REMOVE,
+    PCBC_OP_TOUCH,
+    PCBC_OP_COUNTER,
+    PCBC_OP_LOOKUP_IN,
+    PCBC_OP_MUTATE_IN,
+    PCBC_OP_HTTP,
+    PCBC_OP_N1QL,
+    PCBC_OP_VIEW,
+    PCBC_OP_SEARCH,
+    PCBC_OP__MAX
+} pcbc_op_type_t;
+
+/* latencies of the bucket operations, histograms are allocated on first use */
+typedef struct {
+    char *name; // of the bucket
+    pcbc_histogram_t *service[PCBC_OP__MAX]; // from scheduling to the response from the server
+    pcbc_histogram_t *total[PCBC_OP__MAX];   // from the start of the operation to the release of decoded results
+} pcbc_metrics_t;
+
+/* the slowest operations of every service are kept by the tracer, and reported to the log periodically */
+#define PCBC_TRACER_SAMPLE_MAX 64
+#define PCBC_TRACER_ID_SIZE 128
+typedef struct pcbc_tracer pcbc_tracer_t;
+void pcbc_tracer_destroy(pcbc_tracer_t *tracer);
+void pcbc_tracer_flush(int force TSRMLS_DC);
+
+typedef struct pcbc_cmpr_stat pcbc_cmpr_stat_t;
+
+/* sockets and timers of the IO plugin, which the library is waiting for, see Bucket::watchers() */
+typedef struct pcbc_io_watcher pcbc_io_watcher_t;
+lcb_error_t pcbc_io_create(lcb_io_opt_t *io TSRMLS_DC);
+void pcbc_io_destroy(lcb_io_opt_t io, pcbc_io_watcher_t *watchers);
+int pcbc_io_watchers(zval *return_value TSRMLS_DC);
+
+/* zstd contexts of the thread, while the dictionaries are shared by the process */
+typedef struct pcbc_zstd_ctx pcbc_zstd_ctx_t;
+#if HAVE_COUCHBASE_ZSTD
+void pcbc_zstd_init(TSRMLS_D);
+void pcbc_zstd_shutdown();
+void pcbc_zstd_ctx_destroy(pcbc_zstd_ctx_t *ctx);
+unsigned pcbc_zstd_dictionary_id();
+int pcbc_zstd_compress(const char *input, size_t input_size, char **output, size_t *output_size TSRMLS_DC);
+int pcbc_zstd_decompress(const char *input, size_t input_size, char **output, size_t *output_size TSRMLS_DC);
+#endif
+
+lcb_U64 pcbc_metrics_now();
+pcbc_metrics_t *pcbc_metrics_get(const char *bucketname TSRMLS_DC);
+void pcbc_metrics_record(pcbc_metrics_t *metrics, int total, pcbc_op_type_t op, lcb_U64 elapsed);
+void pcbc_metrics_destroy(HashTable *metrics);
+
 struct pcbc_connection {
     lcb_type_t type;
     char *connstr;
@@ -82,6 +151,12 @@ struct pcbc_connection {
     lcb_t lcb;
     int refs;
     time_t idle_at;
+    time_t created_at;
+    double bootstrap_ms; // time spent waiting for the bootstrap
+    long nhits;          // number of times the connection was reused from the pool
+    long nops;           // number of responses received
+    int orphans;         // cookies abandoned by freed objects, the instance is destroyed with them when released
+    pcbc_metrics_t *metrics;
 };
 typedef struct pcbc_connection pcbc_connection_t;
 
@@ -89,23 +164,78 @@ lcb_error_t pcbc_connection_get(pcbc_connection_t **result, lcb_type_t type, con
                                 const char *bucketname, lcb_AUTHENTICATOR *auth, char *auth_hash TSRMLS_DC);
 void pcbc_connection_addref(pcbc_connection_t *conn TSRMLS_DC);
 void pcbc_connection_delref(pcbc_connection_t *conn TSRMLS_DC);
+void pcbc_connection_orphan(pcbc_connection_t *conn, void *cookie, int pending TSRMLS_DC);
 #if PHP_VERSION_ID >= 70000
 void pcbc_connection_cleanup();
 #else
 void pcbc_connection_cleanup(TSRMLS_D);
 #endif
+void pcbc_connection_prewarm(TSRMLS_D);
+void pcbc_connstr_memo_destroy(HashTable *memo);
 
 ZEND_BEGIN_MODULE_GLOBALS(couchbase)
 char *log_level;
+char *log_subsystem_levels;
+// buffered logger, disabled when the target is empty
+char *log_target;
+long log_buffer_size;
+long log_flush_interval;
+long log_rate_limit;
+pcbc_log_sink_t *log_sink;
 
 char *enc_format;
 char *enc_cmpr;
 int enc_format_i;
 int enc_cmpr_i;
 long enc_cmpr_threshold;
+// adaptive compression skips the classes of values, which are not getting smaller after compression
+zend_bool enc_cmpr_adaptive;
+long enc_cmpr_probe_interval;
+pcbc_cmpr_stat_t *enc_cmpr_stats;
+long enc_cmpr_skips;
+long enc_zstd_level;
+char *enc_zstd_dictionary;
+char *dec_zstd_dictionaries; // in addition to the encoder dictionary, to read values written with older ones
+pcbc_zstd_ctx_t *zstd_ctx;
+long enc_lz4hc_level;
+// Snappy compression on the wire, negotiated with the server by the library
+char *net_cmpr;
+int net_cmpr_i; // one of lcb_COMPRESSOPTS, or -1 to keep default of the library
+long net_cmpr_min_size;
+double net_cmpr_min_ratio;
 long pool_max_idle_time;
+long pool_max_instances;
+long pool_hits;       // connections reused from the pool
+long pool_misses;     // connections established on demand
+long pool_evictions;  // idle connections closed by cleanup
+long pool_reconnects; // idle connections replaced after failed health check
+long pool_health_check_idle;
+long pool_health_check_timeout; // in milliseconds, zero keeps the operation timeout of the connection
+char *pool_prewarm;
+zend_bool pool_prewarmed;
+char *pool_config_cache;
+long pool_config_cache_ttl;
+long pool_config_cache_hits;  // bootstraps served from the config cache file
+long pool_network_bootstraps; // bootstraps which fetched configuration from the cluster
 double enc_cmpr_factor;
 zend_bool dec_json_array;
+zend_bool dec_lazy;
+char *dec_json_parser;
+int dec_json_parser_i;
+long n1ql_stream_max_buffered; // rows of the query stream, which might be received while it is not iterated
+lcb_io_opt_t io; // shared by all connections, so that waiting on one of them drives the others too
+pcbc_io_watcher_t *io_watchers;
+// normalized connection strings, see pcbc_connection_get()
+HashTable *connstr_memo;
+// latency metrics of the buckets, see Metrics::snapshot()
+HashTable *metrics;
+pcbc_tracer_t *tracer;
+long tracing_interval;
+long tracing_sample_size;
+long tracing_threshold_kv;
+long tracing_threshold_query;
+long tracing_threshold_view;
+long tracing_threshold_search;
 ZEND_END_MODULE_GLOBALS(couchbase)
 ZEND_EXTERN_MODULE_GLOBALS(couchbase)
 
@@ -123,6 +253,9 @@ PHP_MINIT_FUNCTION(Cluster);
 PHP_MINIT_FUNCTION(ClusterManager);
 PHP_MINIT_FUNCTION(UserSettings);
 PHP_MINIT_FUNCTION(Bucket);
+PHP_MINIT_FUNCTION(Future);
+PHP_MINIT_FUNCTION(Metrics);
+PHP_MINIT_FUNCTION(Batch);
 PHP_MINIT_FUNCTION(BucketManager);
 PHP_MINIT_FUNCTION(Authenticator);
 PHP_MINIT_FUNCTION(ClassicAuthenticator);
@@ -134,6 +267,8 @@ PHP_MINIT_FUNCTION(ViewQuery);
 PHP_MINIT_FUNCTION(SpatialViewQuery);
 PHP_MINIT_FUNCTION(AnalyticsQuery);
 PHP_MINIT_FUNCTION(N1qlQuery);
+PHP_MINIT_FUNCTION(N1qlQueryStream);
+PHP_MINIT_FUNCTION(GetManyIterator);
 PHP_MINIT_FUNCTION(N1qlIndex);
 PHP_MINIT_FUNCTION(MutateInBuilder);
 PHP_MINIT_FUNCTION(LookupInBuilder);
@@ -238,6 +373,15 @@ typedef int pcbc_str_arg_size;
 #define pcbc_free_object_arg void
 #endif
 
+/* parameters of dtor_obj handler, which is called while all objects are still alive, unlike free_obj */
+#if PHP_VERSION_ID >= 70000
+#define PCBC_DTOR_OBJECT_ARGS zend_object *object
+#define PCBC_DTOR_OBJECT_STD() zend_objects_destroy_object(object)
+#else
+#define PCBC_DTOR_OBJECT_ARGS void *object, zend_object_handle handle TSRMLS_DC
+#define PCBC_DTOR_OBJECT_STD() zend_objects_destroy_object(object, handle TSRMLS_CC)
+#endif
+
 #if PHP_VERSION_ID >= 70000
 #define pcbc_create_object_retval zend_object *
 #else
@@ -336,6 +480,20 @@ typedef int pcbc_str_arg_size;
 #define PCBC_PSTRING(__pcbc_zval, __pcbc_str) ZVAL_STRING((__pcbc_zval), (__pcbc_str), 0)
 #endif
 
+#if PHP_VERSION_ID >= 70000
+#define PCBC_HASH_GET_CURRENT_DATA_EX(ht, pos) zend_hash_get_current_data_ex(ht, pos)
+#else
+static zend_always_inline PCBC_ZVAL *pcbc_hash_get_current_data_ex(HashTable *ht, HashPosition *pos)
+{
+    zval **result;
+    if (zend_hash_get_current_data_ex(ht, (void **)&result, pos) != SUCCESS) {
+        return NULL;
+    }
+    return result;
+}
+#define PCBC_HASH_GET_CURRENT_DATA_EX(ht, pos) pcbc_hash_get_current_data_ex(ht, pos)
+#endif
+
 #if PHP_VERSION_ID >= 70000
 #define pcbc_make_printable_zval(__pcbc_expr, __pcbc_expr_copy, __pcbc_use_copy)                                       \
     do {                                                                                                               \
@@ -392,14 +550,43 @@ typedef zval *PCBC_ZVAL;
         (__pcbc_error_code) = JSON_G(error_code);                                                                      \
     } while (0)
 
+/* the fast parser gives up on anything it cannot convert exactly like php_json, and php_json_decode() is used then */
+#define PCBC_JSON_PARSER_PHP 0
+#define PCBC_JSON_PARSER_YYJSON 1
+#if HAVE_COUCHBASE_YYJSON && PHP_VERSION_ID >= 70000
+int pcbc_json_fast_decode(zval *return_value, const char *src, size_t len, int options);
+#define PCBC_JSON_FAST_DECODE(__pcbc_zval, __pcbc_src, __pcbc_len, __options)                                          \
+    (PCBCG(dec_json_parser_i) == PCBC_JSON_PARSER_YYJSON &&                                                            \
+     pcbc_json_fast_decode((__pcbc_zval), (__pcbc_src), (__pcbc_len), (__options)) == SUCCESS)
+#else
+#define PCBC_JSON_FAST_DECODE(__pcbc_zval, __pcbc_src, __pcbc_len, __options) 0
+#endif
+
 #define PCBC_JSON_COPY_DECODE(__pcbc_zval, __pcbc_src, __pcbc_len, __options, __pcbc_error_code)                       \
     do {                                                                                                               \
-        char *__copy = estrndup((__pcbc_src), (__pcbc_len));                                                           \
         PCBC_JSON_RESET_STATE;                                                                                         \
-        php_json_decode_ex((__pcbc_zval), (__copy), (__pcbc_len), (__options),                                         \
-                           PHP_JSON_PARSER_DEFAULT_DEPTH TSRMLS_CC);                                                   \
-        efree(__copy);                                                                                                 \
-        (__pcbc_error_code) = JSON_G(error_code);                                                                      \
+        if (PCBC_JSON_FAST_DECODE((__pcbc_zval), (__pcbc_src), (__pcbc_len), (__options))) {                           \
+            (__pcbc_error_code) = 0;                                                                                   \
+        } else {                                                                                                       \
+            char *__copy = estrndup((__pcbc_src), (__pcbc_len));                                                       \
+            php_json_decode_ex((__pcbc_zval), (__copy), (__pcbc_len), (__options),                                     \
+                               PHP_JSON_PARSER_DEFAULT_DEPTH TSRMLS_CC);                                               \
+            efree(__copy);                                                                                             \
+            (__pcbc_error_code) = JSON_G(error_code);                                                                  \
+        }                                                                                                              \
+    } while (0)
+
+/* the source must be zero-terminated (e.g. the value of the PHP string) */
+#define PCBC_JSON_DECODE(__pcbc_zval, __pcbc_src, __pcbc_len, __options, __pcbc_error_code)                            \
+    do {                                                                                                               \
+        PCBC_JSON_RESET_STATE;                                                                                         \
+        if (PCBC_JSON_FAST_DECODE((__pcbc_zval), (__pcbc_src), (__pcbc_len), (__options))) {                           \
+            (__pcbc_error_code) = 0;                                                                                   \
+        } else {                                                                                                       \
+            php_json_decode_ex((__pcbc_zval), (char *)(__pcbc_src), (__pcbc_len), (__options),                         \
+                               PHP_JSON_PARSER_DEFAULT_DEPTH TSRMLS_CC);                                               \
+            (__pcbc_error_code) = JSON_G(error_code);                                                                  \
+        }                                                                                                              \
     } while (0)
 
 #if PHP_VERSION_ID >= 70000
@@ -492,6 +679,8 @@ typedef struct {
     pcbc_connection_t *conn;
     PCBC_ZVAL encoder;
     PCBC_ZVAL decoder;
+    zend_bool native_encoder; /* encoder is \Couchbase\defaultEncoder, call it without PHP dispatch */
+    zend_bool native_decoder; /* decoder is \Couchbase\defaultDecoder, call it without PHP dispatch */
     PCBC_ZEND_OBJECT_POST
 } pcbc_bucket_t;
 
@@ -501,6 +690,15 @@ typedef struct {
     PCBC_ZEND_OBJECT_POST
 } pcbc_bucket_manager_t;
 
+typedef struct {
+    PCBC_ZEND_OBJECT_PRE
+    PCBC_ZVAL bytes;   /* encoded value, which is decoded on the first access to the "value" property */
+    PCBC_ZVAL decoder; /* undefined when the value is decoded with \Couchbase\defaultDecoder */
+    lcb_U32 flags;
+    lcb_datatype_t datatype;
+    PCBC_ZEND_OBJECT_POST
+} pcbc_document_t;
+
 #define PCBC_SDSPEC_GET_PATH(_s, _p, _np)                                                                              \
     do {                                                                                                               \
         _p = (char *)(_s)->s.path.contig.bytes;                                                                        \
@@ -728,10 +926,16 @@ int pcbc_pp_ismapped(pcbc_pp_state *state);
 int pcbc_pp_keycount(pcbc_pp_state *state);
 int pcbc_pp_next(pcbc_pp_state *state);
 
-int pcbc_decode_value(zval *return_value, pcbc_bucket_t *bucket, const char *bytes, int bytes_len, lcb_U32 flags,
+int pcbc_decode_value(zval *return_value, pcbc_bucket_t *bucket, zval *bytes, lcb_U32 flags,
                       lcb_datatype_t datatype TSRMLS_DC);
-int pcbc_encode_value(pcbc_bucket_t *bucket, zval *value, void **bytes, lcb_size_t *nbytes, lcb_uint32_t *flags,
+int pcbc_decode_value_ex(zval *return_value, zval *decoder, zval *bytes, lcb_U32 flags,
+                         lcb_datatype_t datatype TSRMLS_DC);
+/* on success, the caller owns the string in bytes, and releases it with zval_ptr_dtor() once the command is scheduled */
+int pcbc_encode_value(pcbc_bucket_t *bucket, zval *value, PCBC_ZVAL *bytes, lcb_uint32_t *flags,
                       lcb_uint8_t *datatype TSRMLS_DC);
+int pcbc_default_encode(zval *value, PCBC_ZVAL *bytes, lcb_uint32_t *flags, lcb_uint8_t *datatype TSRMLS_DC);
+void pcbc_default_decode(zval *return_value, zval *bytes, lcb_U32 flags, lcb_datatype_t datatype TSRMLS_DC);
+int pcbc_transcoder_is_default(zval *callable, int is_encoder);
 
 lcb_U64 pcbc_base36_decode_str(const char *str, int len);
 char *pcbc_base36_encode_str(lcb_U64 num);
@@ -739,6 +943,7 @@ lcb_cas_t pcbc_cas_decode(zval *cas TSRMLS_DC);
 void pcbc_cas_encode(zval *return_value, lcb_cas_t cas TSRMLS_DC);
 
 void pcbc_bucket_subdoc_request(pcbc_bucket_t *data, void *builder, int is_lookup, zval *return_value TSRMLS_DC);
+void pcbc_bucket_subdoc_request_async(zval *bucket, void *builder, int is_lookup, zval *return_value TSRMLS_DC);
 void pcbc_http_request(zval *return_value, lcb_t conn, lcb_CMDHTTP *cmd, int json_response TSRMLS_DC);
 
 void pcbc_bucket_init(zval *return_value, pcbc_cluster_t *cluster, const char *bucketname,
@@ -746,6 +951,8 @@ void pcbc_bucket_init(zval *return_value, pcbc_cluster_t *cluster, const char *b
 void pcbc_bucket_manager_init(zval *return_value, zval *bucket TSRMLS_DC);
 void pcbc_bucket_get(pcbc_bucket_t *obj, pcbc_pp_state *pp_state, pcbc_pp_id *id, zval **lock, zval **expiry,
                      zval **groupid, zval *return_value TSRMLS_DC);
+void pcbc_bucket_get_async(zval *bucket, pcbc_pp_state *pp_state, pcbc_pp_id *id, zval **lock, zval **expiry,
+                           zval **groupid, zval *return_value TSRMLS_DC);
 
 lcb_U32 pcbc_subdoc_options_to_flags(int is_path, int is_lookup, zval *options TSRMLS_DC);
 int pcbc_lookup_in_builder_get(pcbc_lookup_in_builder_t *builder, char *path, int path_len, zval *options TSRMLS_DC);
@@ -781,9 +988,8 @@ void pcbc_mutation_token_init_php(zval *return_value, char *bucket, int bucket_l
 void pcbc_mutation_state_export_for_n1ql(pcbc_mutation_state_t *obj, zval *scan_vectors TSRMLS_DC);
 void pcbc_mutation_state_export_for_search(pcbc_mutation_state_t *obj, zval *scan_vectors TSRMLS_DC);
 
-void pcbc_document_init_decode(zval *return_value, pcbc_bucket_t *bucket, const char *bytes, int bytes_len,
-                               lcb_U32 flags, lcb_datatype_t datatype, lcb_cas_t cas,
-                               const lcb_MUTATION_TOKEN *token TSRMLS_DC);
+void pcbc_document_init_decode(zval *return_value, pcbc_bucket_t *bucket, zval *bytes, lcb_U32 flags,
+                               lcb_datatype_t datatype, lcb_cas_t cas, const lcb_MUTATION_TOKEN *token TSRMLS_DC);
 void pcbc_document_init_counter(zval *return_value, pcbc_bucket_t *bucket, lcb_U64 value, lcb_cas_t cas,
                                 const lcb_MUTATION_TOKEN *token TSRMLS_DC);
 void pcbc_document_init_error(zval *return_value, opcookie_res *header TSRMLS_DC);
@@ -906,6 +1112,10 @@ static inline pcbc_user_settings_t *pcbc_user_settings_fetch_object(zend_object
 {
     return (pcbc_user_settings_t *)((char *)obj - XtOffsetOf(pcbc_user_settings_t, std));
 }
+static inline pcbc_document_t *pcbc_document_fetch_object(zend_object *obj)
+{
+    return (pcbc_document_t *)((char *)obj - XtOffsetOf(pcbc_document_t, std));
+}
 #define Z_CLUSTER_OBJ(zo) (pcbc_cluster_fetch_object(zo))
 #define Z_CLUSTER_OBJ_P(zv) (pcbc_cluster_fetch_object(Z_OBJ_P(zv)))
 #define Z_CLUSTER_MANAGER_OBJ(zo) (pcbc_cluster_manager_fetch_object(zo))
@@ -936,6 +1146,8 @@ static inline pcbc_user_settings_t *pcbc_user_settings_fetch_object(zend_object
 #define Z_PASSWORD_AUTHENTICATOR_OBJ_P(zv) (pcbc_password_authenticator_fetch_object(Z_OBJ_P(zv)))
 #define Z_USER_SETTINGS_OBJ(zo) (pcbc_user_settings_fetch_object(zo))
 #define Z_USER_SETTINGS_OBJ_P(zv) (pcbc_user_settings_fetch_object(Z_OBJ_P(zv)))
+#define Z_DOCUMENT_OBJ(zo) (pcbc_document_fetch_object(zo))
+#define Z_DOCUMENT_OBJ_P(zv) (pcbc_document_fetch_object(Z_OBJ_P(zv)))
 #else
 #define Z_CLUSTER_OBJ(zo) ((pcbc_cluster_t *)zo)
 #define Z_CLUSTER_OBJ_P(zv) ((pcbc_cluster_t *)zend_object_store_get_object(zv TSRMLS_CC))
@@ -967,16 +1179,41 @@ static inline pcbc_user_settings_t *pcbc_user_settings_fetch_object(zend_object
 #define Z_PASSWORD_AUTHENTICATOR_OBJ_P(zv) ((pcbc_password_authenticator_t *)zend_object_store_get_object(zv TSRMLS_CC))
 #define Z_USER_SETTINGS_OBJ(zo) ((pcbc_user_settings_t *)zo)
 #define Z_USER_SETTINGS_OBJ_P(zv) ((pcbc_user_settings_t *)zend_object_store_get_object(zv TSRMLS_CC))
+#define Z_DOCUMENT_OBJ(zo) ((pcbc_document_t *)zo)
+#define Z_DOCUMENT_OBJ_P(zv) ((pcbc_document_t *)zend_object_store_get_object(zv TSRMLS_CC))
 #endif
 
+/* results of the operation, their keys and small buffers are carved from the arena blocks,
+ * which are released together in opcookie_destroy() */
+typedef struct opcookie_arena_block {
+    struct opcookie_arena_block *next;
+    size_t size;
+    size_t used;
+} opcookie_arena_block;
+
+#define PCBC_OPCOOKIE_ARENA_BLOCK_MIN 4096
+#define PCBC_OPCOOKIE_ARENA_BLOCK_MAX 65536
+
 typedef struct {
     opcookie_res *res_head;
     opcookie_res *res_tail;
+    opcookie_arena_block *arena;
+    int nres;
+    int breakout_nres; // when non-zero, K/V callbacks interrupt the event loop once nres reaches this value
     lcb_error_t first_error;
     int json_response;
     int json_options;
     int is_cbas; // FIXME: convert to bit-flags
     PCBC_ZVAL exc;
+    lcb_U64 started;         // when the operation was started, see pcbc_metrics_now()
+    lcb_U64 scheduled;       // when the commands have been encoded and handed to the library
+    pcbc_metrics_t *metrics; // set by the first response, to account total latency on destroy
+    pcbc_op_type_t op;
+    lcb_U64 responded;       // when the last response has been received
+    const char *trace_id;    // document ID or query, which identifies slow operation in the tracer report
+    int trace_id_len;
+    size_t payload;          // number of bytes received
+    int orphaned;            // responses to drop before destroying the cookie, see pcbc_connection_orphan()
 } opcookie;
 
 opcookie *opcookie_init();
@@ -984,6 +1221,12 @@ void opcookie_destroy(opcookie *cookie);
 void opcookie_push(opcookie *cookie, opcookie_res *res);
 lcb_error_t opcookie_get_first_error(opcookie *cookie);
 opcookie_res *opcookie_next_res(opcookie *cookie, opcookie_res *cur);
+opcookie_res *opcookie_shift(opcookie *cookie);
+void *opcookie_alloc(opcookie *cookie, size_t size);
+char *opcookie_strndup(opcookie *cookie, const char *str, size_t len);
+void opcookie_arena_reset(opcookie *cookie);
+void pcbc_metrics_service(lcb_t instance, opcookie *cookie, pcbc_op_type_t op);
+void pcbc_tracer_record(opcookie *cookie, lcb_U64 total TSRMLS_DC);
 
 #define FOREACH_OPCOOKIE_RES(Type, Res, cookie)                                                                        \
     Res = NULL;                                                                                                        \
@@ -999,9 +1242,158 @@ typedef struct {
 
 lcb_error_t proc_store_results(pcbc_bucket_t *bucket, zval *return_value, opcookie *cookie, int is_mapped TSRMLS_DC);
 
+/* default number of store operations kept in flight by Bucket::upsertStream() */
+#define PCBC_UPSERT_STREAM_WINDOW 1000
+
+typedef struct {
+    opcookie_res header;
+    char *key;
+    int key_len;
+    PCBC_ZVAL bytes;
+    lcb_U32 flags;
+    lcb_datatype_t datatype;
+    lcb_cas_t cas;
+} opcookie_get_res;
+
+typedef struct {
+    opcookie_res header;
+    lcb_U16 rflags;
+    PCBC_ZVAL row;
+} opcookie_n1qlrow_res;
+
+/* maximum number of rows buffered by the query stream before it yields control back to the caller */
+#define PCBC_N1QL_STREAM_WINDOW 128
+
+typedef struct {
+    PCBC_ZEND_OBJECT_PRE
+    pcbc_bucket_t *bucket;
+    PCBC_ZVAL bucket_zval;
+    opcookie *cookie;
+    pcbc_connection_t *conn; // the instance referring to the cookie, it might outlive the bucket at shutdown
+    lcb_N1QLHANDLE handle;
+    int nbuffered;
+    zend_bool started;
+    zend_bool waiting;
+    zend_bool complete;
+    zend_bool overflow; // rows are dropped, and the query will be cancelled once the buffered ones are consumed
+    long index;
+    PCBC_ZVAL current;
+    PCBC_ZVAL meta;
+    PCBC_ZEND_OBJECT_POST
+} pcbc_n1ql_query_stream_t;
+
+#if PHP_VERSION_ID >= 70000
+static inline pcbc_n1ql_query_stream_t *pcbc_n1ql_query_stream_fetch_object(zend_object *obj)
+{
+    return (pcbc_n1ql_query_stream_t *)((char *)obj - XtOffsetOf(pcbc_n1ql_query_stream_t, std));
+}
+#define Z_N1QL_QUERY_STREAM_OBJ(zo) (pcbc_n1ql_query_stream_fetch_object(zo))
+#define Z_N1QL_QUERY_STREAM_OBJ_P(zv) (pcbc_n1ql_query_stream_fetch_object(Z_OBJ_P(zv)))
+#else
+#define Z_N1QL_QUERY_STREAM_OBJ(zo) ((pcbc_n1ql_query_stream_t *)zo)
+#define Z_N1QL_QUERY_STREAM_OBJ_P(zv) ((pcbc_n1ql_query_stream_t *)zend_object_store_get_object(zv TSRMLS_CC))
+#endif
+
+void pcbc_n1ql_query_stream_init(zval *return_value, zval *bucket, int json_options, int is_cbas TSRMLS_DC);
+void pcbc_bucket_n1ql_stream_request(zval *bucket, lcb_CMDN1QL *cmd, int json_options, int is_cbas,
+                                     zval *return_value TSRMLS_DC);
+
+/* default number of get operations kept in flight by the iterator of Bucket::getMany() */
+#define PCBC_GET_MANY_WINDOW 1000
+
+typedef struct {
+    PCBC_ZEND_OBJECT_PRE
+    pcbc_bucket_t *bucket;
+    PCBC_ZVAL bucket_zval;
+    PCBC_ZVAL ids;
+    HashPosition ids_pos;
+    opcookie *cookie;
+    pcbc_connection_t *conn; // refers to the cookie while the gets are pending
+    int window;
+    int nscheduled;
+    int index;
+    zend_bool started;
+    zend_bool exhausted;
+    PCBC_ZVAL current;
+    PCBC_ZVAL current_id;
+    PCBC_ZEND_OBJECT_POST
+} pcbc_get_many_iterator_t;
+
+#if PHP_VERSION_ID >= 70000
+static inline pcbc_get_many_iterator_t *pcbc_get_many_iterator_fetch_object(zend_object *obj)
+{
+    return (pcbc_get_many_iterator_t *)((char *)obj - XtOffsetOf(pcbc_get_many_iterator_t, std));
+}
+#define Z_GET_MANY_ITERATOR_OBJ(zo) (pcbc_get_many_iterator_fetch_object(zo))
+#define Z_GET_MANY_ITERATOR_OBJ_P(zv) (pcbc_get_many_iterator_fetch_object(Z_OBJ_P(zv)))
+#else
+#define Z_GET_MANY_ITERATOR_OBJ(zo) ((pcbc_get_many_iterator_t *)zo)
+#define Z_GET_MANY_ITERATOR_OBJ_P(zv) ((pcbc_get_many_iterator_t *)zend_object_store_get_object(zv TSRMLS_CC))
+#endif
+
+void pcbc_get_many_iterator_init(zval *return_value, zval *bucket, zval *ids, int window TSRMLS_DC);
+
 #define proc_remove_results proc_store_results
 #define proc_touch_results proc_store_results
 
+typedef lcb_error_t (*pcbc_proc_results_fn)(pcbc_bucket_t *bucket, zval *return_value, opcookie *cookie,
+                                            int is_mapped TSRMLS_DC);
+
+typedef struct {
+    PCBC_ZEND_OBJECT_PRE
+    pcbc_bucket_t *bucket;
+    PCBC_ZVAL bucket_zval;
+    opcookie *cookie;
+    pcbc_connection_t *conn; // refers to the cookie until the future is resolved
+    pcbc_proc_results_fn proc;
+    int nscheduled;
+    int is_mapped;
+    zend_bool resolved;
+    lcb_error_t err;
+    PCBC_ZVAL result;
+    PCBC_ZEND_OBJECT_POST
+} pcbc_future_t;
+
+#if PHP_VERSION_ID >= 70000
+static inline pcbc_future_t *pcbc_future_fetch_object(zend_object *obj)
+{
+    return (pcbc_future_t *)((char *)obj - XtOffsetOf(pcbc_future_t, std));
+}
+#define Z_FUTURE_OBJ(zo) (pcbc_future_fetch_object(zo))
+#define Z_FUTURE_OBJ_P(zv) (pcbc_future_fetch_object(Z_OBJ_P(zv)))
+#else
+#define Z_FUTURE_OBJ(zo) ((pcbc_future_t *)zo)
+#define Z_FUTURE_OBJ_P(zv) ((pcbc_future_t *)zend_object_store_get_object(zv TSRMLS_CC))
+#endif
+
+void pcbc_future_init(zval *return_value, zval *bucket, opcookie *cookie, int nscheduled, int is_mapped,
+                      pcbc_proc_results_fn proc TSRMLS_DC);
+lcb_error_t pcbc_future_fetch(zval *future, zval *return_value TSRMLS_DC);
+
+typedef struct {
+    PCBC_ZEND_OBJECT_PRE
+    pcbc_bucket_t *bucket;
+    PCBC_ZVAL bucket_zval;
+    PCBC_ZVAL ops;
+    PCBC_ZEND_OBJECT_POST
+} pcbc_batch_t;
+
+#if PHP_VERSION_ID >= 70000
+static inline pcbc_batch_t *pcbc_batch_fetch_object(zend_object *obj)
+{
+    return (pcbc_batch_t *)((char *)obj - XtOffsetOf(pcbc_batch_t, std));
+}
+#define Z_BATCH_OBJ(zo) (pcbc_batch_fetch_object(zo))
+#define Z_BATCH_OBJ_P(zv) (pcbc_batch_fetch_object(Z_OBJ_P(zv)))
+#else
+#define Z_BATCH_OBJ(zo) ((pcbc_batch_t *)zo)
+#define Z_BATCH_OBJ_P(zv) ((pcbc_batch_t *)zend_object_store_get_object(zv TSRMLS_CC))
+#endif
+
+void pcbc_batch_init(zval *return_value, zval *bucket TSRMLS_DC);
+void pcbc_batch_dispatch(zval *batch, zval *futures TSRMLS_DC);
+void pcbc_batch_collect(zval *futures, zval *return_value TSRMLS_DC);
+
 #define pcbc_assert_number_of_commands(lcb, cmd, nscheduled, ntotal)                                                   \
     if (nscheduled != ntotal) {                                                                                        \
         pcbc_log(LOGARGS(lcb, ERROR), "Failed to schedule %s commands (%d out of %d sent)", cmd, nscheduled, ntotal);  \
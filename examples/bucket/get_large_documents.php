@@ -0,0 +1,71 @@
+<?php
+/**
+ * The following example measures reading of large documents with
+ * Bucket::get(). Every value is handed from the library callback to the
+ * decoder as a single PHP string, so the peak memory of one get() should
+ * stay close to the size of the raw value plus the size of the decoded
+ * value, and not to several copies of the raw value.
+ *
+ * Run it with the builds of the extension you want to compare, and the same
+ * arguments, to see the difference in throughput and peak memory. Every
+ * document is measured in a separate PHP process, so that the peak memory
+ * is not affected by the documents measured before it.
+ *
+ * Usage: php get_large_documents.php [connstr] [bucket] [iterations]
+ */
+
+$connstr = isset($argv[1]) ? $argv[1] : 'couchbase://localhost';
+$bucketName = isset($argv[2]) ? $argv[2] : 'default';
+$iterations = isset($argv[3]) ? (int)$argv[3] : 1000;
+
+$cluster = new \Couchbase\Cluster($connstr);
+$bucket = $cluster->openBucket($bucketName);
+
+if (isset($argv[4])) {
+    /*
+     * Measure single document, the process has been started by the code below.
+     */
+    $id = $argv[4];
+    $base = memory_get_usage();
+    $res = $bucket->get($id);
+    $peak = memory_get_peak_usage() - $base;
+    $size = strlen(is_string($res->value) ? $res->value : json_encode($res->value));
+    unset($res);
+
+    $start = microtime(true);
+    for ($i = 0; $i < $iterations; $i++) {
+        $res = $bucket->get($id);
+        unset($res);
+    }
+    $elapsed = microtime(true) - $start;
+
+    printf("%-20s %7d bytes: %8.1f gets/s, %8.1f MB/s, peak +%d bytes (%.2fx of value)\n",
+           $id, $size, $iterations / $elapsed, $size * $iterations / $elapsed / 1048576, $peak, $peak / $size);
+    exit(0);
+}
+
+/*
+ * Documents of 100, 250 and 500 KB, stored both as raw strings and as JSON
+ * arrays of small objects.
+ */
+$ids = [];
+foreach ([100, 250, 500] as $kb) {
+    $bucket->upsert("large-string-{$kb}k", str_repeat('x', $kb * 1024));
+    $ids[] = "large-string-{$kb}k";
+
+    $items = [];
+    for ($i = 0; $i * 64 < $kb * 1024; $i++) {
+        $items[] = ['id' => $i, 'name' => "item $i", 'price' => 12.5, 'tags' => ['a', 'b']];
+    }
+    $bucket->upsert("large-json-{$kb}k", $items);
+    $ids[] = "large-json-{$kb}k";
+}
+
+$php = escapeshellarg(PHP_BINARY);
+if (php_ini_loaded_file()) {
+    $php .= ' -c ' . escapeshellarg(php_ini_loaded_file());
+}
+foreach ($ids as $id) {
+    passthru(sprintf('%s %s %s %s %d %s', $php, escapeshellarg(__FILE__), escapeshellarg($connstr),
+                     escapeshellarg($bucketName), $iterations, escapeshellarg($id)));
+}
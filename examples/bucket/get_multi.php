@@ -0,0 +1,68 @@
+<?php
+/**
+ * The following example measures Bucket::get() with a large list of keys.
+ * The results of such multi-get, and copies of their keys, are carved from
+ * blocks of the operation arena, instead of being allocated one by one, so
+ * both wall time and the memory used while the operation is in flight
+ * depend on the allocation strategy.
+ *
+ * Run it with the builds of the extension you want to compare, and the same
+ * arguments. The measurement runs in a separate PHP process, so that the
+ * peak memory is not affected by the setup of the documents.
+ *
+ * Usage: php get_multi.php [connstr] [bucket] [keys] [iterations]
+ */
+
+$connstr = isset($argv[1]) ? $argv[1] : 'couchbase://localhost';
+$bucketName = isset($argv[2]) ? $argv[2] : 'default';
+$count = isset($argv[3]) ? (int)$argv[3] : 10000;
+$iterations = isset($argv[4]) ? (int)$argv[4] : 20;
+
+$cluster = new \Couchbase\Cluster($connstr);
+$bucket = $cluster->openBucket($bucketName);
+
+$ids = [];
+for ($i = 0; $i < $count; $i++) {
+    $ids[] = "multi-get-$i";
+}
+
+if (isset($argv[5])) {
+    /*
+     * Measure, the process has been started by the code below.
+     */
+    $base = memory_get_usage();
+    $res = $bucket->get($ids);
+    $peak = memory_get_peak_usage() - $base;
+    $retained = memory_get_usage() - $base;
+    unset($res);
+    $leaked = memory_get_usage() - $base;
+
+    $start = microtime(true);
+    for ($i = 0; $i < $iterations; $i++) {
+        $res = $bucket->get($ids);
+        unset($res);
+    }
+    $elapsed = microtime(true) - $start;
+
+    printf("get() of %d keys, %d iterations: %.3f s, %.2f ms per get(), %.2f us per key\n",
+           $count, $iterations, $elapsed, $elapsed * 1e3 / $iterations, $elapsed * 1e6 / $iterations / $count);
+    printf("memory: peak +%d bytes (%.1f per key), results +%d bytes, after release %+d bytes\n",
+           $peak, $peak / $count, $retained, $leaked);
+    printf("memory after %d more iterations: %+d bytes\n", $iterations, memory_get_usage() - $base);
+    exit(0);
+}
+
+foreach (array_chunk($ids, 1000) as $chunk) {
+    $docs = [];
+    foreach ($chunk as $id) {
+        $docs[$id] = ['value' => ['id' => $id, 'counter' => 42]];
+    }
+    $bucket->upsert($docs);
+}
+
+$php = escapeshellarg(PHP_BINARY);
+if (php_ini_loaded_file()) {
+    $php .= ' -c ' . escapeshellarg(php_ini_loaded_file());
+}
+passthru(sprintf('%s %s %s %s %d %d measure', $php, escapeshellarg(__FILE__), escapeshellarg($connstr),
+                 escapeshellarg($bucketName), $count, $iterations));
@@ -0,0 +1,30 @@
+<?php
+/**
+ * The following example measures the cost of Cluster::openBucket() when
+ * the connection is already in the pool, which is what applications
+ * opening buckets on every request pay after the first one.
+ *
+ * Usage: php open_bucket.php [connstr] [bucket] [iterations]
+ */
+
+$connstr = isset($argv[1]) ? $argv[1] : 'couchbase://localhost';
+$bucketName = isset($argv[2]) ? $argv[2] : 'default';
+$iterations = isset($argv[3]) ? (int)$argv[3] : 100000;
+
+$cluster = new \Couchbase\Cluster($connstr);
+
+/*
+ * The first call bootstraps the connection and puts it into the pool.
+ */
+$bucket = $cluster->openBucket($bucketName);
+unset($bucket);
+
+$start = microtime(true);
+for ($i = 0; $i < $iterations; $i++) {
+    $bucket = $cluster->openBucket($bucketName);
+    unset($bucket);
+}
+$elapsed = microtime(true) - $start;
+
+printf("%d calls in %.3f s, %.2f us per openBucket()\n", $iterations, $elapsed, $elapsed * 1e6 / $iterations);
+print_r(array_diff_key(\Couchbase\Pool::stats(), ['connections' => 1]));
@@ -0,0 +1,65 @@
+<?php
+/**
+ * The following example compares decoding time of the built-in PHP JSON parser
+ * and yyjson, which can be selected with couchbase.decoder.json_parser INI
+ * setting, when the extension has been built with yyjson headers.
+ *
+ * The documents are decoded with the default transcoder, in the same way as
+ * they would be decoded after get() or for the rows of the N1QL query.
+ *
+ * Usage: php json_parser.php [iterations]
+ */
+
+if (!\Couchbase\HAVE_YYJSON) {
+    die("Extension does not support yyjson parser, install yyjson headers and rebuild pecl/couchbase\n");
+}
+
+$iterations = isset($argv[1]) ? intval($argv[1]) : 10000;
+
+/*
+ * Some document shapes, which are typical for the Couchbase applications:
+ * small user profile, product with nested attributes, and the large result
+ * of the N1QL query.
+ */
+$profile = [
+    'type' => 'user',
+    'name' => 'Arthur Dent',
+    'email' => 'arthur@example.com',
+    'age' => 42,
+    'active' => true,
+    'roles' => ['reader', 'writer'],
+];
+$product = [
+    'type' => 'product',
+    'sku' => 'WID-0001',
+    'price' => 12.5,
+    'stock' => ['warehouse' => 3, 'store' => null],
+    'attributes' => array_fill(0, 20, ['name' => 'color', 'value' => 'blue', 'weight' => 0.25]),
+];
+$rows = [];
+for ($i = 0; $i < 1000; $i++) {
+    $rows[] = array_merge($profile, ['id' => "user::$i", 'score' => $i * 1.5]);
+}
+$documents = [
+    'profile' => json_encode($profile),
+    'product' => json_encode($product),
+    'query result' => json_encode(['results' => $rows]),
+];
+
+$flags = 0x02000006; /* COUCHBASE_VAL_IS_JSON with common flags of JSON document */
+foreach ($documents as $name => $json) {
+    printf("%s (%d bytes), %d iterations:\n", $name, strlen($json), $iterations);
+    foreach (['php', 'yyjson'] as $parser) {
+        ini_set('couchbase.decoder.json_parser', $parser);
+        foreach ([false, true] as $assoc) {
+            $options = ['jsonassoc' => $assoc];
+            $start = microtime(true);
+            for ($i = 0; $i < $iterations; $i++) {
+                \Couchbase\basicDecoderV1($json, $flags, 0, $options);
+            }
+            $elapsed = microtime(true) - $start;
+            printf("    %-6s %-7s %8.3f sec, %8.1f MB/s\n", $parser, $assoc ? 'arrays' : 'objects', $elapsed,
+                   strlen($json) * $iterations / $elapsed / 1048576);
+        }
+    }
+}
@@ -14,10 +14,46 @@
  *   limitations under the License.
  */
 
-#include <libcouchbase/couchbase.h>
-#include <php.h>
+#include "couchbase.h"
 
-#include "log.h"
+#ifndef PHP_WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#define PCBC_LOG_RATE_SLOTS 32
+/* how long the target, which could not be opened, is not tried again */
+#define PCBC_LOG_RETRY_DELAY_US 5000000
+
+struct pcbc_log_sink {
+    int fd;         // -1 until the target is opened
+    int is_socket;
+    int connecting;   // non-blocking connect of the socket is still in progress
+    lcb_U64 retry_at; // when the target, which has failed to open, might be tried again
+#ifndef PHP_WIN32
+    struct sockaddr_storage addr; // of tcp:// target, resolved only once
+    socklen_t addrlen;            // zero until the address is resolved
+#endif
+    long pid;       // the buffer inherited by the forked child belongs to the parent, and is discarded
+    char *buf;
+    size_t size;
+    size_t used;
+    lcb_U64 first_at; // when the oldest buffered record was written
+    struct {
+        char name[PCBC_LOG_SUBSYS_NAME_SIZE];
+        time_t window;
+        long count;
+        long suppressed;
+    } rates[PCBC_LOG_RATE_SLOTS];
+    int nrates;
+};
 
 static const char *level_to_string(int severity)
 {
@@ -41,6 +77,572 @@ static const char *level_to_string(int severity)
 
 #define PCBC_LOG_MSG_SIZE 1024
 
+static void log_handler(struct lcb_logprocs_st *procs, unsigned int iid, const char *subsys, int severity,
+                        const char *srcfile, int srcline, const char *fmt, va_list ap);
+
+struct pcbc_logger_st pcbc_logger = {{0 /* version */, {{log_handler} /* v1 */} /*v*/},
+                                     /** Minimum severity */
+                                     LCB_LOG_INFO,
+                                     /** Severity of the subsystems without own level */
+                                     LCB_LOG_INFO};
+
+/* returns -1 when the name is unknown */
+int pcbc_log_parse_level(const char *str)
+{
+    if (!strcmp(str, "TRACE") || !strcmp(str, "TRAC")) {
+        return LCB_LOG_TRACE;
+    } else if (!strcmp(str, "DEBUG") || !strcmp(str, "DEBG")) {
+        return LCB_LOG_DEBUG;
+    } else if (!strcmp(str, "INFO")) {
+        return LCB_LOG_INFO;
+    } else if (!strcmp(str, "WARN")) {
+        return LCB_LOG_WARN;
+    } else if (!strcmp(str, "ERROR") || !strcmp(str, "EROR")) {
+        return LCB_LOG_ERROR;
+    } else if (!strcmp(str, "FATAL") || !strcmp(str, "FATL")) {
+        return LCB_LOG_FATAL;
+    }
+    return -1;
+}
+
+static void update_minlevel()
+{
+    int ii;
+
+    pcbc_logger.minlevel = pcbc_logger.level;
+    for (ii = 0; ii < pcbc_logger.nsubsys; ++ii) {
+        if (pcbc_logger.subsys[ii].level < pcbc_logger.minlevel) {
+            pcbc_logger.minlevel = pcbc_logger.subsys[ii].level;
+        }
+    }
+}
+
+void pcbc_log_set_level(int level)
+{
+    pcbc_logger.level = level;
+    update_minlevel();
+}
+
+/* parses list like "pcbc/pool=DEBUG,lcb/=ERROR", where the name ending with slash matches all subsystems with this
+ * prefix. The list is applied only if all entries are valid */
+int pcbc_log_set_subsystem_levels(const char *spec)
+{
+    pcbc_log_subsys_t subsys[PCBC_LOG_SUBSYS_MAX];
+    const char *ptr = spec ? spec : "";
+    int nsubsys = 0;
+
+    memset(subsys, 0, sizeof(subsys));
+    while (*ptr) {
+        const char *end, *eq;
+        char level[8] = {0};
+
+        ptr += strspn(ptr, ", ");
+        if (*ptr == '\0') {
+            break;
+        }
+        end = ptr + strcspn(ptr, ", ");
+        eq = memchr(ptr, '=', end - ptr);
+        if (eq == NULL || eq == ptr || eq - ptr >= PCBC_LOG_SUBSYS_NAME_SIZE || end - eq - 1 >= (int)sizeof(level) ||
+            nsubsys == PCBC_LOG_SUBSYS_MAX) {
+            return FAILURE;
+        }
+        memcpy(level, eq + 1, end - eq - 1);
+        subsys[nsubsys].level = pcbc_log_parse_level(level);
+        if (subsys[nsubsys].level < 0) {
+            return FAILURE;
+        }
+        memcpy(subsys[nsubsys].name, ptr, eq - ptr);
+        nsubsys++;
+        ptr = end;
+    }
+    memcpy(pcbc_logger.subsys, subsys, sizeof(subsys));
+    pcbc_logger.nsubsys = nsubsys;
+    update_minlevel();
+    return SUCCESS;
+}
+
+static int subsystem_level(const char *subsys)
+{
+    int ii;
+
+    for (ii = 0; ii < pcbc_logger.nsubsys; ++ii) {
+        const char *name = pcbc_logger.subsys[ii].name;
+        size_t len = strlen(name);
+
+        if (strcmp(name, subsys) == 0 || (name[len - 1] == '/' && strncmp(name, subsys, len) == 0)) {
+            return pcbc_logger.subsys[ii].level;
+        }
+    }
+    return pcbc_logger.level;
+}
+
+#ifndef PHP_WIN32
+/* the process ID is checked for every message, so it is cached, and refreshed only in the forked child */
+static long log_pid = 0;
+static int log_atfork_registered = 0;
+
+static void log_atfork_child(void)
+{
+    log_pid = getpid();
+}
+#endif
+
+void pcbc_log_startup(void)
+{
+#ifndef PHP_WIN32
+    log_pid = getpid();
+    if (!log_atfork_registered) {
+        log_atfork_registered = pthread_atfork(NULL, NULL, log_atfork_child) == 0;
+    }
+#endif
+}
+
+static pcbc_log_sink_t *log_sink(TSRMLS_D)
+{
+    pcbc_log_sink_t *sink = PCBCG(log_sink);
+
+    if (sink == NULL) {
+        sink = PCBCG(log_sink) = pecalloc(1, sizeof(pcbc_log_sink_t), 1);
+        sink->fd = -1;
+#ifndef PHP_WIN32
+        sink->pid = log_pid;
+#endif
+    }
+#ifndef PHP_WIN32
+    if (sink->pid != log_pid) {
+        if (sink->fd >= 0) {
+            close(sink->fd);
+            sink->fd = -1;
+        }
+        sink->connecting = 0;
+        sink->used = 0;
+        sink->nrates = 0;
+        sink->pid = log_pid;
+    }
+#endif
+    return sink;
+}
+
+static int log_buffered(TSRMLS_D)
+{
+#ifdef PHP_WIN32
+    return 0;
+#else
+    return PCBCG(log_target) != NULL && PCBCG(log_target)[0] != '\0';
+#endif
+}
+
+#ifndef PHP_WIN32
+#ifdef MSG_NOSIGNAL
+#define PCBC_LOG_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define PCBC_LOG_SEND_FLAGS 0
+#endif
+
+static int log_resolve(pcbc_log_sink_t *sink, const char *target)
+{
+    struct addrinfo hints, *res = NULL;
+    char host[256] = {0};
+    const char *port = strrchr(target + 6, ':');
+
+    if (port == NULL || port - (target + 6) >= (int)sizeof(host)) {
+        return FAILURE;
+    }
+    memcpy(host, target + 6, port - (target + 6));
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if (getaddrinfo(host, port + 1, &hints, &res) != 0) {
+        return FAILURE;
+    }
+    if (res == NULL || res->ai_addrlen > sizeof(sink->addr)) {
+        if (res) {
+            freeaddrinfo(res);
+        }
+        return FAILURE;
+    }
+    memcpy(&sink->addr, res->ai_addr, res->ai_addrlen);
+    sink->addrlen = res->ai_addrlen;
+    freeaddrinfo(res);
+    return SUCCESS;
+}
+
+/* starts connection to the collector. The socket is non-blocking from the beginning, so that unreachable collector
+ * does not stall the request, and the connection is completed in the background, see log_sink_ready() */
+static int log_connect(pcbc_log_sink_t *sink, const char *target)
+{
+    struct sockaddr_un unix_addr;
+    struct sockaddr *addr;
+    socklen_t addrlen;
+    int fd;
+
+    sink->connecting = 0;
+    if (strncmp(target, "unix://", 7) == 0) {
+        if (strlen(target + 7) >= sizeof(unix_addr.sun_path)) {
+            return -1;
+        }
+        memset(&unix_addr, 0, sizeof(unix_addr));
+        unix_addr.sun_family = AF_UNIX;
+        strcpy(unix_addr.sun_path, target + 7);
+        addr = (struct sockaddr *)&unix_addr;
+        addrlen = sizeof(unix_addr);
+    } else {
+        if (sink->addrlen == 0 && log_resolve(sink, target) != SUCCESS) {
+            return -1;
+        }
+        addr = (struct sockaddr *)&sink->addr;
+        addrlen = sink->addrlen;
+    }
+    fd = socket(addr->sa_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // the collector which does not keep up loses records instead of blocking the requests
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    if (connect(fd, addr, addrlen) != 0) {
+        if (errno != EINPROGRESS) {
+            close(fd);
+            return -1;
+        }
+        sink->connecting = 1;
+    }
+#ifdef SO_NOSIGPIPE
+    {
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+    }
+#endif
+    return fd;
+}
+
+/* returns 1 when the socket is connected, 0 while the connection is in progress, and -1 if it has failed */
+static int log_sink_ready(pcbc_log_sink_t *sink)
+{
+    struct pollfd pfd;
+    int err = 0;
+    socklen_t len = sizeof(err);
+
+    if (!sink->connecting) {
+        return 1;
+    }
+    pfd.fd = sink->fd;
+    pfd.events = POLLOUT;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 0) <= 0) {
+        return 0;
+    }
+    if (getsockopt(sink->fd, SOL_SOCKET, SO_ERROR, &err, &len) != 0 || err != 0) {
+        return -1;
+    }
+    sink->connecting = 0;
+    return 1;
+}
+
+static void log_sink_open(pcbc_log_sink_t *sink TSRMLS_DC)
+{
+    const char *target = PCBCG(log_target);
+
+    if (strncmp(target, "unix://", 7) == 0 || strncmp(target, "tcp://", 6) == 0) {
+        sink->fd = log_connect(sink, target);
+        sink->is_socket = 1;
+    } else {
+        if (strncmp(target, "file://", 7) == 0) {
+            target += 7;
+        }
+        sink->fd = open(target, O_WRONLY | O_APPEND | O_CREAT, 0644);
+        sink->is_socket = 0;
+    }
+    if (sink->fd >= 0) {
+        fcntl(sink->fd, F_SETFD, FD_CLOEXEC);
+    }
+}
+
+/* discards the records starting at the offset, and reports their number to PHP error log */
+static void log_sink_drop(pcbc_log_sink_t *sink, size_t off)
+{
+    char msg[128];
+    long dropped = 0;
+    const char *ptr = sink->buf + off;
+
+    while ((ptr = memchr(ptr, '\n', sink->buf + sink->used - ptr)) != NULL) {
+        dropped++;
+        ptr++;
+    }
+    snprintf(msg, sizeof(msg), "[cb,WARN] (pcbc/log) %ld records dropped, because the log target is not writable",
+             dropped);
+    {
+        TSRMLS_FETCH();
+        php_log_err(msg TSRMLS_CC);
+    }
+    sink->used = 0;
+}
+
+/* writes all buffered records with as few system calls as possible */
+static void log_sink_write(pcbc_log_sink_t *sink)
+{
+    size_t off = 0;
+    int err = 0;
+
+    while (sink->fd >= 0 && off < sink->used) {
+        ssize_t rv;
+
+        if (sink->is_socket) {
+            rv = send(sink->fd, sink->buf + off, sink->used - off, PCBC_LOG_SEND_FLAGS);
+        } else {
+            rv = write(sink->fd, sink->buf + off, sink->used - off);
+        }
+        if (rv > 0) {
+            off += rv;
+        } else if (rv < 0 && errno == EINTR) {
+            continue;
+        } else {
+            err = rv < 0 ? errno : EIO;
+            break;
+        }
+    }
+    if (off < sink->used) {
+        // the socket with partially written record is reconnected, so that the collector does not see broken line
+        if (sink->fd >= 0 && sink->is_socket && (off > 0 || (err != EAGAIN && err != EWOULDBLOCK))) {
+            close(sink->fd);
+            sink->fd = -1;
+        }
+        log_sink_drop(sink, off);
+    }
+    sink->used = 0;
+}
+
+/* writes the buffer to the target, opening it if necessary. While the connection is in progress, the records are kept
+ * in the buffer, unless the space is needed for the new ones. The target, which could not be opened, is not tried
+ * again for PCBC_LOG_RETRY_DELAY_US, and the records are dropped meanwhile */
+static void log_sink_flush(pcbc_log_sink_t *sink, int need_space TSRMLS_DC)
+{
+    int rv;
+
+    if (sink->used == 0) {
+        return;
+    }
+    if (sink->fd < 0) {
+        if (pcbc_metrics_now() < sink->retry_at) {
+            log_sink_drop(sink, 0);
+            return;
+        }
+        log_sink_open(sink TSRMLS_CC);
+        if (sink->fd < 0) {
+            sink->retry_at = pcbc_metrics_now() + PCBC_LOG_RETRY_DELAY_US;
+            log_sink_drop(sink, 0);
+            return;
+        }
+    }
+    rv = log_sink_ready(sink);
+    if (rv < 0) {
+        close(sink->fd);
+        sink->fd = -1;
+        sink->connecting = 0;
+        sink->retry_at = pcbc_metrics_now() + PCBC_LOG_RETRY_DELAY_US;
+        log_sink_drop(sink, 0);
+        return;
+    }
+    if (rv == 0) {
+        if (need_space) {
+            log_sink_drop(sink, 0);
+        }
+        return;
+    }
+    log_sink_write(sink);
+}
+
+static char *log_reserve(pcbc_log_sink_t *sink, size_t need TSRMLS_DC)
+{
+    if (sink->buf == NULL) {
+        sink->size = PCBCG(log_buffer_size) > 4096 ? PCBCG(log_buffer_size) : 4096;
+        sink->buf = pemalloc(sink->size, 1);
+    }
+    if (sink->used + need > sink->size) {
+        log_sink_flush(sink, 1 TSRMLS_CC);
+        if (need > sink->size) {
+            sink->buf = perealloc(sink->buf, need, 1);
+            sink->size = need;
+        }
+    }
+    return sink->buf + sink->used;
+}
+
+static size_t log_format(char *buf, const char *fmt, va_list ap)
+{
+    int len = vsnprintf(buf, PCBC_LOG_MSG_SIZE, fmt, ap);
+
+    if (len < 0) {
+        len = 0;
+    } else if (len >= PCBC_LOG_MSG_SIZE) {
+        len = PCBC_LOG_MSG_SIZE - 1;
+    }
+    return len;
+}
+
+/* appends string as JSON, the buffer must have space for six bytes per character */
+static char *log_escape(char *out, const char *str, size_t len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t ii;
+
+    for (ii = 0; ii < len; ++ii) {
+        unsigned char ch = (unsigned char)str[ii];
+
+        if (ch == '"' || ch == '\\') {
+            *out++ = '\\';
+            *out++ = ch;
+        } else if (ch < 0x20) {
+            *out++ = '\\';
+            *out++ = 'u';
+            *out++ = '0';
+            *out++ = '0';
+            *out++ = hex[ch >> 4];
+            *out++ = hex[ch & 0xf];
+        } else {
+            *out++ = ch;
+        }
+    }
+    return out;
+}
+
+/* appends JSON record to the buffer, which is written when it is full, or when the oldest record is older than
+ * couchbase.log_flush_interval_ms */
+static void log_buffer_record(int severity, const char *subsys, int srcline, int iid, void *instance, const char *msg,
+                              size_t msg_len TSRMLS_DC)
+{
+    pcbc_log_sink_t *sink = log_sink(TSRMLS_C);
+    struct timeval tv;
+    struct tm tm;
+    char head[128], tail[96];
+    int head_len, tail_len;
+    size_t subsys_len = strlen(subsys);
+    lcb_U64 now = pcbc_metrics_now();
+    char *out;
+
+    gettimeofday(&tv, NULL);
+    php_gmtime_r(&tv.tv_sec, &tm);
+    head_len = snprintf(head, sizeof(head),
+                        "{\"time\":\"%04d-%02d-%02dT%02d:%02d:%02d.%06ldZ\",\"pid\":%ld,\"level\":\"%s\",\"subsys\":\"",
+                        tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                        (long)tv.tv_usec, sink->pid, level_to_string(severity));
+    if (instance) {
+        tail_len = snprintf(tail, sizeof(tail), "\",\"line\":%d,\"instance\":\"%p\",\"msg\":\"", srcline, instance);
+    } else if (iid) {
+        tail_len = snprintf(tail, sizeof(tail), "\",\"line\":%d,\"iid\":%d,\"msg\":\"", srcline, iid);
+    } else {
+        tail_len = snprintf(tail, sizeof(tail), "\",\"line\":%d,\"msg\":\"", srcline);
+    }
+
+    out = log_reserve(sink, head_len + tail_len + 6 * (subsys_len + msg_len) + 3 TSRMLS_CC);
+    memcpy(out, head, head_len);
+    out = log_escape(out + head_len, subsys, subsys_len);
+    memcpy(out, tail, tail_len);
+    out = log_escape(out + tail_len, msg, msg_len);
+    memcpy(out, "\"}\n", 3);
+    out += 3;
+    if (sink->used == 0) {
+        sink->first_at = now;
+    }
+    sink->used = out - sink->buf;
+    if (now - sink->first_at >= (lcb_U64)PCBCG(log_flush_interval) * 1000) {
+        log_sink_flush(sink, 0 TSRMLS_CC);
+    }
+}
+#endif
+
+void pcbc_log_flush(TSRMLS_D)
+{
+#ifndef PHP_WIN32
+    if (PCBCG(log_sink) && log_buffered(TSRMLS_C)) {
+        log_sink_flush(log_sink(TSRMLS_C), 0 TSRMLS_CC);
+    }
+#endif
+}
+
+/* writes the rest of the buffer, but does not open the target, because the settings might be gone already */
+void pcbc_log_sink_destroy(pcbc_log_sink_t *sink)
+{
+    if (sink == NULL) {
+        return;
+    }
+#ifndef PHP_WIN32
+    if (sink->pid == log_pid) {
+        log_sink_write(sink);
+    }
+    if (sink->fd >= 0) {
+        close(sink->fd);
+    }
+#endif
+    if (sink->buf) {
+        pefree(sink->buf, 1);
+    }
+    pefree(sink, 1);
+}
+
+/* writes formatted message to the buffer, or directly to PHP error log */
+static void log_emit(int severity, const char *subsys, int srcline, int iid, void *instance, const char *msg,
+                     size_t msg_len TSRMLS_DC)
+{
+    char *buf = NULL;
+
+#ifndef PHP_WIN32
+    if (log_buffered(TSRMLS_C)) {
+        log_buffer_record(severity, subsys, srcline, iid, instance, msg, msg_len TSRMLS_CC);
+        return;
+    }
+#endif
+    spprintf(&buf, 0, "[cb,%s] (%s L:%d) %s", level_to_string(severity), subsys, srcline, msg);
+    php_log_err(buf TSRMLS_CC);
+    efree(buf);
+}
+
+/* counts the message against per-second limit of its subsystem. The number of suppressed messages is reported with
+ * the first message of the next second */
+static int log_admit(const char *subsys TSRMLS_DC)
+{
+    pcbc_log_sink_t *sink;
+    time_t now;
+    int ii;
+
+    if (PCBCG(log_rate_limit) == 0) {
+        return 1;
+    }
+    sink = log_sink(TSRMLS_C);
+    now = time(NULL);
+    for (ii = 0; ii < sink->nrates; ++ii) {
+        if (strncmp(sink->rates[ii].name, subsys, PCBC_LOG_SUBSYS_NAME_SIZE - 1) == 0) {
+            break;
+        }
+    }
+    if (ii == sink->nrates) {
+        if (ii == PCBC_LOG_RATE_SLOTS) {
+            return 1;
+        }
+        memset(&sink->rates[ii], 0, sizeof(sink->rates[ii]));
+        strncpy(sink->rates[ii].name, subsys, PCBC_LOG_SUBSYS_NAME_SIZE - 1);
+        sink->rates[ii].window = now;
+        sink->nrates++;
+    }
+    if (sink->rates[ii].window != now) {
+        long suppressed = sink->rates[ii].suppressed;
+
+        sink->rates[ii].window = now;
+        sink->rates[ii].count = 0;
+        sink->rates[ii].suppressed = 0;
+        if (suppressed) {
+            char msg[96];
+            int len = snprintf(msg, sizeof(msg), "%ld messages suppressed by couchbase.log_rate_limit", suppressed);
+            log_emit(LCB_LOG_WARN, subsys, __LINE__, 0, NULL, msg, len TSRMLS_CC);
+        }
+    }
+    if (sink->rates[ii].count >= PCBCG(log_rate_limit)) {
+        sink->rates[ii].suppressed++;
+        return 0;
+    }
+    sink->rates[ii].count++;
+    return 1;
+}
+
 static void log_handler(struct lcb_logprocs_st *procs, unsigned int iid, const char *subsys, int severity,
                         const char *srcfile, int srcline, const char *fmt, va_list ap)
 {
@@ -51,15 +653,24 @@ static void log_handler(struct lcb_logprocs_st *procs, unsigned int iid, const c
     if (severity < logger->minlevel) {
         return;
     }
+    if (subsys == NULL) {
+        subsys = "";
+    }
+    if (severity < subsystem_level(subsys) || !log_admit(subsys TSRMLS_CC)) {
+        return;
+    }
 
+#ifndef PHP_WIN32
+    if (log_buffered(TSRMLS_C)) {
+        size_t len = log_format(buf, fmt, ap);
+        log_buffer_record(severity, subsys, srcline, iid, NULL, buf, len TSRMLS_CC);
+        return;
+    }
+#endif
     pcbc_log_formatter(buf, PCBC_LOG_MSG_SIZE, level_to_string(severity), subsys, srcline, iid, NULL, 1, fmt, ap);
     php_log_err(buf TSRMLS_CC);
 }
 
-struct pcbc_logger_st pcbc_logger = {{0 /* version */, {{log_handler} /* v1 */} /*v*/},
-                                     /** Minimum severity */
-                                     LCB_LOG_INFO};
-
 void pcbc_log(int severity, lcb_t instance, const char *subsys, const char *srcfile, int srcline, const char *fmt, ...)
 {
     va_list ap;
@@ -69,11 +680,33 @@ void pcbc_log(int severity, lcb_t instance, const char *subsys, const char *srcf
     if (severity < pcbc_logger.minlevel) {
         return;
     }
+    if (severity < subsystem_level(subsys) || !log_admit(subsys TSRMLS_CC)) {
+        return;
+    }
 
     va_start(ap, fmt);
+#ifndef PHP_WIN32
+    if (log_buffered(TSRMLS_C)) {
+        size_t len = log_format(buf, fmt, ap);
+        va_end(ap);
+        log_buffer_record(severity, subsys, srcline, 0, (void *)instance, buf, len TSRMLS_CC);
+        return;
+    }
+#endif
     pcbc_log_formatter(buf, PCBC_LOG_MSG_SIZE, level_to_string(severity), subsys, srcline, 0, (void *)instance, 0, fmt,
                        ap);
     va_end(ap);
 
     php_log_err(buf TSRMLS_CC);
 }
+
+/* writes the message as is, without size limit of pcbc_log(), which is needed for reports in JSON */
+void pcbc_log_raw(int severity, const char *subsys, int srcline, const char *msg)
+{
+    TSRMLS_FETCH();
+
+    if (severity < pcbc_logger.minlevel || severity < subsystem_level(subsys)) {
+        return;
+    }
+    log_emit(severity, subsys, srcline, 0, NULL, msg, strlen(msg) TSRMLS_CC);
+}
@@ -19,13 +19,34 @@
 
 #include <libcouchbase/couchbase.h>
 
+#define PCBC_LOG_SUBSYS_MAX 16
+#define PCBC_LOG_SUBSYS_NAME_SIZE 32
+
+typedef struct {
+    char name[PCBC_LOG_SUBSYS_NAME_SIZE];
+    int level;
+} pcbc_log_subsys_t;
+
 struct pcbc_logger_st {
     struct lcb_logprocs_st base;
-    int minlevel;
+    int minlevel; // the lowest of all levels, to discard messages early
+    int level;    // couchbase.log_level
+    int nsubsys;  // couchbase.log_subsystem_levels
+    pcbc_log_subsys_t subsys[PCBC_LOG_SUBSYS_MAX];
 };
 
+/* buffer of the records, which are written to couchbase.log_target in batches */
+typedef struct pcbc_log_sink pcbc_log_sink_t;
+
 void pcbc_log_formatter(char *buf, int buf_size, const char *severity, const char *subsystem, int srcline,
                         int instance_id, void *instance_ptr, int is_lcb, const char *fmt, va_list ap);
 void pcbc_log(int severity, lcb_t instance, const char *subsys, const char *srcfile, int srcline, const char *fmt, ...);
+void pcbc_log_raw(int severity, const char *subsys, int srcline, const char *msg);
+int pcbc_log_parse_level(const char *str);
+void pcbc_log_set_level(int level);
+int pcbc_log_set_subsystem_levels(const char *spec);
+void pcbc_log_startup(void);
+void pcbc_log_flush(TSRMLS_D);
+void pcbc_log_sink_destroy(pcbc_log_sink_t *sink);
 
 #endif // LOG_H_
@@ -18,20 +18,103 @@
 
 opcookie *opcookie_init()
 {
-    return ecalloc(1, sizeof(opcookie));
+    opcookie *cookie = ecalloc(1, sizeof(opcookie));
+
+    cookie->started = pcbc_metrics_now();
+    cookie->scheduled = cookie->started;
+    return cookie;
 }
 
-void opcookie_destroy(opcookie *cookie)
+#define PCBC_ARENA_HEADER_SIZE ZEND_MM_ALIGNED_SIZE(sizeof(opcookie_arena_block))
+#define PCBC_ARENA_DATA(block) ((char *)(block) + PCBC_ARENA_HEADER_SIZE)
+
+static void opcookie_arena_free(opcookie_arena_block *block)
 {
-    opcookie_res *iter = cookie->res_head;
-    while (iter != NULL) {
-        opcookie_res *cur = iter;
-        iter = cur->next;
+    while (block != NULL) {
+        opcookie_arena_block *cur = block;
+        block = cur->next;
         efree(cur);
     }
+}
+
+void opcookie_destroy(opcookie *cookie)
+{
+    if (cookie->metrics) {
+        lcb_U64 total = pcbc_metrics_now() - cookie->started;
+        TSRMLS_FETCH();
+
+        pcbc_metrics_record(cookie->metrics, 1, cookie->op, total);
+        pcbc_tracer_record(cookie, total TSRMLS_CC);
+    }
+    // all results are allocated from the arena, so they are not freed one by one
+    opcookie_arena_free(cookie->arena);
     efree(cookie);
 }
 
+/* returns zeroed memory, which lives until the cookie is destroyed or the arena is reset */
+void *opcookie_alloc(opcookie *cookie, size_t size)
+{
+    opcookie_arena_block *block = cookie->arena;
+    char *ptr;
+
+    size = ZEND_MM_ALIGNED_SIZE(size);
+    if (size > PCBC_OPCOOKIE_ARENA_BLOCK_MAX / 2) {
+        // large chunks get dedicated block, which is placed behind the current one to keep filling the latter
+        block = emalloc(PCBC_ARENA_HEADER_SIZE + size);
+        block->size = block->used = size;
+        if (cookie->arena) {
+            block->next = cookie->arena->next;
+            cookie->arena->next = block;
+        } else {
+            block->next = NULL;
+            cookie->arena = block;
+        }
+        ptr = PCBC_ARENA_DATA(block);
+        memset(ptr, 0, size);
+        return ptr;
+    }
+    if (block == NULL || block->size - block->used < size) {
+        size_t block_size = block ? block->size * 2 : PCBC_OPCOOKIE_ARENA_BLOCK_MIN;
+
+        if (block_size > PCBC_OPCOOKIE_ARENA_BLOCK_MAX) {
+            block_size = PCBC_OPCOOKIE_ARENA_BLOCK_MAX;
+        }
+        // the chunk up to half of the maximum might still be larger than the next block in the growth sequence
+        if (block_size < size) {
+            block_size = size;
+        }
+        block = emalloc(PCBC_ARENA_HEADER_SIZE + block_size);
+        block->size = block_size;
+        block->used = 0;
+        block->next = cookie->arena;
+        cookie->arena = block;
+    }
+    ptr = PCBC_ARENA_DATA(block) + block->used;
+    block->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+char *opcookie_strndup(opcookie *cookie, const char *str, size_t len)
+{
+    char *ptr = opcookie_alloc(cookie, len + 1);
+    memcpy(ptr, str, len);
+    return ptr;
+}
+
+/* releases memory of all results at once, the caller must ensure that none of them is referenced anymore */
+void opcookie_arena_reset(opcookie *cookie)
+{
+    if (cookie->arena) {
+        opcookie_arena_free(cookie->arena->next);
+        cookie->arena->next = NULL;
+        cookie->arena->used = 0;
+    }
+    cookie->res_head = NULL;
+    cookie->res_tail = NULL;
+    cookie->trace_id = NULL;
+}
+
 lcb_error_t opcookie_get_first_error(opcookie *cookie)
 {
     return cookie->first_error;
@@ -47,6 +130,7 @@ void opcookie_push(opcookie *cookie, opcookie_res *res)
         cookie->res_tail = res;
     }
     res->next = NULL;
+    cookie->nres++;
 
     if (res->err != LCB_SUCCESS && cookie->first_error == LCB_SUCCESS) {
         cookie->first_error = res->err;
@@ -61,3 +145,17 @@ opcookie_res *opcookie_next_res(opcookie *cookie, opcookie_res *cur)
         return cur->next;
     }
 }
+
+opcookie_res *opcookie_shift(opcookie *cookie)
+{
+    opcookie_res *res = cookie->res_head;
+
+    if (res != NULL) {
+        cookie->res_head = res->next;
+        if (cookie->res_head == NULL) {
+            cookie->res_tail = NULL;
+        }
+        res->next = NULL;
+    }
+    return res;
+}
@@ -47,7 +47,6 @@ static zend_always_inline int pcbc_get_parameters_array_ex(int param_count, PCBC
 #endif
 
 #if PHP_VERSION_ID >= 70000
-#define PCBC_HASH_GET_CURRENT_DATA_EX(ht, pos) zend_hash_get_current_data_ex(ht, pos)
 static zend_always_inline int pcbc_hash_str_get_current_key_ex(HashTable *ht, char **str, uint *len,
                                                                zend_ulong *num_index, HashPosition *pos)
 {
@@ -63,15 +62,6 @@ static zend_always_inline int pcbc_hash_str_get_current_key_ex(HashTable *ht, ch
     return key_type;
 }
 #else
-static zend_always_inline PCBC_ZVAL *pcbc_hash_get_current_data_ex(HashTable *ht, HashPosition *pos)
-{
-    zval **result;
-    if (zend_hash_get_current_data_ex(ht, (void **)&result, pos) != SUCCESS) {
-        return NULL;
-    }
-    return result;
-}
-#define PCBC_HASH_GET_CURRENT_DATA_EX(ht, pos) pcbc_hash_get_current_data_ex(ht, pos)
 static zend_always_inline int pcbc_hash_str_get_current_key_ex(HashTable *ht, char **str, uint *len,
                                                                zend_ulong *num_index, HashPosition *pos)
 {
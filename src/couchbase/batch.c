@@ -0,0 +1,430 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+/**
+ * Batch collects operations of different types, and executes them with single network roundtrip.
+ *
+ * Every operation is stored as an array [target, methodName, args...], where target is the bucket (or subdocument
+ * builder), and methodName is the name of its *Async() method, which schedules the command and returns Future.
+ */
+
+#include "couchbase.h"
+
+#define LOGARGS(batch, lvl) LCB_LOG_##lvl, batch->bucket->conn->lcb, "pcbc/batch", __FILE__, __LINE__
+
+#define PCBC_BATCH_MAX_ARGS 3
+
+extern zend_class_entry *pcbc_lookup_in_builder_ce;
+extern zend_class_entry *pcbc_future_ce;
+
+zend_class_entry *pcbc_batch_ce;
+
+static void batch_add(pcbc_batch_t *batch, zval *target, const char *method, zval **args, int nargs TSRMLS_DC)
+{
+    PCBC_ZVAL op;
+    int i;
+
+    PCBC_ZVAL_ALLOC(op);
+    array_init(PCBC_P(op));
+    PCBC_ADDREF_P(target);
+    add_next_index_zval(PCBC_P(op), target);
+    ADD_NEXT_INDEX_STRING(PCBC_P(op), method);
+    for (i = 0; i < nargs && args[i]; ++i) {
+        PCBC_ADDREF_P(args[i]);
+        add_next_index_zval(PCBC_P(op), args[i]);
+    }
+    add_next_index_zval(PCBC_P(batch->ops), PCBC_P(op));
+}
+
+static int batch_schedule(zval *op, zval *return_value TSRMLS_DC)
+{
+    PCBC_ZVAL params[PCBC_BATCH_MAX_ARGS];
+    zval *target, *method;
+    int i, nparams;
+
+    target = php_array_fetchn(op, 0);
+    method = php_array_fetchn(op, 1);
+    nparams = php_array_count(op) - 2;
+    for (i = 0; i < nparams; ++i) {
+        params[i] = PCBC_D(php_array_fetchn(op, i + 2));
+    }
+    return call_user_function(EG(function_table), PCBC_CP(target), method, return_value, nparams, params TSRMLS_CC);
+}
+
+/* {{{ proto void Batch::__construct() Should not be called directly */
+PHP_METHOD(Batch, __construct)
+{
+    throw_pcbc_exception("Accessing private constructor.", LCB_EINVAL);
+}
+/* }}} */
+
+/* {{{ proto \Couchbase\Batch Batch::get(string|array $ids, array $options = []) */
+PHP_METHOD(Batch, get)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(getThis());
+    zval *args[2] = {NULL, NULL};
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z|z", &args[0], &args[1]);
+    if (rv == FAILURE) {
+        return;
+    }
+    batch_add(obj, PCBC_P(obj->bucket_zval), "getAsync", args, 2 TSRMLS_CC);
+    RETURN_ZVAL(getThis(), 1, 0);
+} /* }}} */
+
+/* {{{ proto \Couchbase\Batch Batch::upsert(string|array $ids, mixed $value, array $options = []) */
+PHP_METHOD(Batch, upsert)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(getThis());
+    zval *args[3] = {NULL, NULL, NULL};
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zz|z", &args[0], &args[1], &args[2]);
+    if (rv == FAILURE) {
+        return;
+    }
+    batch_add(obj, PCBC_P(obj->bucket_zval), "upsertAsync", args, 3 TSRMLS_CC);
+    RETURN_ZVAL(getThis(), 1, 0);
+} /* }}} */
+
+/* {{{ proto \Couchbase\Batch Batch::replace(string|array $ids, mixed $value, array $options = []) */
+PHP_METHOD(Batch, replace)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(getThis());
+    zval *args[3] = {NULL, NULL, NULL};
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zz|z", &args[0], &args[1], &args[2]);
+    if (rv == FAILURE) {
+        return;
+    }
+    batch_add(obj, PCBC_P(obj->bucket_zval), "replaceAsync", args, 3 TSRMLS_CC);
+    RETURN_ZVAL(getThis(), 1, 0);
+} /* }}} */
+
+/* {{{ proto \Couchbase\Batch Batch::remove(string|array $ids, array $options = []) */
+PHP_METHOD(Batch, remove)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(getThis());
+    zval *args[2] = {NULL, NULL};
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z|z", &args[0], &args[1]);
+    if (rv == FAILURE) {
+        return;
+    }
+    batch_add(obj, PCBC_P(obj->bucket_zval), "removeAsync", args, 2 TSRMLS_CC);
+    RETURN_ZVAL(getThis(), 1, 0);
+} /* }}} */
+
+/* {{{ proto \Couchbase\Batch Batch::counter(string|array $ids, int $delta = 1, array $options = []) */
+PHP_METHOD(Batch, counter)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(getThis());
+    zval *args[3] = {NULL, NULL, NULL};
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z|zz", &args[0], &args[1], &args[2]);
+    if (rv == FAILURE) {
+        return;
+    }
+    batch_add(obj, PCBC_P(obj->bucket_zval), "counterAsync", args, 3 TSRMLS_CC);
+    RETURN_ZVAL(getThis(), 1, 0);
+} /* }}} */
+
+/* {{{ proto \Couchbase\Batch Batch::touch(string|array $ids, int $expiry, array $options = []) */
+PHP_METHOD(Batch, touch)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(getThis());
+    zval *args[3] = {NULL, NULL, NULL};
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "zz|z", &args[0], &args[1], &args[2]);
+    if (rv == FAILURE) {
+        return;
+    }
+    batch_add(obj, PCBC_P(obj->bucket_zval), "touchAsync", args, 3 TSRMLS_CC);
+    RETURN_ZVAL(getThis(), 1, 0);
+} /* }}} */
+
+/* {{{ proto \Couchbase\Batch Batch::lookupIn(\Couchbase\LookupInBuilder $builder) */
+PHP_METHOD(Batch, lookupIn)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(getThis());
+    zval *builder = NULL;
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "O", &builder, pcbc_lookup_in_builder_ce);
+    if (rv == FAILURE) {
+        return;
+    }
+    if (Z_LOOKUP_IN_BUILDER_OBJ_P(builder)->bucket != obj->bucket) {
+        throw_pcbc_exception("LookupInBuilder belongs to different bucket", LCB_EINVAL);
+        RETURN_NULL();
+    }
+    batch_add(obj, builder, "executeAsync", NULL, 0 TSRMLS_CC);
+    RETURN_ZVAL(getThis(), 1, 0);
+} /* }}} */
+
+/* schedules all operations of the batch, and appends their futures to the array */
+void pcbc_batch_dispatch(zval *batch, zval *futures TSRMLS_DC)
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ_P(batch);
+    PCBC_ZVAL ops;
+    int rv, i, nops;
+    lcb_U64 now;
+
+    // the batch is emptied, so it can be filled again while the results are processed
+    ops = obj->ops;
+    PCBC_ZVAL_ALLOC(obj->ops);
+    array_init(PCBC_P(obj->ops));
+    nops = php_array_count(PCBC_P(ops));
+
+    lcb_sched_enter(obj->bucket->conn->lcb);
+    for (i = 0; i < nops; ++i) {
+        PCBC_ZVAL future;
+
+        PCBC_ZVAL_ALLOC(future);
+        ZVAL_NULL(PCBC_P(future));
+        rv = batch_schedule(php_array_fetchn(PCBC_P(ops), i), PCBC_P(future) TSRMLS_CC);
+        add_next_index_zval(futures, PCBC_P(future));
+        if (rv == FAILURE || EG(exception)) {
+            pcbc_log(LOGARGS(obj, ERROR), "Failed to schedule batch operation #%d, %d out of %d sent", i, i, nops);
+            break;
+        }
+    }
+    // nothing is sent before lcb_sched_leave(), so encoding of the later operations is not their service time
+    now = pcbc_metrics_now();
+    for (i = 0; i < php_array_count(futures); ++i) {
+        zval *future = php_array_fetchn(futures, i);
+
+        if (Z_TYPE_P(future) == IS_OBJECT && instanceof_function(Z_OBJCE_P(future), pcbc_future_ce TSRMLS_CC) &&
+            Z_FUTURE_OBJ_P(future)->cookie) {
+            Z_FUTURE_OBJ_P(future)->cookie->scheduled = now;
+        }
+    }
+    // the scheduled commands are sent even on failure, and will be drained when their futures are destroyed
+    lcb_sched_leave(obj->bucket->conn->lcb);
+    zval_ptr_dtor(&ops);
+}
+
+/* resolves the futures, and builds the list of results */
+void pcbc_batch_collect(zval *futures, zval *return_value TSRMLS_DC)
+{
+    int i, nops = php_array_count(futures);
+
+    array_init(return_value);
+    for (i = 0; i < nops; ++i) {
+        PCBC_ZVAL res;
+        lcb_error_t err;
+        zval *future = php_array_fetchn(futures, i);
+
+        PCBC_ZVAL_ALLOC(res);
+        ZVAL_NULL(PCBC_P(res));
+        if (Z_TYPE_P(future) == IS_OBJECT && instanceof_function(Z_OBJCE_P(future), pcbc_future_ce TSRMLS_CC)) {
+            err = pcbc_future_fetch(future, PCBC_P(res) TSRMLS_CC);
+            if (err != LCB_SUCCESS) {
+                // failed operation does not interrupt the batch, the exception takes its place in the results
+                pcbc_exception_init_lcb(PCBC_P(res), err, NULL, NULL, NULL TSRMLS_CC);
+            }
+        }
+        add_next_index_zval(return_value, PCBC_P(res));
+    }
+}
+
+/* {{{ proto array Batch::execute()
+   Sends all collected operations at once, and returns their results in the order of insertion */
+PHP_METHOD(Batch, execute)
+{
+    pcbc_batch_t *obj;
+    PCBC_ZVAL futures;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_BATCH_OBJ_P(getThis());
+
+    PCBC_ZVAL_ALLOC(futures);
+    array_init(PCBC_P(futures));
+    pcbc_batch_dispatch(getThis(), PCBC_P(futures) TSRMLS_CC);
+    if (!EG(exception)) {
+        lcb_wait(obj->bucket->conn->lcb);
+        pcbc_batch_collect(PCBC_P(futures), return_value TSRMLS_CC);
+    }
+    zval_ptr_dtor(&futures);
+} /* }}} */
+
+/* {{{ proto int Batch::count() */
+PHP_METHOD(Batch, count)
+{
+    pcbc_batch_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_BATCH_OBJ_P(getThis());
+    RETURN_LONG(php_array_count(PCBC_P(obj->ops)));
+} /* }}} */
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Batch_none, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Batch_get, 0, 0, 1)
+ZEND_ARG_INFO(0, ids)
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Batch_upsert, 0, 0, 2)
+ZEND_ARG_INFO(0, ids)
+ZEND_ARG_INFO(0, value)
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Batch_counter, 0, 0, 1)
+ZEND_ARG_INFO(0, ids)
+ZEND_ARG_INFO(0, delta)
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Batch_touch, 0, 0, 2)
+ZEND_ARG_INFO(0, ids)
+ZEND_ARG_INFO(0, expiry)
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Batch_lookupIn, 0, 0, 1)
+ZEND_ARG_INFO(0, builder)
+ZEND_END_ARG_INFO()
+
+// clang-format off
+zend_function_entry batch_methods[] = {
+    PHP_ME(Batch, __construct, ai_Batch_none, ZEND_ACC_PRIVATE | ZEND_ACC_FINAL | ZEND_ACC_CTOR)
+    PHP_ME(Batch, get, ai_Batch_get, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, upsert, ai_Batch_upsert, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, replace, ai_Batch_upsert, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, remove, ai_Batch_get, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, counter, ai_Batch_counter, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, touch, ai_Batch_touch, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, lookupIn, ai_Batch_lookupIn, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, execute, ai_Batch_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Batch, count, ai_Batch_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_FE_END
+};
+// clang-format on
+
+zend_object_handlers pcbc_batch_handlers;
+
+void pcbc_batch_init(zval *return_value, zval *bucket TSRMLS_DC)
+{
+    pcbc_batch_t *batch;
+
+    object_init_ex(return_value, pcbc_batch_ce);
+    batch = Z_BATCH_OBJ_P(return_value);
+#if PHP_VERSION_ID >= 70000
+    ZVAL_COPY(&batch->bucket_zval, bucket);
+#else
+    Z_ADDREF_P(bucket);
+    batch->bucket_zval = bucket;
+#endif
+    batch->bucket = Z_BUCKET_OBJ_P(bucket);
+    PCBC_ZVAL_ALLOC(batch->ops);
+    array_init(PCBC_P(batch->ops));
+}
+
+static void batch_free_object(pcbc_free_object_arg *object TSRMLS_DC) /* {{{ */
+{
+    pcbc_batch_t *obj = Z_BATCH_OBJ(object);
+
+    if (!Z_ISUNDEF(obj->ops)) {
+        zval_ptr_dtor(&obj->ops);
+        ZVAL_UNDEF(PCBC_P(obj->ops));
+    }
+    if (!Z_ISUNDEF(obj->bucket_zval)) {
+        zval_ptr_dtor(&obj->bucket_zval);
+        ZVAL_UNDEF(PCBC_P(obj->bucket_zval));
+    }
+    obj->bucket = NULL;
+
+    zend_object_std_dtor(&obj->std TSRMLS_CC);
+#if PHP_VERSION_ID < 70000
+    efree(obj);
+#endif
+} /* }}} */
+
+static pcbc_create_object_retval batch_create_object(zend_class_entry *class_type TSRMLS_DC)
+{
+    pcbc_batch_t *obj = NULL;
+
+    obj = PCBC_ALLOC_OBJECT_T(pcbc_batch_t, class_type);
+
+    zend_object_std_init(&obj->std, class_type TSRMLS_CC);
+    object_properties_init(&obj->std, class_type);
+
+#if PHP_VERSION_ID >= 70000
+    obj->std.handlers = &pcbc_batch_handlers;
+    return &obj->std;
+#else
+    {
+        zend_object_value ret;
+        ret.handle = zend_objects_store_put(obj, (zend_objects_store_dtor_t)zend_objects_destroy_object,
+                                            batch_free_object, NULL TSRMLS_CC);
+        ret.handlers = &pcbc_batch_handlers;
+        return ret;
+    }
+#endif
+}
+
+static HashTable *batch_get_debug_info(zval *object, int *is_temp TSRMLS_DC) /* {{{ */
+{
+    pcbc_batch_t *obj = NULL;
+#if PHP_VERSION_ID >= 70000
+    zval retval;
+#else
+    zval retval = zval_used_for_init;
+#endif
+
+    *is_temp = 1;
+    obj = Z_BATCH_OBJ_P(object);
+
+    array_init(&retval);
+    ADD_ASSOC_LONG_EX(&retval, "operations", php_array_count(PCBC_P(obj->ops)));
+
+    return Z_ARRVAL(retval);
+} /* }}} */
+
+PHP_MINIT_FUNCTION(Batch)
+{
+    zend_class_entry ce;
+
+    INIT_NS_CLASS_ENTRY(ce, "Couchbase", "Batch", batch_methods);
+    pcbc_batch_ce = zend_register_internal_class(&ce TSRMLS_CC);
+    pcbc_batch_ce->create_object = batch_create_object;
+    PCBC_CE_FLAGS_FINAL(pcbc_batch_ce);
+    PCBC_CE_DISABLE_SERIALIZATION(pcbc_batch_ce);
+
+    memcpy(&pcbc_batch_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    pcbc_batch_handlers.get_debug_info = batch_get_debug_info;
+#if PHP_VERSION_ID >= 70000
+    pcbc_batch_handlers.free_obj = batch_free_object;
+    pcbc_batch_handlers.offset = XtOffsetOf(pcbc_batch_t, std);
+#endif
+    return SUCCESS;
+}
@@ -42,6 +42,14 @@ PHP_METHOD(Bucket, n1ix_create);
 PHP_METHOD(Bucket, n1ix_drop);
 PHP_METHOD(Bucket, http_request);
 PHP_METHOD(Bucket, durability);
+PHP_METHOD(Bucket, getAsync);
+PHP_METHOD(Bucket, getMany);
+PHP_METHOD(Bucket, upsertAsync);
+PHP_METHOD(Bucket, upsertStream);
+PHP_METHOD(Bucket, removeAsync);
+PHP_METHOD(Bucket, counterAsync);
+PHP_METHOD(Bucket, replaceAsync);
+PHP_METHOD(Bucket, touchAsync);
 
 /* {{{ proto void Bucket::__construct()
    Should not be called directly */
@@ -51,6 +59,76 @@ PHP_METHOD(Bucket, __construct)
 }
 /* }}} */
 
+/* {{{ proto void Bucket::waitAll()
+   Runs the event loop until all operations scheduled with *Async() methods are completed */
+PHP_METHOD(Bucket, waitAll)
+{
+    pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    lcb_wait(obj->conn->lcb);
+    RETURN_NULL();
+}
+/* }}} */
+
+/* {{{ proto void Bucket::tick()
+   Processes network events which are ready, without blocking. Completed futures become ready, and their wait()
+   returns immediately. */
+PHP_METHOD(Bucket, tick)
+{
+    pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
+    lcb_error_t err;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    err = lcb_tick_nowait(obj->conn->lcb);
+    if (err != LCB_SUCCESS) {
+        throw_lcb_exception(err);
+    }
+    RETURN_NULL();
+}
+/* }}} */
+
+/* {{{ proto array Bucket::watchers()
+   Returns sockets and the timeout the library is waiting for, so that an external event loop can call tick() when
+   one of them is ready */
+PHP_METHOD(Bucket, watchers)
+{
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    rv = pcbc_io_watchers(return_value TSRMLS_CC);
+    if (rv == FAILURE) {
+        throw_pcbc_exception("IO plugin does not expose its sockets and timers", LCB_CLIENT_FEATURE_UNAVAILABLE);
+        RETURN_NULL();
+    }
+}
+/* }}} */
+
+/* {{{ proto \Couchbase\Batch Bucket::batch()
+   Creates a container for operations of different types, which will be sent together */
+PHP_METHOD(Bucket, batch)
+{
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    pcbc_batch_init(return_value, getThis() TSRMLS_CC);
+}
+/* }}} */
+
 /* {{{ proto void Bucket::setTranscoder(callable $encoder, callable $decoder)
    Sets custom encoder and decoder functions for handling serialization */
 PHP_METHOD(Bucket, setTranscoder)
@@ -85,6 +163,8 @@ PHP_METHOD(Bucket, setTranscoder)
     PCBC_ADDREF_P(decoder);
     obj->decoder = decoder;
 #endif
+    obj->native_encoder = pcbc_transcoder_is_default(encoder, 1);
+    obj->native_decoder = pcbc_transcoder_is_default(decoder, 0);
 
     RETURN_NULL();
 }
@@ -405,6 +485,57 @@ PHP_METHOD(Bucket, query)
     }
 } /* }}} */
 
+/* {{{ proto \Couchbase\N1qlQueryStream Bucket::queryStream($query, boolean $jsonassoc = false) */
+PHP_METHOD(Bucket, queryStream)
+{
+    int rv;
+    pcbc_bucket_t *obj;
+    zend_bool jsonassoc = 0;
+    int json_options = 0;
+    zval *query;
+    smart_str buf = {0};
+    int last_error;
+    zval *options = NULL;
+    lcb_CMDN1QL cmd = {0};
+    int is_cbas = 0;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "o|b", &query, &jsonassoc);
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    if (jsonassoc) {
+        json_options |= PHP_JSON_OBJECT_AS_ARRAY;
+    }
+    obj = Z_BUCKET_OBJ_P(getThis());
+    if (instanceof_function(Z_OBJCE_P(query), pcbc_n1ql_query_ce TSRMLS_CC)) {
+        PCBC_READ_PROPERTY(options, pcbc_n1ql_query_ce, query, "options", 0);
+        if (!Z_N1QL_QUERY_OBJ_P(query)->adhoc) {
+            cmd.cmdflags |= LCB_CMDN1QL_F_PREPCACHE;
+        }
+        if (Z_N1QL_QUERY_OBJ_P(query)->cross_bucket) {
+            cmd.cmdflags |= LCB_CMD_F_MULTIAUTH;
+        }
+    } else if (instanceof_function(Z_OBJCE_P(query), pcbc_analytics_query_ce TSRMLS_CC)) {
+        PCBC_READ_PROPERTY(options, pcbc_analytics_query_ce, query, "options", 0);
+        cmd.cmdflags |= LCB_CMDN1QL_F_CBASQUERY;
+        is_cbas = 1;
+    } else {
+        throw_pcbc_exception("Only N1QL and Analytics queries can be streamed", LCB_EINVAL);
+        RETURN_NULL();
+    }
+    PCBC_JSON_ENCODE(&buf, options, 0, last_error);
+    if (last_error != 0) {
+        pcbc_log(LOGARGS(obj, WARN), "Failed to encode N1QL query as JSON: json_last_error=%d", last_error);
+        smart_str_free(&buf);
+        RETURN_NULL();
+    }
+    smart_str_0(&buf);
+    PCBC_SMARTSTR_SET(buf, cmd.query, cmd.nquery);
+    pcbc_log(LOGARGS(obj, TRACE), "%s STREAM: %*s", is_cbas ? "ANALYTICS" : "N1QL", PCBC_SMARTSTR_TRACE(buf));
+    pcbc_bucket_n1ql_stream_request(getThis(), &cmd, json_options, is_cbas, return_value TSRMLS_CC);
+    smart_str_free(&buf);
+} /* }}} */
+
 /* {{{ proto mixed Bucket::mapSize($id) */
 PHP_METHOD(Bucket, mapSize)
 {
@@ -961,6 +1092,16 @@ ZEND_ARG_INFO(0, ids)
 ZEND_ARG_INFO(0, options)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(ai_Bucket_getMany, 0, 0, 1)
+ZEND_ARG_INFO(0, ids)
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Bucket_upsertStream, 0, 0, 1)
+ZEND_ARG_INFO(0, docs)
+ZEND_ARG_INFO(0, options)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(ai_Bucket_getAndLock, 0, 0, 3)
 ZEND_ARG_INFO(0, ids)
 ZEND_ARG_INFO(0, lockTime)
@@ -1025,6 +1166,11 @@ ZEND_ARG_INFO(0, query)
 ZEND_ARG_INFO(0, jsonAsArray)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(ai_Bucket_queryStream, 0, 0, 2)
+ZEND_ARG_INFO(0, query)
+ZEND_ARG_INFO(0, jsonAsArray)
+ZEND_END_ARG_INFO()
+
 ZEND_BEGIN_ARG_INFO_EX(ai_Bucket_mapSize, 0, 0, 1)
 ZEND_ARG_INFO(0, id)
 ZEND_END_ARG_INFO()
@@ -1109,11 +1255,24 @@ zend_function_entry bucket_methods[] = {
     PHP_ME(Bucket, unlock, ai_Bucket_unlock, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, touch, ai_Bucket_touch, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, counter, ai_Bucket_counter, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, getAsync, ai_Bucket_get, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, getMany, ai_Bucket_getMany, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, upsertAsync, ai_Bucket_upsert, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, upsertStream, ai_Bucket_upsertStream, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, removeAsync, ai_Bucket_remove, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, counterAsync, ai_Bucket_counter, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, replaceAsync, ai_Bucket_upsert, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, touchAsync, ai_Bucket_touch, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, waitAll, ai_Bucket_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, tick, ai_Bucket_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, watchers, ai_Bucket_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, batch, ai_Bucket_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, lookupIn, ai_Bucket_lookupIn, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, retrieveIn, ai_Bucket_retrieveIn, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, mutateIn, ai_Bucket_mutateIn, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, manager, ai_Bucket_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, query, ai_Bucket_query, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Bucket, queryStream, ai_Bucket_queryStream, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, mapSize, ai_Bucket_mapSize, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, mapAdd, ai_Bucket_mapAdd, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Bucket, mapRemove, ai_Bucket_mapRemove, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
@@ -1144,6 +1303,7 @@ static void pcbc_bucket_free_object(pcbc_free_object_arg *object TSRMLS_DC) /* {
     pcbc_bucket_t *obj = Z_BUCKET_OBJ(object);
 
     pcbc_connection_delref(obj->conn TSRMLS_CC);
+    obj->conn = NULL;
     if (!Z_ISUNDEF(obj->encoder)) {
         zval_ptr_dtor(&obj->encoder);
         ZVAL_UNDEF(PCBC_P(obj->encoder));
@@ -1251,6 +1411,8 @@ void pcbc_bucket_init(zval *return_value, pcbc_cluster_t *cluster, const char *b
     PCBC_ZVAL_ALLOC(bucket->decoder);
     PCBC_STRING(bucket->encoder, "\\Couchbase\\defaultEncoder");
     PCBC_STRING(bucket->decoder, "\\Couchbase\\defaultDecoder");
+    bucket->native_encoder = 1;
+    bucket->native_decoder = 1;
 }
 
 zval *bop_get_return_doc(zval *return_value, const char *key, int key_len, int is_mapped TSRMLS_DC)
@@ -26,10 +26,14 @@ typedef struct {
 
 static void ftsrow_callback(lcb_t instance, int ignoreme, const lcb_RESPFTS *resp)
 {
-    opcookie_ftsrow_res *result = ecalloc(1, sizeof(opcookie_ftsrow_res));
+    opcookie_ftsrow_res *result = opcookie_alloc((opcookie *)resp->cookie, sizeof(opcookie_ftsrow_res));
     opcookie *cookie = (opcookie *)resp->cookie;
     TSRMLS_FETCH();
 
+    cookie->payload += resp->nrow;
+    if (resp->rflags & LCB_RESP_F_FINAL) {
+        pcbc_metrics_service(instance, cookie, PCBC_OP_SEARCH);
+    }
     result->header.err = resp->rc;
     if (result->header.err == LCB_HTTP_ERROR) {
         pcbc_log(LOGARGS(instance, ERROR), "Failed to search in index. %d: %.*s", (int)resp->htresp->htstatus,
@@ -150,6 +154,8 @@ void pcbc_bucket_cbft_request(pcbc_bucket_t *bucket, lcb_CMDFTS *cmd, int json_r
     cookie = opcookie_init();
     cookie->json_response = json_response;
     cookie->json_options = json_options;
+    cookie->trace_id = cmd->query;
+    cookie->trace_id_len = cmd->nquery;
     err = lcb_fts_query(bucket->conn->lcb, cookie, cmd);
     if (err == LCB_SUCCESS) {
         lcb_wait(bucket->conn->lcb);
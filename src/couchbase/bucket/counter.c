@@ -29,7 +29,7 @@ typedef struct {
 
 void counter_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    opcookie_arithmetic_res *result = ecalloc(1, sizeof(opcookie_arithmetic_res));
+    opcookie_arithmetic_res *result = opcookie_alloc((opcookie *)rb->cookie, sizeof(opcookie_arithmetic_res));
     const lcb_RESPCOUNTER *resp = (const lcb_RESPCOUNTER *)rb;
     const lcb_MUTATION_TOKEN *mutinfo;
     TSRMLS_FETCH();
@@ -38,7 +38,7 @@ void counter_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
     PCBC_RESP_ERR_COPY(result->header, cbtype, rb);
     result->key_len = resp->nkey;
     if (resp->nkey) {
-        result->key = estrndup(resp->key, resp->nkey);
+        result->key = opcookie_strndup((opcookie *)rb->cookie, resp->key, resp->nkey);
     }
     result->value = resp->value;
     result->cas = resp->cas;
@@ -76,17 +76,13 @@ static lcb_error_t proc_arithmetic_results(pcbc_bucket_t *bucket, zval *return_v
 
     FOREACH_OPCOOKIE_RES(opcookie_arithmetic_res, res, cookie)
     {
-        if (res->key) {
-            efree(res->key);
-        }
         PCBC_RESP_ERR_FREE(res->header);
     }
 
     return err;
 }
 
-// counter($id, $delta {, $initial, $expiry}) : MetaDoc
-PHP_METHOD(Bucket, counter)
+static void bucket_counter_common(INTERNAL_FUNCTION_PARAMETERS, zend_bool async)
 {
     pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
     int ii, ncmds, nscheduled;
@@ -139,6 +135,12 @@ PHP_METHOD(Bucket, counter)
     }
     pcbc_assert_number_of_commands(obj->conn->lcb, "counter", nscheduled, ncmds);
 
+    if (async && (nscheduled || err == LCB_SUCCESS)) {
+        pcbc_future_init(return_value, getThis(), cookie, nscheduled, pcbc_pp_ismapped(&pp_state),
+                         proc_arithmetic_results TSRMLS_CC);
+        return;
+    }
+
     if (nscheduled) {
         lcb_wait(obj->conn->lcb);
 
@@ -151,3 +153,15 @@ PHP_METHOD(Bucket, counter)
         throw_lcb_exception(err);
     }
 }
+
+// counter($id, $delta {, $initial, $expiry}) : MetaDoc
+PHP_METHOD(Bucket, counter)
+{
+    bucket_counter_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
+}
+
+// counterAsync($id, $delta {, $initial, $expiry}) : Future
+PHP_METHOD(Bucket, counterAsync)
+{
+    bucket_counter_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
+}
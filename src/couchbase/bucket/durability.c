@@ -24,12 +24,12 @@ typedef struct {
 
 void durability_callback(lcb_t instance, const void *cookie, lcb_error_t error, const lcb_durability_resp_t *resp)
 {
-    opcookie_durability_res *result = ecalloc(1, sizeof(opcookie_durability_res));
+    opcookie_durability_res *result = opcookie_alloc((opcookie *)cookie, sizeof(opcookie_durability_res));
     TSRMLS_FETCH();
 
     result->header.err = error;
     if (resp->v.v0.key) {
-        result->key = estrndup(resp->v.v0.key, resp->v.v0.nkey);
+        result->key = opcookie_strndup((opcookie *)cookie, resp->v.v0.key, resp->v.v0.nkey);
     }
 
     opcookie_push((opcookie *)cookie, &result->header);
@@ -59,13 +59,6 @@ static lcb_error_t proc_durability_results(pcbc_bucket_t *bucket, zval *return_v
         }
     }
 
-    FOREACH_OPCOOKIE_RES(opcookie_durability_res, res, cookie)
-    {
-        if (res->key) {
-            efree(res->key);
-        }
-    }
-
     return err;
 }
 
@@ -18,37 +18,34 @@
 
 #define LOGARGS(instance, lvl) LCB_LOG_##lvl, instance, "pcbc/get", __FILE__, __LINE__
 
-typedef struct {
-    opcookie_res header;
-    char *key;
-    int key_len;
-    char *bytes;
-    int bytes_len;
-    lcb_U32 flags;
-    lcb_datatype_t datatype;
-    lcb_cas_t cas;
-} opcookie_get_res;
-
 void get_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    opcookie_get_res *result = ecalloc(1, sizeof(opcookie_get_res));
+    opcookie *cookie = (opcookie *)rb->cookie;
+    opcookie_get_res *result = opcookie_alloc(cookie, sizeof(opcookie_get_res));
     const lcb_RESPGET *resp = (const lcb_RESPGET *)rb;
     TSRMLS_FETCH();
 
     PCBC_RESP_ERR_COPY(result->header, cbtype, rb);
     result->key_len = resp->nkey;
     if (resp->nkey) {
-        result->key = estrndup(resp->key, resp->nkey);
+        result->key = opcookie_strndup(cookie, resp->key, resp->nkey);
     }
-    result->bytes_len = resp->nvalue;
+    // the only copy of the value, the decoder will reuse this string
+    PCBC_ZVAL_ALLOC(result->bytes);
     if (resp->nvalue) {
-        result->bytes = estrndup(resp->value, resp->nvalue);
+        PCBC_STRINGL(result->bytes, resp->value, resp->nvalue);
+    } else {
+        ZVAL_EMPTY_STRING(PCBC_P(result->bytes));
     }
     result->flags = resp->itmflags;
     result->datatype = resp->datatype;
     result->cas = resp->cas;
 
-    opcookie_push((opcookie *)rb->cookie, &result->header);
+    opcookie_push(cookie, &result->header);
+    if (cookie->breakout_nres && cookie->nres >= cookie->breakout_nres) {
+        // the iterator of getMany() wants to refill its window before all operations are completed
+        lcb_breakout(instance);
+    }
 }
 
 static lcb_error_t proc_get_results(pcbc_bucket_t *bucket, zval *return_value, opcookie *cookie,
@@ -68,7 +65,7 @@ static lcb_error_t proc_get_results(pcbc_bucket_t *bucket, zval *return_value, o
             zval *doc = bop_get_return_doc(return_value, res->key, res->key_len, is_mapped TSRMLS_CC);
 
             if (res->header.err == LCB_SUCCESS) {
-                pcbc_document_init_decode(doc, bucket, res->bytes, res->bytes_len, res->flags, res->datatype, res->cas,
+                pcbc_document_init_decode(doc, bucket, PCBC_P(res->bytes), res->flags, res->datatype, res->cas,
                                           NULL TSRMLS_CC);
             } else {
                 pcbc_document_init_error(doc, &res->header TSRMLS_CC);
@@ -78,20 +75,16 @@ static lcb_error_t proc_get_results(pcbc_bucket_t *bucket, zval *return_value, o
 
     FOREACH_OPCOOKIE_RES(opcookie_get_res, res, cookie)
     {
-        if (res->key) {
-            efree(res->key);
-        }
-        if (res->bytes) {
-            efree(res->bytes);
-        }
+        zval_ptr_dtor(&res->bytes);
         PCBC_RESP_ERR_FREE(res->header);
     }
 
     return err;
 }
 
-void pcbc_bucket_get(pcbc_bucket_t *obj, pcbc_pp_state *pp_state, pcbc_pp_id *id, zval **lock, zval **expiry,
-                     zval **groupid, zval *return_value TSRMLS_DC)
+/* when async_bucket is not NULL, the results are not awaited, and return_value is initialized as Future */
+static void bucket_get_common(pcbc_bucket_t *obj, zval *async_bucket, pcbc_pp_state *pp_state, pcbc_pp_id *id,
+                              zval **lock, zval **expiry, zval **groupid, zval *return_value TSRMLS_DC)
 {
     int ii, ncmds, nscheduled;
     opcookie *cookie;
@@ -134,6 +127,12 @@ void pcbc_bucket_get(pcbc_bucket_t *obj, pcbc_pp_state *pp_state, pcbc_pp_id *id
     }
     pcbc_assert_number_of_commands(obj->conn->lcb, "get", nscheduled, ncmds);
 
+    if (async_bucket && (nscheduled || err == LCB_SUCCESS)) {
+        pcbc_future_init(return_value, async_bucket, cookie, nscheduled, pcbc_pp_ismapped(pp_state),
+                         proc_get_results TSRMLS_CC);
+        return;
+    }
+
     if (nscheduled) {
         lcb_wait(obj->conn->lcb);
         err = proc_get_results(obj, return_value, cookie, pcbc_pp_ismapped(pp_state) TSRMLS_CC);
@@ -146,6 +145,18 @@ void pcbc_bucket_get(pcbc_bucket_t *obj, pcbc_pp_state *pp_state, pcbc_pp_id *id
     }
 }
 
+void pcbc_bucket_get(pcbc_bucket_t *obj, pcbc_pp_state *pp_state, pcbc_pp_id *id, zval **lock, zval **expiry,
+                     zval **groupid, zval *return_value TSRMLS_DC)
+{
+    bucket_get_common(obj, NULL, pp_state, id, lock, expiry, groupid, return_value TSRMLS_CC);
+}
+
+void pcbc_bucket_get_async(zval *bucket, pcbc_pp_state *pp_state, pcbc_pp_id *id, zval **lock, zval **expiry,
+                           zval **groupid, zval *return_value TSRMLS_DC)
+{
+    bucket_get_common(Z_BUCKET_OBJ_P(bucket), bucket, pp_state, id, lock, expiry, groupid, return_value TSRMLS_CC);
+}
+
 /* {{{ proto mixed Bucket::get(string $id, array $options) */
 PHP_METHOD(Bucket, get)
 {
@@ -164,6 +175,47 @@ PHP_METHOD(Bucket, get)
     pcbc_bucket_get(obj, &pp_state, &id, &lock, &expiry, &groupid, return_value TSRMLS_CC);
 }
 
+/* {{{ proto \Couchbase\Future Bucket::getAsync(string $id, array $options) */
+PHP_METHOD(Bucket, getAsync)
+{
+    pcbc_pp_state pp_state;
+    pcbc_pp_id id;
+    zval *lock = NULL, *expiry = NULL, *groupid = NULL;
+
+    // Note that groupid is experimental here and should not be used.
+    if (pcbc_pp_begin(ZEND_NUM_ARGS() TSRMLS_CC, &pp_state, "id||lockTime,expiry,groupid", &id, &lock, &expiry,
+                      &groupid) != SUCCESS) {
+        throw_pcbc_exception("Invalid arguments.", LCB_EINVAL);
+        RETURN_NULL();
+    }
+
+    pcbc_bucket_get_async(getThis(), &pp_state, &id, &lock, &expiry, &groupid, return_value TSRMLS_CC);
+}
+
+/* {{{ proto \Couchbase\GetManyIterator Bucket::getMany(array $ids, array $options) */
+PHP_METHOD(Bucket, getMany)
+{
+    zval *ids = NULL, *options = NULL, *window = NULL;
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a|a!", &ids, &options);
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    if (options) {
+        window = php_array_fetch(options, "window");
+        PCBC_CHECK_ZVAL_LONG(window, "window must be an integer");
+        // the iterator keeps the window as int, so larger values must not be truncated
+        if (window && (Z_LVAL_P(window) <= 0 || Z_LVAL_P(window) > INT_MAX)) {
+            throw_pcbc_exception("window must be a positive integer not greater than 2147483647", LCB_EINVAL);
+            RETURN_NULL();
+        }
+    }
+
+    pcbc_get_many_iterator_init(return_value, getThis(), ids, window ? Z_LVAL_P(window) : PCBC_GET_MANY_WINDOW
+                                TSRMLS_CC);
+}
+
 /* {{{ proto mixed Bucket::getAndLock(string $id, int $lockTime, array $options) */
 PHP_METHOD(Bucket, getAndLock)
 {
@@ -25,7 +25,7 @@ typedef struct {
 
 void http_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    opcookie_http_res *result = ecalloc(1, sizeof(opcookie_http_res));
+    opcookie_http_res *result = opcookie_alloc((opcookie *)rb->cookie, sizeof(opcookie_http_res));
     const lcb_RESPHTTP *resp = (const lcb_RESPHTTP *)rb;
     TSRMLS_FETCH();
 
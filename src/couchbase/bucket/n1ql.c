@@ -18,17 +18,9 @@
 
 #define LOGARGS(instance, lvl) LCB_LOG_##lvl, instance, "pcbc/n1ql", __FILE__, __LINE__
 
-typedef struct {
-    opcookie_res header;
-    lcb_U16 rflags;
-    PCBC_ZVAL row;
-} opcookie_n1qlrow_res;
-
-static void n1qlrow_callback(lcb_t instance, int ignoreme, const lcb_RESPN1QL *resp)
+static opcookie_n1qlrow_res *n1qlrow_decode(lcb_t instance, opcookie *cookie, const lcb_RESPN1QL *resp TSRMLS_DC)
 {
-    opcookie_n1qlrow_res *result = ecalloc(1, sizeof(opcookie_n1qlrow_res));
-    opcookie *cookie = (opcookie *)resp->cookie;
-    TSRMLS_FETCH();
+    opcookie_n1qlrow_res *result = opcookie_alloc(cookie, sizeof(opcookie_n1qlrow_res));
 
     result->header.err = resp->rc;
     result->rflags = resp->rflags;
@@ -86,7 +78,53 @@ static void n1qlrow_callback(lcb_t instance, int ignoreme, const lcb_RESPN1QL *r
         }
     }
 
-    opcookie_push((opcookie *)resp->cookie, &result->header);
+    return result;
+}
+
+static void n1qlrow_callback(lcb_t instance, int ignoreme, const lcb_RESPN1QL *resp)
+{
+    opcookie *cookie = (opcookie *)resp->cookie;
+    opcookie_n1qlrow_res *result;
+    TSRMLS_FETCH();
+
+    cookie->payload += resp->nrow;
+    if (resp->rflags & LCB_RESP_F_FINAL) {
+        pcbc_metrics_service(instance, cookie, PCBC_OP_N1QL);
+    }
+    result = n1qlrow_decode(instance, cookie, resp TSRMLS_CC);
+    opcookie_push(cookie, &result->header);
+}
+
+static void n1qlrow_stream_callback(lcb_t instance, int ignoreme, const lcb_RESPN1QL *resp)
+{
+    pcbc_n1ql_query_stream_t *stream = (pcbc_n1ql_query_stream_t *)resp->cookie;
+    opcookie_n1qlrow_res *result;
+    TSRMLS_FETCH();
+
+    if (!(resp->rflags & LCB_RESP_F_FINAL) && !stream->waiting && PCBCG(n1ql_stream_max_buffered) > 0 &&
+        stream->nbuffered >= PCBCG(n1ql_stream_max_buffered)) {
+        // the loop is pumped by some other operation, and nobody consumes the rows, so they must not pile up
+        if (!stream->overflow) {
+            pcbc_log(LOGARGS(instance, WARN), "Query stream is not iterated, dropping rows after %d buffered",
+                     stream->nbuffered);
+            stream->overflow = 1;
+        }
+        return;
+    }
+    result = n1qlrow_decode(instance, stream->cookie, resp TSRMLS_CC);
+    opcookie_push(stream->cookie, &result->header);
+    if (resp->rflags & LCB_RESP_F_FINAL) {
+        pcbc_metrics_service(instance, stream->cookie, PCBC_OP_N1QL);
+        // the handle is invalidated by the library after the final row
+        stream->handle = NULL;
+        stream->complete = 1;
+    } else {
+        stream->nbuffered++;
+        // do not break out of the loop when the rows are pumped by some other operation
+        if (stream->waiting && stream->nbuffered >= PCBC_N1QL_STREAM_WINDOW) {
+            lcb_breakout(instance);
+        }
+    }
 }
 
 static lcb_error_t proc_n1qlrow_results(zval *return_value, opcookie *cookie TSRMLS_DC)
@@ -154,6 +192,8 @@ void pcbc_bucket_n1ql_request(pcbc_bucket_t *bucket, lcb_CMDN1QL *cmd, int json_
     cookie->json_response = json_response;
     cookie->json_options = json_options;
     cookie->is_cbas = is_cbas;
+    cookie->trace_id = cmd->query;
+    cookie->trace_id_len = cmd->nquery;
     err = lcb_n1ql_query(bucket->conn->lcb, cookie, cmd);
     if (err == LCB_SUCCESS) {
         lcb_wait(bucket->conn->lcb);
@@ -168,3 +208,23 @@ void pcbc_bucket_n1ql_request(pcbc_bucket_t *bucket, lcb_CMDN1QL *cmd, int json_
     }
     opcookie_destroy(cookie);
 }
+
+void pcbc_bucket_n1ql_stream_request(zval *bucket, lcb_CMDN1QL *cmd, int json_options, int is_cbas,
+                                     zval *return_value TSRMLS_DC)
+{
+    pcbc_n1ql_query_stream_t *stream;
+    lcb_error_t err;
+
+    pcbc_n1ql_query_stream_init(return_value, bucket, json_options, is_cbas TSRMLS_CC);
+    stream = Z_N1QL_QUERY_STREAM_OBJ_P(return_value);
+
+    cmd->callback = n1qlrow_stream_callback;
+    cmd->content_type = PCBC_CONTENT_TYPE_JSON;
+    cmd->handle = &stream->handle;
+    err = lcb_n1ql_query(stream->conn->lcb, stream, cmd);
+    if (err != LCB_SUCCESS) {
+        stream->handle = NULL;
+        stream->complete = 1;
+        throw_lcb_exception(err);
+    }
+}
@@ -20,14 +20,14 @@
 
 void remove_callback(lcb_t instance, int cbtype, const lcb_RESPREMOVE *resp)
 {
-    opcookie_store_res *result = ecalloc(1, sizeof(opcookie_store_res));
+    opcookie_store_res *result = opcookie_alloc((opcookie *)resp->cookie, sizeof(opcookie_store_res));
     const lcb_MUTATION_TOKEN *mutinfo;
     TSRMLS_FETCH();
 
     PCBC_RESP_ERR_COPY(result->header, cbtype, resp);
     result->key_len = resp->nkey;
     if (resp->nkey) {
-        result->key = estrndup(resp->key, resp->nkey);
+        result->key = opcookie_strndup((opcookie *)resp->cookie, resp->key, resp->nkey);
     }
     result->cas = resp->cas;
     mutinfo = lcb_resp_get_mutation_token(cbtype, resp);
@@ -38,8 +38,7 @@ void remove_callback(lcb_t instance, int cbtype, const lcb_RESPREMOVE *resp)
     opcookie_push((opcookie *)resp->cookie, &result->header);
 }
 
-// remove($id {, $cas, $groupid}) : MetaDoc
-PHP_METHOD(Bucket, remove)
+static void bucket_remove_common(INTERNAL_FUNCTION_PARAMETERS, zend_bool async)
 {
     pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
     int ii, ncmds, nscheduled;
@@ -47,7 +46,7 @@ PHP_METHOD(Bucket, remove)
     pcbc_pp_id id;
     opcookie *cookie;
     zval *zcas, *zgroupid;
-    lcb_error_t err;
+    lcb_error_t err = LCB_SUCCESS;
 
     // Note that groupid is experimental here and should not be used.
     if (pcbc_pp_begin(ZEND_NUM_ARGS() TSRMLS_CC, &pp_state, "id||cas,groupid", &id, &zcas, &zgroupid) != SUCCESS) {
@@ -81,6 +80,12 @@ PHP_METHOD(Bucket, remove)
     }
     pcbc_assert_number_of_commands(obj->conn->lcb, "remove", nscheduled, ncmds);
 
+    if (async && (nscheduled || err == LCB_SUCCESS)) {
+        pcbc_future_init(return_value, getThis(), cookie, nscheduled, pcbc_pp_ismapped(&pp_state),
+                         proc_remove_results TSRMLS_CC);
+        return;
+    }
+
     if (nscheduled) {
         lcb_wait(obj->conn->lcb);
 
@@ -93,3 +98,15 @@ PHP_METHOD(Bucket, remove)
         throw_lcb_exception(err);
     }
 }
+
+// remove($id {, $cas, $groupid}) : MetaDoc
+PHP_METHOD(Bucket, remove)
+{
+    bucket_remove_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
+}
+
+// removeAsync($id {, $cas, $groupid}) : Future
+PHP_METHOD(Bucket, removeAsync)
+{
+    bucket_remove_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
+}
@@ -20,14 +20,14 @@
 
 void store_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    opcookie_store_res *result = ecalloc(1, sizeof(opcookie_store_res));
+    opcookie_store_res *result = opcookie_alloc((opcookie *)rb->cookie, sizeof(opcookie_store_res));
     const lcb_MUTATION_TOKEN *mutinfo;
     TSRMLS_FETCH();
 
     PCBC_RESP_ERR_COPY(result->header, cbtype, rb);
     result->key_len = rb->nkey;
     if (rb->nkey) {
-        result->key = estrndup(rb->key, rb->nkey);
+        result->key = opcookie_strndup((opcookie *)rb->cookie, rb->key, rb->nkey);
     }
     result->cas = rb->cas;
     mutinfo = lcb_resp_get_mutation_token(cbtype, rb);
@@ -44,6 +44,11 @@ void store_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
     }
 
     opcookie_push((opcookie *)rb->cookie, &result->header);
+    if (((opcookie *)rb->cookie)->breakout_nres &&
+        ((opcookie *)rb->cookie)->nres >= ((opcookie *)rb->cookie)->breakout_nres) {
+        // upsertStream() wants to refill its window before all operations are completed
+        lcb_breakout(instance);
+    }
 }
 
 lcb_error_t proc_store_results(pcbc_bucket_t *bucket, zval *return_value, opcookie *cookie, int is_mapped TSRMLS_DC)
@@ -71,9 +76,6 @@ lcb_error_t proc_store_results(pcbc_bucket_t *bucket, zval *return_value, opcook
 
     FOREACH_OPCOOKIE_RES(opcookie_store_res, res, cookie)
     {
-        if (res->key) {
-            efree(res->key);
-        }
         PCBC_RESP_ERR_FREE(res->header);
     }
 
@@ -104,8 +106,7 @@ PHP_METHOD(Bucket, insert)
     nscheduled = 0;
     for (ii = 0; pcbc_pp_next(&pp_state); ++ii) {
         lcb_CMDSTOREDUR cmd = {0};
-        void *bytes;
-        lcb_size_t nbytes;
+        PCBC_ZVAL bytes;
 
         PCBC_CHECK_ZVAL_LONG(zexpiry, "expiry must be an integer");
         PCBC_CHECK_ZVAL_LONG(zflags, "flags must be an integer");
@@ -114,12 +115,12 @@ PHP_METHOD(Bucket, insert)
         cmd.operation = LCB_ADD;
         LCB_CMD_SET_KEY(&cmd, id.str, id.len);
 
-        if (pcbc_encode_value(obj, zvalue, &bytes, &nbytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
+        if (pcbc_encode_value(obj, zvalue, &bytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
             pcbc_log(LOGARGS(obj->conn->lcb, ERROR), "Failed to encode value for before storing");
             err = LCB_ERROR;
             break;
         }
-        LCB_CMD_SET_VALUE(&cmd, bytes, nbytes);
+        LCB_CMD_SET_VALUE(&cmd, Z_STRVAL_P(PCBC_P(bytes)), Z_STRLEN_P(PCBC_P(bytes)));
 
         if (zexpiry) {
             cmd.exptime = Z_LVAL_P(zexpiry);
@@ -142,12 +143,14 @@ PHP_METHOD(Bucket, insert)
         } else {
             err = lcb_store3(obj->conn->lcb, cookie, (lcb_CMDSTORE *)&cmd);
         }
-        efree(bytes);
+        zval_ptr_dtor(&bytes);
         if (err != LCB_SUCCESS) {
             break;
         }
         nscheduled++;
     }
+    // the service latency starts here, so it does not include encoding of the documents
+    cookie->scheduled = pcbc_metrics_now();
     pcbc_assert_number_of_commands(obj->conn->lcb, "insert", nscheduled, ncmds);
 
     if (nscheduled) {
@@ -163,8 +166,7 @@ PHP_METHOD(Bucket, insert)
     }
 }
 
-// upsert($id, $doc {, $expiry, $groupid}) : MetaDoc
-PHP_METHOD(Bucket, upsert)
+static void bucket_upsert_common(INTERNAL_FUNCTION_PARAMETERS, zend_bool async)
 {
     pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
     int ii, ncmds, nscheduled;
@@ -172,7 +174,7 @@ PHP_METHOD(Bucket, upsert)
     zval *zvalue, *zexpiry, *zflags, *zgroupid, *zpersist, *zreplica;
     pcbc_pp_id id;
     opcookie *cookie;
-    lcb_error_t err;
+    lcb_error_t err = LCB_SUCCESS;
 
     // Note that groupid is experimental here and should not be used.
     if (pcbc_pp_begin(ZEND_NUM_ARGS() TSRMLS_CC, &pp_state, "id|value|expiry,flags,groupid,persist_to,replicate_to",
@@ -187,8 +189,7 @@ PHP_METHOD(Bucket, upsert)
     nscheduled = 0;
     for (ii = 0; pcbc_pp_next(&pp_state); ++ii) {
         lcb_CMDSTOREDUR cmd = {0};
-        void *bytes;
-        lcb_size_t nbytes;
+        PCBC_ZVAL bytes;
 
         PCBC_CHECK_ZVAL_LONG(zexpiry, "expiry must be an integer");
         PCBC_CHECK_ZVAL_LONG(zflags, "flags must be an integer");
@@ -199,12 +200,12 @@ PHP_METHOD(Bucket, upsert)
         cmd.operation = LCB_SET;
         LCB_CMD_SET_KEY(&cmd, id.str, id.len);
 
-        if (pcbc_encode_value(obj, zvalue, &bytes, &nbytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
+        if (pcbc_encode_value(obj, zvalue, &bytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
             pcbc_log(LOGARGS(obj->conn->lcb, ERROR), "Failed to encode value for before storing");
             err = LCB_ERROR;
             break;
         }
-        LCB_CMD_SET_VALUE(&cmd, bytes, nbytes);
+        LCB_CMD_SET_VALUE(&cmd, Z_STRVAL_P(PCBC_P(bytes)), Z_STRLEN_P(PCBC_P(bytes)));
 
         if (zexpiry) {
             cmd.exptime = Z_LVAL_P(zexpiry);
@@ -227,14 +228,21 @@ PHP_METHOD(Bucket, upsert)
         } else {
             err = lcb_store3(obj->conn->lcb, cookie, (lcb_CMDSTORE *)&cmd);
         }
-        efree(bytes);
+        zval_ptr_dtor(&bytes);
         if (err != LCB_SUCCESS) {
             break;
         }
         nscheduled++;
     }
+    cookie->scheduled = pcbc_metrics_now();
     pcbc_assert_number_of_commands(obj->conn->lcb, "upsert", nscheduled, ncmds);
 
+    if (async && (nscheduled || err == LCB_SUCCESS)) {
+        pcbc_future_init(return_value, getThis(), cookie, nscheduled, pcbc_pp_ismapped(&pp_state),
+                         proc_store_results TSRMLS_CC);
+        return;
+    }
+
     if (nscheduled) {
         lcb_wait(obj->conn->lcb);
 
@@ -248,8 +256,294 @@ PHP_METHOD(Bucket, upsert)
     }
 }
 
-// replace($id, $doc {, $cas, $expiry, $groupid}) : MetaDoc
-PHP_METHOD(Bucket, replace)
+// upsert($id, $doc {, $expiry, $groupid}) : MetaDoc
+PHP_METHOD(Bucket, upsert)
+{
+    bucket_upsert_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
+}
+
+// upsertAsync($id, $doc {, $expiry, $groupid}) : Future
+PHP_METHOD(Bucket, upsertAsync)
+{
+    bucket_upsert_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
+}
+
+/* pulls documents from array or Traversable, without materializing the latter */
+typedef struct {
+    HashTable *ht;
+    HashPosition pos;
+    zend_object_iterator *iter;
+    zend_bool started;
+} upsert_stream_source;
+
+static int upsert_stream_source_init(upsert_stream_source *src, zval *docs TSRMLS_DC)
+{
+    memset(src, 0, sizeof(upsert_stream_source));
+    if (Z_TYPE_P(docs) == IS_ARRAY) {
+        src->ht = Z_ARRVAL_P(docs);
+        zend_hash_internal_pointer_reset_ex(src->ht, &src->pos);
+        return SUCCESS;
+    }
+    src->iter = Z_OBJCE_P(docs)->get_iterator(Z_OBJCE_P(docs), docs, 0 TSRMLS_CC);
+    if (src->iter == NULL || EG(exception)) {
+        return FAILURE;
+    }
+    if (src->iter->funcs->rewind) {
+        src->iter->funcs->rewind(src->iter TSRMLS_CC);
+    }
+    return EG(exception) ? FAILURE : SUCCESS;
+}
+
+static void upsert_stream_source_destroy(upsert_stream_source *src TSRMLS_DC)
+{
+    if (src->iter) {
+#if PHP_VERSION_ID >= 70000
+        zend_iterator_dtor(src->iter);
+#else
+        src->iter->funcs->dtor(src->iter TSRMLS_CC);
+#endif
+        src->iter = NULL;
+    }
+}
+
+/* initializes key with copy of the current ID, and points value to the current document, which is valid until the
+ * next call */
+static int upsert_stream_source_next(upsert_stream_source *src, zval *key, zval **value TSRMLS_DC)
+{
+    if (src->ht) {
+        PCBC_ZVAL *data = PCBC_HASH_GET_CURRENT_DATA_EX(src->ht, &src->pos);
+
+        if (data == NULL) {
+            return 0;
+        }
+        zend_hash_get_current_key_zval_ex(src->ht, key, &src->pos);
+        *value = PCBC_N(data);
+        zend_hash_move_forward_ex(src->ht, &src->pos);
+        return 1;
+    }
+
+    if (src->started) {
+        src->iter->funcs->move_forward(src->iter TSRMLS_CC);
+        if (EG(exception)) {
+            return 0;
+        }
+    }
+    src->started = 1;
+    if (src->iter->funcs->valid(src->iter TSRMLS_CC) != SUCCESS || EG(exception)) {
+        return 0;
+    }
+#if PHP_VERSION_ID >= 70000
+    *value = src->iter->funcs->get_current_data(src->iter);
+#else
+    {
+        zval **data = NULL;
+        src->iter->funcs->get_current_data(src->iter, &data TSRMLS_CC);
+        *value = data ? *data : NULL;
+    }
+#endif
+    if (*value == NULL || EG(exception)) {
+        return 0;
+    }
+    if (src->iter->funcs->get_current_key) {
+        src->iter->funcs->get_current_key(src->iter, key TSRMLS_CC);
+    } else {
+        ZVAL_NULL(key);
+    }
+    return 1;
+}
+
+typedef struct {
+    long nsuccess;
+    long nfailure;
+    zval *on_error;
+    PCBC_ZVAL errors;
+} upsert_stream_summary;
+
+/* consumes results received so far, and reports failed keys to the callback, or collects them in the summary */
+static void upsert_stream_consume(opcookie *cookie, upsert_stream_summary *summary TSRMLS_DC)
+{
+    opcookie_store_res *res;
+
+    while ((res = (opcookie_store_res *)opcookie_shift(cookie)) != NULL) {
+        if (res->header.err == LCB_SUCCESS) {
+            summary->nsuccess++;
+        } else if (!summary->on_error) {
+            zval *exc = bop_get_return_doc(PCBC_P(summary->errors), res->key, res->key_len, 1 TSRMLS_CC);
+
+            summary->nfailure++;
+            pcbc_exception_init_lcb(exc, res->header.err, NULL, res->header.err_ctx, res->header.err_ref TSRMLS_CC);
+        } else if (!EG(exception)) {
+            PCBC_ZVAL params[2];
+            PCBC_ZVAL retval;
+
+            summary->nfailure++;
+            PCBC_ZVAL_ALLOC(params[0]);
+            PCBC_ZVAL_ALLOC(params[1]);
+            PCBC_ZVAL_ALLOC(retval);
+            PCBC_STRINGL(params[0], res->key, res->key_len);
+            pcbc_exception_init_lcb(PCBC_P(params[1]), res->header.err, NULL, res->header.err_ctx,
+                                    res->header.err_ref TSRMLS_CC);
+            ZVAL_NULL(PCBC_P(retval));
+            call_user_function(EG(function_table), NULL, summary->on_error, PCBC_P(retval), 2, params TSRMLS_CC);
+            zval_ptr_dtor(&retval);
+            zval_ptr_dtor(&params[0]);
+            zval_ptr_dtor(&params[1]);
+        } else {
+            // the callback has thrown already, the remaining failures are only counted
+            summary->nfailure++;
+        }
+        PCBC_RESP_ERR_FREE(res->header);
+    }
+    opcookie_arena_reset(cookie);
+}
+
+// upsertStream($docs {, $expiry, $window, $onError}) : array
+PHP_METHOD(Bucket, upsertStream)
+{
+    pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
+    zval *docs = NULL, *options = NULL, *zexpiry = NULL, *zwindow = NULL;
+    upsert_stream_source src;
+    upsert_stream_summary summary = {0};
+    opcookie *cookie;
+    lcb_error_t err = LCB_SUCCESS;
+    int nscheduled = 0, window = PCBC_UPSERT_STREAM_WINDOW;
+    zend_bool exhausted = 0;
+    int rv;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "z|a!", &docs, &options);
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    if (Z_TYPE_P(docs) != IS_ARRAY &&
+        (Z_TYPE_P(docs) != IS_OBJECT || !instanceof_function(Z_OBJCE_P(docs), zend_ce_traversable TSRMLS_CC))) {
+        throw_pcbc_exception("docs must be an array or Traversable", LCB_EINVAL);
+        RETURN_NULL();
+    }
+    if (options) {
+        zexpiry = php_array_fetch(options, "expiry");
+        PCBC_CHECK_ZVAL_LONG(zexpiry, "expiry must be an integer");
+        zwindow = php_array_fetch(options, "window");
+        PCBC_CHECK_ZVAL_LONG(zwindow, "window must be an integer");
+        if (zwindow) {
+            if (Z_LVAL_P(zwindow) <= 0 || Z_LVAL_P(zwindow) > INT_MAX) {
+                throw_pcbc_exception("window must be a positive integer not greater than 2147483647", LCB_EINVAL);
+                RETURN_NULL();
+            }
+            window = Z_LVAL_P(zwindow);
+        }
+        summary.on_error = php_array_fetch(options, "onError");
+#if PHP_VERSION_ID >= 70000
+        if (summary.on_error && !zend_is_callable(summary.on_error, 0, NULL)) {
+#else
+        if (summary.on_error && !zend_is_callable(summary.on_error, 0, NULL TSRMLS_CC)) {
+#endif
+            throw_pcbc_exception("onError must be callable", LCB_EINVAL);
+            RETURN_NULL();
+        }
+    }
+
+    if (upsert_stream_source_init(&src, docs TSRMLS_CC) != SUCCESS) {
+        upsert_stream_source_destroy(&src TSRMLS_CC);
+        RETURN_NULL();
+    }
+    PCBC_ZVAL_ALLOC(summary.errors);
+    array_init(PCBC_P(summary.errors));
+    cookie = opcookie_init();
+
+    while (1) {
+        // the cookie is shared by all batches, so the latency is measured from the last one
+        cookie->started = pcbc_metrics_now();
+        lcb_sched_enter(obj->conn->lcb);
+        while (!exhausted && nscheduled - cookie->nres < window) {
+            lcb_CMDSTORE cmd = {0};
+            zval key, *value = NULL;
+            PCBC_ZVAL bytes;
+
+            if (!upsert_stream_source_next(&src, &key, &value TSRMLS_CC)) {
+                exhausted = 1;
+                break;
+            }
+            if (Z_TYPE(key) == IS_LONG) {
+                convert_to_string(&key);
+            }
+            if (Z_TYPE(key) != IS_STRING) {
+                zval_dtor(&key);
+                pcbc_log(LOGARGS(obj->conn->lcb, ERROR), "Document ID must be a string, stopping after %d documents",
+                         nscheduled);
+                err = LCB_EINVAL;
+                exhausted = 1;
+                break;
+            }
+            cmd.operation = LCB_SET;
+            LCB_CMD_SET_KEY(&cmd, Z_STRVAL(key), Z_STRLEN(key));
+            if (pcbc_encode_value(obj, value, &bytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
+                zval_dtor(&key);
+                pcbc_log(LOGARGS(obj->conn->lcb, ERROR), "Failed to encode value for before storing");
+                err = LCB_ERROR;
+                exhausted = 1;
+                break;
+            }
+            LCB_CMD_SET_VALUE(&cmd, Z_STRVAL_P(PCBC_P(bytes)), Z_STRLEN_P(PCBC_P(bytes)));
+            if (zexpiry) {
+                cmd.exptime = Z_LVAL_P(zexpiry);
+            }
+            err = lcb_store3(obj->conn->lcb, cookie, &cmd);
+            zval_ptr_dtor(&bytes);
+            zval_dtor(&key);
+            if (err != LCB_SUCCESS) {
+                exhausted = 1;
+                break;
+            }
+            nscheduled++;
+        }
+        cookie->scheduled = pcbc_metrics_now();
+        lcb_sched_leave(obj->conn->lcb);
+
+        if (cookie->nres < nscheduled) {
+            // stop the event loop after a quarter of the window, to schedule more while the rest is in flight
+            int threshold = window / 4;
+
+            if (threshold < 1) {
+                threshold = 1;
+            }
+            if (threshold > nscheduled - cookie->nres || exhausted || EG(exception)) {
+                threshold = nscheduled - cookie->nres;
+            }
+            cookie->breakout_nres = cookie->nres + threshold;
+            lcb_wait(obj->conn->lcb);
+            cookie->breakout_nres = 0;
+        }
+        upsert_stream_consume(cookie, &summary TSRMLS_CC);
+        if (EG(exception)) {
+            // thrown by the source or the callback, so the remaining documents are not pulled
+            exhausted = 1;
+        }
+        if (exhausted && cookie->nres >= nscheduled) {
+            break;
+        }
+    }
+
+    upsert_stream_source_destroy(&src TSRMLS_CC);
+    // the duration of the whole stream is not the latency of an operation
+    cookie->metrics = NULL;
+    opcookie_destroy(cookie);
+
+    if (EG(exception)) {
+        zval_ptr_dtor(&summary.errors);
+        RETURN_NULL();
+    }
+    if (err != LCB_SUCCESS) {
+        zval_ptr_dtor(&summary.errors);
+        throw_lcb_exception(err);
+        RETURN_NULL();
+    }
+    array_init(return_value);
+    ADD_ASSOC_LONG_EX(return_value, "success", summary.nsuccess);
+    ADD_ASSOC_LONG_EX(return_value, "failure", summary.nfailure);
+    ADD_ASSOC_ZVAL_EX(return_value, "errors", PCBC_P(summary.errors));
+}
+
+static void bucket_replace_common(INTERNAL_FUNCTION_PARAMETERS, zend_bool async)
 {
     pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
     int ii, ncmds, nscheduled;
@@ -257,7 +551,7 @@ PHP_METHOD(Bucket, replace)
     pcbc_pp_id id;
     zval *zvalue, *zcas, *zexpiry, *zflags, *zgroupid, *zpersist, *zreplica;
     opcookie *cookie;
-    lcb_error_t err;
+    lcb_error_t err = LCB_SUCCESS;
 
     // Note that groupid is experimental here and should not be used.
     if (pcbc_pp_begin(ZEND_NUM_ARGS() TSRMLS_CC, &pp_state, "id|value|cas,expiry,flags,groupid,persist_to,replicate_to",
@@ -272,8 +566,7 @@ PHP_METHOD(Bucket, replace)
     nscheduled = 0;
     for (ii = 0; pcbc_pp_next(&pp_state); ++ii) {
         lcb_CMDSTOREDUR cmd = {0};
-        void *bytes;
-        lcb_size_t nbytes;
+        PCBC_ZVAL bytes;
 
         PCBC_CHECK_ZVAL_STRING(zcas, "cas must be a string");
         PCBC_CHECK_ZVAL_LONG(zexpiry, "expiry must be an integer");
@@ -285,12 +578,12 @@ PHP_METHOD(Bucket, replace)
         cmd.operation = LCB_REPLACE;
         LCB_CMD_SET_KEY(&cmd, id.str, id.len);
 
-        if (pcbc_encode_value(obj, zvalue, &bytes, &nbytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
+        if (pcbc_encode_value(obj, zvalue, &bytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
             pcbc_log(LOGARGS(obj->conn->lcb, ERROR), "Failed to encode value for before storing");
             err = LCB_ERROR;
             break;
         }
-        LCB_CMD_SET_VALUE(&cmd, bytes, nbytes);
+        LCB_CMD_SET_VALUE(&cmd, Z_STRVAL_P(PCBC_P(bytes)), Z_STRLEN_P(PCBC_P(bytes)));
 
         if (zcas) {
             cmd.cas = pcbc_cas_decode(zcas TSRMLS_CC);
@@ -316,14 +609,21 @@ PHP_METHOD(Bucket, replace)
         } else {
             err = lcb_store3(obj->conn->lcb, cookie, (lcb_CMDSTORE *)&cmd);
         }
-        efree(bytes);
+        zval_ptr_dtor(&bytes);
         if (err != LCB_SUCCESS) {
             break;
         }
         nscheduled++;
     }
+    cookie->scheduled = pcbc_metrics_now();
     pcbc_assert_number_of_commands(obj->conn->lcb, "replace", nscheduled, ncmds);
 
+    if (async && (nscheduled || err == LCB_SUCCESS)) {
+        pcbc_future_init(return_value, getThis(), cookie, nscheduled, pcbc_pp_ismapped(&pp_state),
+                         proc_store_results TSRMLS_CC);
+        return;
+    }
+
     if (nscheduled) {
         lcb_wait(obj->conn->lcb);
 
@@ -337,6 +637,18 @@ PHP_METHOD(Bucket, replace)
     }
 }
 
+// replace($id, $doc {, $cas, $expiry, $groupid}) : MetaDoc
+PHP_METHOD(Bucket, replace)
+{
+    bucket_replace_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
+}
+
+// replaceAsync($id, $doc {, $cas, $expiry, $groupid}) : Future
+PHP_METHOD(Bucket, replaceAsync)
+{
+    bucket_replace_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
+}
+
 // append($id, $doc {, $cas, $groupid}) : MetaDoc
 PHP_METHOD(Bucket, append)
 {
@@ -361,8 +673,7 @@ PHP_METHOD(Bucket, append)
     nscheduled = 0;
     for (ii = 0; pcbc_pp_next(&pp_state); ++ii) {
         lcb_CMDSTOREDUR cmd = {0};
-        void *bytes;
-        lcb_size_t nbytes;
+        PCBC_ZVAL bytes;
 
         PCBC_CHECK_ZVAL_STRING(zcas, "cas must be a string");
         PCBC_CHECK_ZVAL_STRING(zgroupid, "groupid must be a string");
@@ -372,12 +683,12 @@ PHP_METHOD(Bucket, append)
         cmd.operation = LCB_APPEND;
         LCB_CMD_SET_KEY(&cmd, id.str, id.len);
 
-        if (pcbc_encode_value(obj, zvalue, &bytes, &nbytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
+        if (pcbc_encode_value(obj, zvalue, &bytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
             pcbc_log(LOGARGS(obj->conn->lcb, ERROR), "Failed to encode value for before storing");
             err = LCB_ERROR;
             break;
         }
-        LCB_CMD_SET_VALUE(&cmd, bytes, nbytes);
+        LCB_CMD_SET_VALUE(&cmd, Z_STRVAL_P(PCBC_P(bytes)), Z_STRLEN_P(PCBC_P(bytes)));
 
         if (zcas) {
             cmd.cas = pcbc_cas_decode(zcas TSRMLS_CC);
@@ -400,12 +711,13 @@ PHP_METHOD(Bucket, append)
         } else {
             err = lcb_store3(obj->conn->lcb, cookie, (lcb_CMDSTORE *)&cmd);
         }
-        efree(bytes);
+        zval_ptr_dtor(&bytes);
         if (err != LCB_SUCCESS) {
             break;
         }
         nscheduled++;
     }
+    cookie->scheduled = pcbc_metrics_now();
     pcbc_assert_number_of_commands(obj->conn->lcb, "append", nscheduled, ncmds);
 
     if (nscheduled) {
@@ -445,8 +757,7 @@ PHP_METHOD(Bucket, prepend)
     nscheduled = 0;
     for (ii = 0; pcbc_pp_next(&pp_state); ++ii) {
         lcb_CMDSTOREDUR cmd = {0};
-        void *bytes;
-        lcb_size_t nbytes;
+        PCBC_ZVAL bytes;
 
         PCBC_CHECK_ZVAL_STRING(zcas, "cas must be a string");
         PCBC_CHECK_ZVAL_STRING(zgroupid, "groupid must be a string");
@@ -456,12 +767,12 @@ PHP_METHOD(Bucket, prepend)
         cmd.operation = LCB_PREPEND;
         LCB_CMD_SET_KEY(&cmd, id.str, id.len);
 
-        if (pcbc_encode_value(obj, zvalue, &bytes, &nbytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
+        if (pcbc_encode_value(obj, zvalue, &bytes, &cmd.flags, &cmd.datatype TSRMLS_CC) != SUCCESS) {
             pcbc_log(LOGARGS(obj->conn->lcb, ERROR), "Failed to encode value for before storing");
             err = LCB_ERROR;
             break;
         }
-        LCB_CMD_SET_VALUE(&cmd, bytes, nbytes);
+        LCB_CMD_SET_VALUE(&cmd, Z_STRVAL_P(PCBC_P(bytes)), Z_STRLEN_P(PCBC_P(bytes)));
 
         if (zcas) {
             cmd.cas = pcbc_cas_decode(zcas TSRMLS_CC);
@@ -484,12 +795,13 @@ PHP_METHOD(Bucket, prepend)
         } else {
             err = lcb_store3(obj->conn->lcb, cookie, (lcb_CMDSTORE *)&cmd);
         }
-        efree(bytes);
+        zval_ptr_dtor(&bytes);
         if (err != LCB_SUCCESS) {
             break;
         }
         nscheduled++;
     }
+    cookie->scheduled = pcbc_metrics_now();
     pcbc_assert_number_of_commands(obj->conn->lcb, "prepend", nscheduled, ncmds);
 
     if (nscheduled) {
@@ -27,7 +27,7 @@ typedef struct {
 
 void subdoc_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    opcookie_subdoc_res *result = ecalloc(1, sizeof(opcookie_subdoc_res));
+    opcookie_subdoc_res *result = opcookie_alloc((opcookie *)rb->cookie, sizeof(opcookie_subdoc_res));
     const lcb_RESPSUBDOC *resp = (const lcb_RESPSUBDOC *)rb;
     const lcb_MUTATION_TOKEN *mutinfo;
     lcb_SDENTRY cur;
@@ -118,7 +118,15 @@ typedef struct {
     lcb_t instance;
 } pcbc_sd_params;
 
-void pcbc_bucket_subdoc_request(pcbc_bucket_t *obj, void *builder, int is_lookup, zval *return_value TSRMLS_DC)
+static lcb_error_t proc_subdoc_future_results(pcbc_bucket_t *bucket, zval *return_value, opcookie *cookie,
+                                              int is_mapped TSRMLS_DC)
+{
+    return proc_subdoc_results(return_value, cookie TSRMLS_CC);
+}
+
+/* when async_bucket is not NULL, the results are not awaited, and return_value is initialized as Future */
+static void bucket_subdoc_common(pcbc_bucket_t *obj, zval *async_bucket, void *builder, int is_lookup,
+                                 zval *return_value TSRMLS_DC)
 {
     opcookie *cookie;
     lcb_CMDSUBDOC cmd = {0};
@@ -154,6 +162,13 @@ void pcbc_bucket_subdoc_request(pcbc_bucket_t *obj, void *builder, int is_lookup
     cookie = opcookie_init();
     err = lcb_subdoc3(obj->conn->lcb, cookie, &cmd);
 
+    if (async_bucket && err == LCB_SUCCESS) {
+        // the command is already encoded into the packet, so the specs are not needed anymore
+        efree((void *)cmd.specs);
+        pcbc_future_init(return_value, async_bucket, cookie, 1, 0, proc_subdoc_future_results TSRMLS_CC);
+        return;
+    }
+
     if (err == LCB_SUCCESS) {
         lcb_wait(obj->conn->lcb);
 
@@ -168,6 +183,16 @@ void pcbc_bucket_subdoc_request(pcbc_bucket_t *obj, void *builder, int is_lookup
     }
 }
 
+void pcbc_bucket_subdoc_request(pcbc_bucket_t *obj, void *builder, int is_lookup, zval *return_value TSRMLS_DC)
+{
+    bucket_subdoc_common(obj, NULL, builder, is_lookup, return_value TSRMLS_CC);
+}
+
+void pcbc_bucket_subdoc_request_async(zval *bucket, void *builder, int is_lookup, zval *return_value TSRMLS_DC)
+{
+    bucket_subdoc_common(Z_BUCKET_OBJ_P(bucket), bucket, builder, is_lookup, return_value TSRMLS_CC);
+}
+
 lcb_U32 pcbc_subdoc_options_to_flags(int is_path, int is_lookup, zval *options TSRMLS_DC)
 {
     lcb_U32 flags = 0;
@@ -20,21 +20,20 @@
 
 void touch_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    opcookie_store_res *result = ecalloc(1, sizeof(opcookie_store_res));
+    opcookie_store_res *result = opcookie_alloc((opcookie *)rb->cookie, sizeof(opcookie_store_res));
     const lcb_RESPTOUCH *resp = (const lcb_RESPTOUCH *)rb;
     TSRMLS_FETCH();
 
     PCBC_RESP_ERR_COPY(result->header, cbtype, rb);
     if (resp->nkey) {
-        result->key = estrndup(resp->key, resp->nkey);
+        result->key = opcookie_strndup((opcookie *)rb->cookie, resp->key, resp->nkey);
     }
     result->cas = resp->cas;
 
     opcookie_push((opcookie *)rb->cookie, &result->header);
 }
 
-// touch($id {, $lock, $groupid}) : MetaDoc
-PHP_METHOD(Bucket, touch)
+static void bucket_touch_common(INTERNAL_FUNCTION_PARAMETERS, zend_bool async)
 {
     pcbc_bucket_t *obj = Z_BUCKET_OBJ_P(getThis());
     int ii, ncmds, nscheduled;
@@ -42,7 +41,7 @@ PHP_METHOD(Bucket, touch)
     pcbc_pp_id id;
     zval *zexpiry, *zgroupid;
     opcookie *cookie;
-    lcb_error_t err;
+    lcb_error_t err = LCB_SUCCESS;
 
     // Note that groupid is experimental here and should not be used.
     if (pcbc_pp_begin(ZEND_NUM_ARGS() TSRMLS_CC, &pp_state, "id|expiry|groupid", &id, &zexpiry, &zgroupid) != SUCCESS) {
@@ -74,6 +73,12 @@ PHP_METHOD(Bucket, touch)
     }
     pcbc_assert_number_of_commands(obj->conn->lcb, "touch", nscheduled, ncmds);
 
+    if (async && (nscheduled || err == LCB_SUCCESS)) {
+        pcbc_future_init(return_value, getThis(), cookie, nscheduled, pcbc_pp_ismapped(&pp_state),
+                         proc_touch_results TSRMLS_CC);
+        return;
+    }
+
     if (nscheduled) {
         lcb_wait(obj->conn->lcb);
 
@@ -86,3 +91,15 @@ PHP_METHOD(Bucket, touch)
         throw_lcb_exception(err);
     }
 }
+
+// touch($id {, $lock, $groupid}) : MetaDoc
+PHP_METHOD(Bucket, touch)
+{
+    bucket_touch_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 0);
+}
+
+// touchAsync($id {, $lock, $groupid}) : Future
+PHP_METHOD(Bucket, touchAsync)
+{
+    bucket_touch_common(INTERNAL_FUNCTION_PARAM_PASSTHRU, 1);
+}
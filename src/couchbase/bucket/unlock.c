@@ -26,14 +26,14 @@ typedef struct {
 
 void unlock_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
 {
-    opcookie_unlock_res *result = ecalloc(1, sizeof(opcookie_unlock_res));
+    opcookie_unlock_res *result = opcookie_alloc((opcookie *)rb->cookie, sizeof(opcookie_unlock_res));
     const lcb_RESPUNLOCK *resp = (const lcb_RESPUNLOCK *)rb;
     TSRMLS_FETCH();
 
     PCBC_RESP_ERR_COPY(result->header, cbtype, rb);
     result->key_len = resp->nkey;
     if (resp->nkey) {
-        result->key = estrndup(resp->key, resp->nkey);
+        result->key = opcookie_strndup((opcookie *)rb->cookie, resp->key, resp->nkey);
     }
 
     opcookie_push((opcookie *)rb->cookie, &result->header);
@@ -65,9 +65,6 @@ static lcb_error_t proc_unlock_results(pcbc_bucket_t *bucket, zval *return_value
 
     FOREACH_OPCOOKIE_RES(opcookie_unlock_res, res, cookie)
     {
-        if (res->key) {
-            efree(res->key);
-        }
         PCBC_RESP_ERR_FREE(res->header);
     }
 
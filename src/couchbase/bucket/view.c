@@ -28,11 +28,15 @@ typedef struct {
 
 static void viewrow_callback(lcb_t instance, int ignoreme, const lcb_RESPVIEWQUERY *resp)
 {
-    opcookie_viewrow_res *result = ecalloc(1, sizeof(opcookie_viewrow_res));
+    opcookie_viewrow_res *result = opcookie_alloc((opcookie *)resp->cookie, sizeof(opcookie_viewrow_res));
     opcookie *cookie = (opcookie *)resp->cookie;
     int last_error;
     TSRMLS_FETCH();
 
+    cookie->payload += resp->nrow;
+    if (resp->rflags & LCB_RESP_F_FINAL) {
+        pcbc_metrics_service(instance, cookie, PCBC_OP_VIEW);
+    }
     PCBC_ZVAL_ALLOC(result->id);
     PCBC_ZVAL_ALLOC(result->key);
     PCBC_ZVAL_ALLOC(result->value);
@@ -182,6 +186,8 @@ void pcbc_bucket_view_request(pcbc_bucket_t *bucket, lcb_CMDVIEWQUERY *cmd, int
     cookie = opcookie_init();
     cookie->json_response = json_response;
     cookie->json_options = json_options;
+    cookie->trace_id = cmd->view;
+    cookie->trace_id_len = cmd->nview;
     err = lcb_view_query(bucket->conn->lcb, cookie, cmd);
     if (err == LCB_SUCCESS) {
         lcb_wait(bucket->conn->lcb);
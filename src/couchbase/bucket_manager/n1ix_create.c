@@ -24,7 +24,7 @@ typedef struct {
 
 static void n1ix_create_callback(lcb_t instance, int cbtype, const lcb_RESPN1XMGMT *resp)
 {
-    opcookie_n1ix_create_res *result = ecalloc(1, sizeof(opcookie_n1ix_create_res));
+    opcookie_n1ix_create_res *result = opcookie_alloc((opcookie *)resp->cookie, sizeof(opcookie_n1ix_create_res));
     TSRMLS_FETCH();
 
     result->header.err = resp->rc;
@@ -26,7 +26,7 @@ typedef struct {
 
 static void n1ix_list_callback(lcb_t instance, int cbtype, const lcb_RESPN1XMGMT *resp)
 {
-    opcookie_n1ix_list_res *result = ecalloc(1, sizeof(opcookie_n1ix_list_res));
+    opcookie_n1ix_list_res *result = opcookie_alloc((opcookie *)resp->cookie, sizeof(opcookie_n1ix_list_res));
     int i;
     TSRMLS_FETCH();
 
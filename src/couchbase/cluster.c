@@ -22,6 +22,7 @@
 
 zend_class_entry *pcbc_cluster_ce;
 extern zend_class_entry *pcbc_authenticator_ce;
+extern zend_class_entry *pcbc_batch_ce;
 
 /* {{{ proto void Cluster::__construct($connstr = 'couchbase://127.0.0.1/')
    Creates a connection to a cluster */
@@ -143,6 +144,66 @@ PHP_METHOD(Cluster, authenticateAs)
     RETURN_NULL();
 } /* }}} */
 
+/* {{{ proto array Cluster::multiExecute(array $batches)
+   Sends operations of the batches, which might belong to different buckets, and waits for all of them concurrently.
+   Returns the results of the batches under the same keys. */
+PHP_METHOD(Cluster, multiExecute)
+{
+    zval *batches = NULL;
+    PCBC_ZVAL futures;
+    HashTable *ht;
+    HashPosition pos;
+    PCBC_ZVAL *entry;
+    int rv, i;
+
+    rv = zend_parse_parameters(ZEND_NUM_ARGS() TSRMLS_CC, "a", &batches);
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    ht = Z_ARRVAL_P(batches);
+    for (zend_hash_internal_pointer_reset_ex(ht, &pos); (entry = PCBC_HASH_GET_CURRENT_DATA_EX(ht, &pos)) != NULL;
+         zend_hash_move_forward_ex(ht, &pos)) {
+        if (Z_TYPE_P(PCBC_N(entry)) != IS_OBJECT ||
+            !instanceof_function(Z_OBJCE_P(PCBC_N(entry)), pcbc_batch_ce TSRMLS_CC)) {
+            throw_pcbc_exception("Expected array of Batch objects", LCB_EINVAL);
+            RETURN_NULL();
+        }
+    }
+
+    // all connections share the IO plugin, so the network activity of all buckets overlaps
+    PCBC_ZVAL_ALLOC(futures);
+    array_init(PCBC_P(futures));
+    for (zend_hash_internal_pointer_reset_ex(ht, &pos); (entry = PCBC_HASH_GET_CURRENT_DATA_EX(ht, &pos)) != NULL;
+         zend_hash_move_forward_ex(ht, &pos)) {
+        PCBC_ZVAL batch_futures;
+
+        PCBC_ZVAL_ALLOC(batch_futures);
+        array_init(PCBC_P(batch_futures));
+        pcbc_batch_dispatch(PCBC_N(entry), PCBC_P(batch_futures) TSRMLS_CC);
+        add_next_index_zval(PCBC_P(futures), PCBC_P(batch_futures));
+        if (EG(exception)) {
+            zval_ptr_dtor(&futures);
+            RETURN_NULL();
+        }
+    }
+
+    array_init(return_value);
+    i = 0;
+    for (zend_hash_internal_pointer_reset_ex(ht, &pos); PCBC_HASH_GET_CURRENT_DATA_EX(ht, &pos) != NULL;
+         zend_hash_move_forward_ex(ht, &pos)) {
+        PCBC_ZVAL res;
+        zval key;
+
+        PCBC_ZVAL_ALLOC(res);
+        pcbc_batch_collect(php_array_fetchn(PCBC_P(futures), i++), PCBC_P(res) TSRMLS_CC);
+        zend_hash_get_current_key_zval_ex(ht, &key, &pos);
+        array_set_zval_key(Z_ARRVAL_P(return_value), &key, PCBC_P(res));
+        zval_dtor(&key);
+        zval_ptr_dtor(&res);
+    }
+    zval_ptr_dtor(&futures);
+} /* }}} */
+
 ZEND_BEGIN_ARG_INFO_EX(ai_Cluster_constructor, 0, 0, 1)
 ZEND_ARG_INFO(0, connstr)
 ZEND_END_ARG_INFO()
@@ -166,6 +227,10 @@ ZEND_ARG_INFO(0, username)
 ZEND_ARG_INFO(0, password)
 ZEND_END_ARG_INFO()
 
+ZEND_BEGIN_ARG_INFO_EX(ai_Cluster_multiExecute, 0, 0, 1)
+ZEND_ARG_INFO(0, batches)
+ZEND_END_ARG_INFO()
+
 // clang-format off
 zend_function_entry cluster_methods[] = {
     PHP_ME(Cluster, __construct, ai_Cluster_constructor, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL | ZEND_ACC_CTOR)
@@ -173,6 +238,7 @@ zend_function_entry cluster_methods[] = {
     PHP_ME(Cluster, manager, ai_Cluster_manager, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Cluster, authenticate, ai_Cluster_authenticate, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(Cluster, authenticateAs, ai_Cluster_authenticateAs, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Cluster, multiExecute, ai_Cluster_multiExecute, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_FE_END
 };
 // clang-format on
@@ -17,6 +17,10 @@
 #include "couchbase.h"
 
 zend_class_entry *pcbc_document_ce;
+zend_object_handlers pcbc_document_handlers;
+#if PHP_VERSION_ID >= 70000
+static uint32_t pcbc_document_value_offset;
+#endif
 
 // clang-format off
 zend_function_entry document_methods[] = {
@@ -24,6 +28,242 @@ zend_function_entry document_methods[] = {
 };
 // clang-format on
 
+static int document_is_value(zval *member)
+{
+    return Z_TYPE_P(member) == IS_STRING && Z_STRLEN_P(member) == sizeof("value") - 1 &&
+           memcmp(Z_STRVAL_P(member), "value", sizeof("value") - 1) == 0;
+}
+
+static void document_forget_bytes(pcbc_document_t *obj)
+{
+    if (!Z_ISUNDEF(obj->bytes)) {
+        zval_ptr_dtor(&obj->bytes);
+        ZVAL_UNDEF(PCBC_P(obj->bytes));
+    }
+    if (!Z_ISUNDEF(obj->decoder)) {
+        zval_ptr_dtor(&obj->decoder);
+        ZVAL_UNDEF(PCBC_P(obj->decoder));
+    }
+}
+
+/* replaces pending encoded bytes with the decoded value */
+static void document_decode(zval *object TSRMLS_DC)
+{
+    pcbc_document_t *obj = Z_DOCUMENT_OBJ_P(object);
+    PCBC_ZVAL bytes, decoder, val;
+
+    if (Z_ISUNDEF(obj->bytes)) {
+        return;
+    }
+    // the state is detached first, so that the decoder, which accesses the document, does not recurse
+    bytes = obj->bytes;
+    decoder = obj->decoder;
+    ZVAL_UNDEF(PCBC_P(obj->bytes));
+    ZVAL_UNDEF(PCBC_P(obj->decoder));
+
+    PCBC_ZVAL_ALLOC(val);
+    ZVAL_NULL(PCBC_P(val));
+    pcbc_decode_value_ex(PCBC_P(val), Z_ISUNDEF(decoder) ? NULL : PCBC_P(decoder), PCBC_P(bytes), obj->flags,
+                         obj->datatype TSRMLS_CC);
+    zend_update_property(pcbc_document_ce, object, ZEND_STRL("value"), PCBC_P(val) TSRMLS_CC);
+    zval_ptr_dtor(&val);
+    zval_ptr_dtor(&bytes);
+    if (!Z_ISUNDEF(decoder)) {
+        zval_ptr_dtor(&decoder);
+    }
+}
+
+static void document_free_object(pcbc_free_object_arg *object TSRMLS_DC) /* {{{ */
+{
+    pcbc_document_t *obj = Z_DOCUMENT_OBJ(object);
+
+    document_forget_bytes(obj);
+    zend_object_std_dtor(&obj->std TSRMLS_CC);
+#if PHP_VERSION_ID < 70000
+    efree(obj);
+#endif
+} /* }}} */
+
+static pcbc_create_object_retval document_create_object(zend_class_entry *class_type TSRMLS_DC)
+{
+    pcbc_document_t *obj = NULL;
+
+    obj = PCBC_ALLOC_OBJECT_T(pcbc_document_t, class_type);
+
+    zend_object_std_init(&obj->std, class_type TSRMLS_CC);
+    object_properties_init(&obj->std, class_type);
+
+#if PHP_VERSION_ID >= 70000
+    obj->std.handlers = &pcbc_document_handlers;
+    return &obj->std;
+#else
+    {
+        zend_object_value ret;
+        ret.handle = zend_objects_store_put(obj, (zend_objects_store_dtor_t)zend_objects_destroy_object,
+                                            document_free_object, NULL TSRMLS_CC);
+        ret.handlers = &pcbc_document_handlers;
+        return ret;
+    }
+#endif
+}
+
+#if PHP_VERSION_ID >= 70000
+static zend_object *document_clone_object(zval *object) /* {{{ */
+{
+    zend_object *old_object = Z_OBJ_P(object);
+    zend_object *new_object;
+
+    document_decode(object);
+    new_object = document_create_object(old_object->ce);
+    zend_objects_clone_members(new_object, old_object);
+    return new_object;
+} /* }}} */
+
+static zval *document_read_property(zval *object, zval *member, int type, void **cache_slot, zval *rv) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_decode(object);
+    }
+    return zend_get_std_object_handlers()->read_property(object, member, type, cache_slot, rv);
+} /* }}} */
+
+static zval *document_get_property_ptr_ptr(zval *object, zval *member, int type, void **cache_slot) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_decode(object);
+    }
+    return zend_get_std_object_handlers()->get_property_ptr_ptr(object, member, type, cache_slot);
+} /* }}} */
+
+static int document_has_property(zval *object, zval *member, int has_set_exists, void **cache_slot) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_decode(object);
+    }
+    return zend_get_std_object_handlers()->has_property(object, member, has_set_exists, cache_slot);
+} /* }}} */
+
+static void document_write_property(zval *object, zval *member, zval *value, void **cache_slot) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_forget_bytes(Z_DOCUMENT_OBJ_P(object));
+    }
+    zend_get_std_object_handlers()->write_property(object, member, value, cache_slot);
+} /* }}} */
+
+static void document_unset_property(zval *object, zval *member, void **cache_slot) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_forget_bytes(Z_DOCUMENT_OBJ_P(object));
+    }
+    zend_get_std_object_handlers()->unset_property(object, member, cache_slot);
+} /* }}} */
+
+/* does not decode the value, because the collector must not call user code */
+static HashTable *document_get_gc(zval *object, zval **table, int *n) /* {{{ */
+{
+    zend_object *zobj = Z_OBJ_P(object);
+
+    if (zobj->properties) {
+        *table = NULL;
+        *n = 0;
+        return zobj->properties;
+    }
+    *table = zobj->properties_table;
+    *n = zobj->ce->default_properties_count;
+    return NULL;
+} /* }}} */
+#else
+static zend_object_value document_clone_object(zval *object TSRMLS_DC) /* {{{ */
+{
+    zend_object *old_object = zend_object_store_get_object(object TSRMLS_CC);
+    zend_object_value new_value;
+
+    document_decode(object TSRMLS_CC);
+    new_value = document_create_object(old_object->ce TSRMLS_CC);
+    zend_objects_clone_members(zend_object_store_get_object_by_handle(new_value.handle TSRMLS_CC), new_value,
+                               old_object, Z_OBJ_HANDLE_P(object) TSRMLS_CC);
+    return new_value;
+} /* }}} */
+
+static zval *document_read_property(zval *object, zval *member, int type, const zend_literal *key TSRMLS_DC) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_decode(object TSRMLS_CC);
+    }
+    return zend_get_std_object_handlers()->read_property(object, member, type, key TSRMLS_CC);
+} /* }}} */
+
+static zval **document_get_property_ptr_ptr(zval *object, zval *member, int type,
+                                            const zend_literal *key TSRMLS_DC) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_decode(object TSRMLS_CC);
+    }
+    return zend_get_std_object_handlers()->get_property_ptr_ptr(object, member, type, key TSRMLS_CC);
+} /* }}} */
+
+static int document_has_property(zval *object, zval *member, int has_set_exists,
+                                 const zend_literal *key TSRMLS_DC) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_decode(object TSRMLS_CC);
+    }
+    return zend_get_std_object_handlers()->has_property(object, member, has_set_exists, key TSRMLS_CC);
+} /* }}} */
+
+static void document_write_property(zval *object, zval *member, zval *value,
+                                    const zend_literal *key TSRMLS_DC) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_forget_bytes(Z_DOCUMENT_OBJ_P(object));
+    }
+    zend_get_std_object_handlers()->write_property(object, member, value, key TSRMLS_CC);
+} /* }}} */
+
+static void document_unset_property(zval *object, zval *member, const zend_literal *key TSRMLS_DC) /* {{{ */
+{
+    if (document_is_value(member)) {
+        document_forget_bytes(Z_DOCUMENT_OBJ_P(object));
+    }
+    zend_get_std_object_handlers()->unset_property(object, member, key TSRMLS_CC);
+} /* }}} */
+
+/* does not decode the value, because the collector must not call user code */
+static HashTable *document_get_gc(zval *object, zval ***table, int *n TSRMLS_DC) /* {{{ */
+{
+    zend_object *zobj = zend_object_store_get_object(object TSRMLS_CC);
+
+    if (zobj->properties) {
+        *table = NULL;
+        *n = 0;
+        return zobj->properties;
+    }
+    *table = zobj->properties_table;
+    *n = zobj->ce->default_properties_count;
+    return NULL;
+} /* }}} */
+#endif
+
+static HashTable *document_get_properties(zval *object TSRMLS_DC) /* {{{ */
+{
+    document_decode(object TSRMLS_CC);
+    return zend_get_std_object_handlers()->get_properties(object TSRMLS_CC);
+} /* }}} */
+
+static HashTable *document_get_debug_info(zval *object, int *is_temp TSRMLS_DC) /* {{{ */
+{
+    *is_temp = 0;
+    return document_get_properties(object TSRMLS_CC);
+} /* }}} */
+
+static int document_compare_objects(zval *object1, zval *object2 TSRMLS_DC) /* {{{ */
+{
+    document_decode(object1 TSRMLS_CC);
+    document_decode(object2 TSRMLS_CC);
+    return zend_get_std_object_handlers()->compare_objects(object1, object2 TSRMLS_CC);
+} /* }}} */
+
 void pcbc_document_init_error(zval *return_value, opcookie_res *header TSRMLS_DC)
 {
     PCBC_ZVAL exc;
@@ -36,16 +276,32 @@ void pcbc_document_init_error(zval *return_value, opcookie_res *header TSRMLS_DC
     zval_ptr_dtor(&exc);
 }
 
-void pcbc_document_init_decode(zval *return_value, pcbc_bucket_t *bucket, const char *bytes, int bytes_len,
-                               lcb_U32 flags, lcb_datatype_t datatype, lcb_cas_t cas,
-                               const lcb_MUTATION_TOKEN *token TSRMLS_DC)
+/* bytes is PHP string with the encoded value, which might be reused by decoder without copying. Unless
+ * couchbase.decoder.lazy is disabled, the document keeps the bytes, and decodes them on first access to the value */
+void pcbc_document_init_decode(zval *return_value, pcbc_bucket_t *bucket, zval *bytes, lcb_U32 flags,
+                               lcb_datatype_t datatype, lcb_cas_t cas, const lcb_MUTATION_TOKEN *token TSRMLS_DC)
 {
     object_init_ex(return_value, pcbc_document_ce);
 
-    if (bytes_len) {
+    if (Z_STRLEN_P(bytes) && PCBCG(dec_lazy)) {
+        pcbc_document_t *obj = Z_DOCUMENT_OBJ_P(return_value);
+
+        obj->bytes = PCBC_D(bytes);
+        PCBC_ADDREF_P(PCBC_P(obj->bytes));
+        if (!bucket->native_decoder) {
+            obj->decoder = bucket->decoder;
+            PCBC_ADDREF_P(PCBC_P(obj->decoder));
+        }
+        obj->flags = flags;
+        obj->datatype = datatype;
+#if PHP_VERSION_ID >= 70000
+        // the engine reads defined property slots directly, so the slot must be undefined to reach the handlers
+        ZVAL_UNDEF(OBJ_PROP(Z_OBJ_P(return_value), pcbc_document_value_offset));
+#endif
+    } else if (Z_STRLEN_P(bytes)) {
         PCBC_ZVAL val;
         PCBC_ZVAL_ALLOC(val);
-        pcbc_decode_value(PCBC_P(val), bucket, bytes, bytes_len, flags, datatype TSRMLS_CC);
+        pcbc_decode_value(PCBC_P(val), bucket, bytes, flags, datatype TSRMLS_CC);
         zend_update_property(pcbc_document_ce, return_value, ZEND_STRL("value"), PCBC_P(val) TSRMLS_CC);
         zval_ptr_dtor(&val);
     }
@@ -121,6 +377,7 @@ PHP_MINIT_FUNCTION(Document)
 
     INIT_NS_CLASS_ENTRY(ce, "Couchbase", "Document", document_methods);
     pcbc_document_ce = zend_register_internal_class(&ce TSRMLS_CC);
+    pcbc_document_ce->create_object = document_create_object;
 
     zend_declare_property_null(pcbc_document_ce, "error", strlen("error"), ZEND_ACC_PUBLIC TSRMLS_CC);
     zend_declare_property_null(pcbc_document_ce, "value", strlen("value"), ZEND_ACC_PUBLIC TSRMLS_CC);
@@ -128,6 +385,26 @@ PHP_MINIT_FUNCTION(Document)
     zend_declare_property_null(pcbc_document_ce, "cas", strlen("cas"), ZEND_ACC_PUBLIC TSRMLS_CC);
     zend_declare_property_null(pcbc_document_ce, "token", strlen("token"), ZEND_ACC_PUBLIC TSRMLS_CC);
 
+    memcpy(&pcbc_document_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    pcbc_document_handlers.clone_obj = document_clone_object;
+    pcbc_document_handlers.read_property = document_read_property;
+    pcbc_document_handlers.get_property_ptr_ptr = document_get_property_ptr_ptr;
+    pcbc_document_handlers.has_property = document_has_property;
+    pcbc_document_handlers.write_property = document_write_property;
+    pcbc_document_handlers.unset_property = document_unset_property;
+    pcbc_document_handlers.get_properties = document_get_properties;
+    pcbc_document_handlers.get_debug_info = document_get_debug_info;
+    pcbc_document_handlers.get_gc = document_get_gc;
+    pcbc_document_handlers.compare_objects = document_compare_objects;
+#if PHP_VERSION_ID >= 70000
+    pcbc_document_handlers.free_obj = document_free_object;
+    pcbc_document_handlers.offset = XtOffsetOf(pcbc_document_t, std);
+    {
+        zend_property_info *info = zend_hash_str_find_ptr(&pcbc_document_ce->properties_info, ZEND_STRL("value"));
+        pcbc_document_value_offset = info->offset;
+    }
+#endif
+
     zend_register_class_alias("\\CouchbaseMetaDoc", pcbc_document_ce);
     return SUCCESS;
 }
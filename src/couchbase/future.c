@@ -0,0 +1,236 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "couchbase.h"
+
+#define LOGARGS(future, lvl) LCB_LOG_##lvl, future->conn->lcb, "pcbc/future", __FILE__, __LINE__
+
+zend_class_entry *pcbc_future_ce;
+
+static void future_resolve(pcbc_future_t *future TSRMLS_DC)
+{
+    if (future->resolved) {
+        return;
+    }
+    if (future->cookie->nres < future->nscheduled) {
+        // drives all pending operations of the bucket, so other futures will be completed too
+        lcb_wait(future->conn->lcb);
+    }
+    if (future->cookie->nres < future->nscheduled) {
+        pcbc_log(LOGARGS(future, WARN), "Future is incomplete after wait (%d out of %d responses)",
+                 future->cookie->nres, future->nscheduled);
+    }
+    PCBC_ZVAL_ALLOC(future->result);
+    ZVAL_NULL(PCBC_P(future->result));
+    future->err = future->proc(future->bucket, PCBC_P(future->result), future->cookie, future->is_mapped TSRMLS_CC);
+    opcookie_destroy(future->cookie);
+    future->cookie = NULL;
+    future->resolved = 1;
+}
+
+/* resolves the future, and copies the result into return_value if the operation was successful */
+lcb_error_t pcbc_future_fetch(zval *future, zval *return_value TSRMLS_DC)
+{
+    pcbc_future_t *obj = Z_FUTURE_OBJ_P(future);
+
+    future_resolve(obj TSRMLS_CC);
+    if (obj->err == LCB_SUCCESS) {
+        ZVAL_ZVAL(return_value, PCBC_P(obj->result), 1, 0);
+    }
+    return obj->err;
+}
+
+/* {{{ proto void Future::__construct() Should not be called directly */
+PHP_METHOD(Future, __construct)
+{
+    throw_pcbc_exception("Accessing private constructor.", LCB_EINVAL);
+}
+/* }}} */
+
+/* {{{ proto mixed Future::wait()
+   Waits for the operation to complete, and returns the same value as the synchronous version of the operation */
+PHP_METHOD(Future, wait)
+{
+    lcb_error_t err;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    err = pcbc_future_fetch(getThis(), return_value TSRMLS_CC);
+    if (err != LCB_SUCCESS) {
+        throw_lcb_exception(err);
+        RETURN_NULL();
+    }
+} /* }}} */
+
+/* {{{ proto boolean Future::isReady()
+   Checks if all responses are received, without running the event loop */
+PHP_METHOD(Future, isReady)
+{
+    pcbc_future_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_FUTURE_OBJ_P(getThis());
+    RETURN_BOOL(obj->resolved || obj->cookie->nres >= obj->nscheduled);
+} /* }}} */
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Future_none, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+// clang-format off
+zend_function_entry future_methods[] = {
+    PHP_ME(Future, __construct, ai_Future_none, ZEND_ACC_PRIVATE | ZEND_ACC_FINAL | ZEND_ACC_CTOR)
+    PHP_ME(Future, wait, ai_Future_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Future, isReady, ai_Future_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_FE_END
+};
+// clang-format on
+
+zend_object_handlers pcbc_future_handlers;
+
+void pcbc_future_init(zval *return_value, zval *bucket, opcookie *cookie, int nscheduled, int is_mapped,
+                      pcbc_proc_results_fn proc TSRMLS_DC)
+{
+    pcbc_future_t *future;
+
+    object_init_ex(return_value, pcbc_future_ce);
+    future = Z_FUTURE_OBJ_P(return_value);
+#if PHP_VERSION_ID >= 70000
+    ZVAL_COPY(&future->bucket_zval, bucket);
+#else
+    Z_ADDREF_P(bucket);
+    future->bucket_zval = bucket;
+#endif
+    future->bucket = Z_BUCKET_OBJ_P(bucket);
+    future->conn = future->bucket->conn;
+    pcbc_connection_addref(future->conn TSRMLS_CC);
+    future->cookie = cookie;
+    future->nscheduled = nscheduled;
+    future->is_mapped = is_mapped;
+    future->proc = proc;
+    future->resolved = 0;
+    future->err = LCB_SUCCESS;
+    ZVAL_UNDEF(PCBC_P(future->result));
+}
+
+static void future_dtor_object(PCBC_DTOR_OBJECT_ARGS) /* {{{ */
+{
+    pcbc_future_t *obj = Z_FUTURE_OBJ(object);
+
+    PCBC_DTOR_OBJECT_STD();
+    // the library still refers to the cookie, so the operations are drained while the bucket and its transcoder are
+    // still alive. At shutdown the destructors are called before any object is freed
+    if (obj->cookie && obj->bucket && obj->bucket->conn) {
+        future_resolve(obj TSRMLS_CC);
+    }
+} /* }}} */
+
+static void future_free_object(pcbc_free_object_arg *object TSRMLS_DC) /* {{{ */
+{
+    pcbc_future_t *obj = Z_FUTURE_OBJ(object);
+
+    if (obj->cookie) {
+        // the destructor has been skipped (e.g. after fatal error), the responses received so far are released with
+        // the request memory, and the rest of them are dropped
+        pcbc_connection_orphan(obj->conn, obj->cookie, obj->nscheduled - obj->cookie->nres TSRMLS_CC);
+        obj->cookie = NULL;
+    }
+    pcbc_connection_delref(obj->conn TSRMLS_CC);
+    obj->conn = NULL;
+    if (!Z_ISUNDEF(obj->result)) {
+        zval_ptr_dtor(&obj->result);
+        ZVAL_UNDEF(PCBC_P(obj->result));
+    }
+    if (!Z_ISUNDEF(obj->bucket_zval)) {
+        zval_ptr_dtor(&obj->bucket_zval);
+        ZVAL_UNDEF(PCBC_P(obj->bucket_zval));
+    }
+    obj->bucket = NULL;
+
+    zend_object_std_dtor(&obj->std TSRMLS_CC);
+#if PHP_VERSION_ID < 70000
+    efree(obj);
+#endif
+} /* }}} */
+
+static pcbc_create_object_retval future_create_object(zend_class_entry *class_type TSRMLS_DC)
+{
+    pcbc_future_t *obj = NULL;
+
+    obj = PCBC_ALLOC_OBJECT_T(pcbc_future_t, class_type);
+
+    zend_object_std_init(&obj->std, class_type TSRMLS_CC);
+    object_properties_init(&obj->std, class_type);
+
+#if PHP_VERSION_ID >= 70000
+    obj->std.handlers = &pcbc_future_handlers;
+    return &obj->std;
+#else
+    {
+        zend_object_value ret;
+        ret.handle = zend_objects_store_put(obj, (zend_objects_store_dtor_t)future_dtor_object, future_free_object,
+                                            NULL TSRMLS_CC);
+        ret.handlers = &pcbc_future_handlers;
+        return ret;
+    }
+#endif
+}
+
+static HashTable *future_get_debug_info(zval *object, int *is_temp TSRMLS_DC) /* {{{ */
+{
+    pcbc_future_t *obj = NULL;
+#if PHP_VERSION_ID >= 70000
+    zval retval;
+#else
+    zval retval = zval_used_for_init;
+#endif
+
+    *is_temp = 1;
+    obj = Z_FUTURE_OBJ_P(object);
+
+    array_init(&retval);
+    ADD_ASSOC_LONG_EX(&retval, "scheduled", obj->nscheduled);
+    ADD_ASSOC_LONG_EX(&retval, "received", obj->cookie ? obj->cookie->nres : obj->nscheduled);
+    ADD_ASSOC_BOOL_EX(&retval, "resolved", obj->resolved);
+
+    return Z_ARRVAL(retval);
+} /* }}} */
+
+PHP_MINIT_FUNCTION(Future)
+{
+    zend_class_entry ce;
+
+    INIT_NS_CLASS_ENTRY(ce, "Couchbase", "Future", future_methods);
+    pcbc_future_ce = zend_register_internal_class(&ce TSRMLS_CC);
+    pcbc_future_ce->create_object = future_create_object;
+    PCBC_CE_FLAGS_FINAL(pcbc_future_ce);
+    PCBC_CE_DISABLE_SERIALIZATION(pcbc_future_ce);
+
+    memcpy(&pcbc_future_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    pcbc_future_handlers.get_debug_info = future_get_debug_info;
+#if PHP_VERSION_ID >= 70000
+    pcbc_future_handlers.dtor_obj = future_dtor_object;
+    pcbc_future_handlers.free_obj = future_free_object;
+    pcbc_future_handlers.offset = XtOffsetOf(pcbc_future_t, std);
+#endif
+    return SUCCESS;
+}
@@ -0,0 +1,389 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "couchbase.h"
+
+#define LOGARGS(it, lvl) LCB_LOG_##lvl, it->conn->lcb, "pcbc/get_many_iterator", __FILE__, __LINE__
+
+zend_class_entry *pcbc_get_many_iterator_ce;
+
+/* schedules get operations for the next IDs, so that at most window documents are pending */
+static lcb_error_t get_many_iterator_refill(pcbc_get_many_iterator_t *it TSRMLS_DC)
+{
+    HashTable *ids = Z_ARRVAL_P(PCBC_P(it->ids));
+    lcb_t lcb = it->conn->lcb;
+    lcb_error_t err = LCB_SUCCESS;
+
+    if (it->exhausted || it->nscheduled - it->index >= it->window) {
+        return LCB_SUCCESS;
+    }
+    // the cookie is shared by all refills, so the latency is measured from the last one
+    it->cookie->started = pcbc_metrics_now();
+    it->cookie->scheduled = it->cookie->started;
+    lcb_sched_enter(lcb);
+    while (it->nscheduled - it->index < it->window) {
+        lcb_CMDGET cmd = {0};
+        PCBC_ZVAL *entry = PCBC_HASH_GET_CURRENT_DATA_EX(ids, &it->ids_pos);
+
+        if (entry == NULL) {
+            it->exhausted = 1;
+            break;
+        }
+        if (Z_TYPE_P(PCBC_N(entry)) != IS_STRING) {
+            pcbc_log(LOGARGS(it, ERROR), "Document ID must be a string, stopping at position %d", it->nscheduled);
+            err = LCB_EINVAL;
+            break;
+        }
+        LCB_CMD_SET_KEY(&cmd, Z_STRVAL_P(PCBC_N(entry)), Z_STRLEN_P(PCBC_N(entry)));
+        err = lcb_get3(lcb, it->cookie, &cmd);
+        if (err != LCB_SUCCESS) {
+            break;
+        }
+        zend_hash_move_forward_ex(ids, &it->ids_pos);
+        it->nscheduled++;
+    }
+    lcb_sched_leave(lcb);
+    if (err != LCB_SUCCESS) {
+        // the operations scheduled so far will be delivered, but no more IDs are taken from the list
+        it->exhausted = 1;
+    }
+    return err;
+}
+
+/* moves the iterator to the next document, refilling the window and running the event loop when the buffer is empty */
+static void get_many_iterator_advance(pcbc_get_many_iterator_t *it TSRMLS_DC)
+{
+    opcookie_get_res *res;
+    lcb_error_t err = LCB_SUCCESS;
+
+    if (!Z_ISUNDEF(it->current)) {
+        zval_ptr_dtor(&it->current);
+        ZVAL_UNDEF(PCBC_P(it->current));
+    }
+    if (!Z_ISUNDEF(it->current_id)) {
+        zval_ptr_dtor(&it->current_id);
+        ZVAL_UNDEF(PCBC_P(it->current_id));
+    }
+    if (it->cookie->res_head == NULL) {
+        err = get_many_iterator_refill(it TSRMLS_CC);
+        if (it->cookie->nres < it->nscheduled) {
+            int threshold = it->window / 4;
+
+            if (threshold < 1) {
+                threshold = 1;
+            }
+            if (threshold > it->nscheduled - it->cookie->nres) {
+                threshold = it->nscheduled - it->cookie->nres;
+            }
+            // return from the event loop after a quarter of the window, while the rest of it is still in flight
+            it->cookie->breakout_nres = it->cookie->nres + threshold;
+            lcb_wait(it->conn->lcb);
+            it->cookie->breakout_nres = 0;
+        }
+        if (err != LCB_SUCCESS) {
+            throw_lcb_exception(err);
+            return;
+        }
+    }
+    res = (opcookie_get_res *)opcookie_shift(it->cookie);
+    if (res == NULL) {
+        if (it->index < it->nscheduled) {
+            pcbc_log(LOGARGS(it, ERROR), "No documents received after event loop completion (%d out of %d)",
+                     it->index, it->nscheduled);
+        }
+        return;
+    }
+    it->index++;
+    PCBC_ZVAL_ALLOC(it->current_id);
+    PCBC_STRINGL(it->current_id, res->key, res->key_len);
+    PCBC_ZVAL_ALLOC(it->current);
+    if (res->header.err == LCB_SUCCESS) {
+        pcbc_document_init_decode(PCBC_P(it->current), it->bucket, PCBC_P(res->bytes), res->flags, res->datatype,
+                                  res->cas, NULL TSRMLS_CC);
+    } else {
+        pcbc_document_init_error(PCBC_P(it->current), &res->header TSRMLS_CC);
+    }
+    zval_ptr_dtor(&res->bytes);
+    PCBC_RESP_ERR_FREE(res->header);
+    if (it->cookie->res_head == NULL) {
+        // all buffered documents are consumed, so the arena can be recycled for the next portion
+        opcookie_arena_reset(it->cookie);
+    }
+}
+
+static void get_many_iterator_start(pcbc_get_many_iterator_t *it TSRMLS_DC)
+{
+    if (!it->started) {
+        it->started = 1;
+        get_many_iterator_advance(it TSRMLS_CC);
+    }
+}
+
+/* {{{ proto void GetManyIterator::__construct() Should not be called directly */
+PHP_METHOD(GetManyIterator, __construct)
+{
+    throw_pcbc_exception("Accessing private constructor.", LCB_EINVAL);
+}
+/* }}} */
+
+/* {{{ proto void GetManyIterator::rewind() */
+PHP_METHOD(GetManyIterator, rewind)
+{
+    pcbc_get_many_iterator_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_GET_MANY_ITERATOR_OBJ_P(getThis());
+    if (obj->index > 1) {
+        throw_pcbc_exception("Iterator cannot be rewound once iteration has started.", LCB_EINVAL);
+        RETURN_NULL();
+    }
+    get_many_iterator_start(obj TSRMLS_CC);
+} /* }}} */
+
+/* {{{ proto boolean GetManyIterator::valid() */
+PHP_METHOD(GetManyIterator, valid)
+{
+    pcbc_get_many_iterator_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_GET_MANY_ITERATOR_OBJ_P(getThis());
+    get_many_iterator_start(obj TSRMLS_CC);
+    RETURN_BOOL(!Z_ISUNDEF(obj->current));
+} /* }}} */
+
+/* {{{ proto \Couchbase\Document GetManyIterator::current() */
+PHP_METHOD(GetManyIterator, current)
+{
+    pcbc_get_many_iterator_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_GET_MANY_ITERATOR_OBJ_P(getThis());
+    get_many_iterator_start(obj TSRMLS_CC);
+    if (Z_ISUNDEF(obj->current)) {
+        RETURN_NULL();
+    }
+    RETURN_ZVAL(PCBC_P(obj->current), 1, 0);
+} /* }}} */
+
+/* {{{ proto string GetManyIterator::key() */
+PHP_METHOD(GetManyIterator, key)
+{
+    pcbc_get_many_iterator_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_GET_MANY_ITERATOR_OBJ_P(getThis());
+    get_many_iterator_start(obj TSRMLS_CC);
+    if (Z_ISUNDEF(obj->current_id)) {
+        RETURN_NULL();
+    }
+    RETURN_ZVAL(PCBC_P(obj->current_id), 1, 0);
+} /* }}} */
+
+/* {{{ proto void GetManyIterator::next() */
+PHP_METHOD(GetManyIterator, next)
+{
+    pcbc_get_many_iterator_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_GET_MANY_ITERATOR_OBJ_P(getThis());
+    if (!obj->started) {
+        get_many_iterator_start(obj TSRMLS_CC);
+    }
+    get_many_iterator_advance(obj TSRMLS_CC);
+} /* }}} */
+
+ZEND_BEGIN_ARG_INFO_EX(ai_GetManyIterator_none, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+// clang-format off
+zend_function_entry get_many_iterator_methods[] = {
+    PHP_ME(GetManyIterator, __construct, ai_GetManyIterator_none, ZEND_ACC_PRIVATE | ZEND_ACC_FINAL | ZEND_ACC_CTOR)
+    PHP_ME(GetManyIterator, rewind, ai_GetManyIterator_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(GetManyIterator, valid, ai_GetManyIterator_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(GetManyIterator, current, ai_GetManyIterator_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(GetManyIterator, key, ai_GetManyIterator_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(GetManyIterator, next, ai_GetManyIterator_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_FE_END
+};
+// clang-format on
+
+zend_object_handlers pcbc_get_many_iterator_handlers;
+
+void pcbc_get_many_iterator_init(zval *return_value, zval *bucket, zval *ids, int window TSRMLS_DC)
+{
+    pcbc_get_many_iterator_t *it;
+
+    object_init_ex(return_value, pcbc_get_many_iterator_ce);
+    it = Z_GET_MANY_ITERATOR_OBJ_P(return_value);
+#if PHP_VERSION_ID >= 70000
+    ZVAL_COPY(&it->bucket_zval, bucket);
+    ZVAL_COPY(&it->ids, ids);
+#else
+    Z_ADDREF_P(bucket);
+    it->bucket_zval = bucket;
+    Z_ADDREF_P(ids);
+    it->ids = ids;
+#endif
+    zend_hash_internal_pointer_reset_ex(Z_ARRVAL_P(PCBC_P(it->ids)), &it->ids_pos);
+    it->bucket = Z_BUCKET_OBJ_P(bucket);
+    it->conn = it->bucket->conn;
+    pcbc_connection_addref(it->conn TSRMLS_CC);
+    it->cookie = opcookie_init();
+    it->window = window;
+    ZVAL_UNDEF(PCBC_P(it->current));
+    ZVAL_UNDEF(PCBC_P(it->current_id));
+}
+
+static void get_many_iterator_dtor_object(PCBC_DTOR_OBJECT_ARGS) /* {{{ */
+{
+    pcbc_get_many_iterator_t *obj = Z_GET_MANY_ITERATOR_OBJ(object);
+
+    PCBC_DTOR_OBJECT_STD();
+    if (obj->cookie && obj->cookie->nres < obj->nscheduled && obj->bucket && obj->bucket->conn) {
+        // the library still refers to the cookie, so the window is drained before the objects are freed
+        obj->cookie->breakout_nres = 0;
+        lcb_wait(obj->conn->lcb);
+    }
+} /* }}} */
+
+static void get_many_iterator_free_object(pcbc_free_object_arg *object TSRMLS_DC) /* {{{ */
+{
+    pcbc_get_many_iterator_t *obj = Z_GET_MANY_ITERATOR_OBJ(object);
+
+    if (obj->cookie) {
+        opcookie_get_res *res;
+
+        FOREACH_OPCOOKIE_RES(opcookie_get_res, res, obj->cookie)
+        {
+            zval_ptr_dtor(&res->bytes);
+            PCBC_RESP_ERR_FREE(res->header);
+        }
+        opcookie_arena_reset(obj->cookie);
+        // the duration of the whole iteration is not the latency of an operation. Without the destructor (e.g. after
+        // fatal error) the gets might still be in flight, and their responses are dropped
+        pcbc_connection_orphan(obj->conn, obj->cookie, obj->nscheduled - obj->cookie->nres TSRMLS_CC);
+        obj->cookie = NULL;
+    }
+    pcbc_connection_delref(obj->conn TSRMLS_CC);
+    obj->conn = NULL;
+    if (!Z_ISUNDEF(obj->current)) {
+        zval_ptr_dtor(&obj->current);
+        ZVAL_UNDEF(PCBC_P(obj->current));
+    }
+    if (!Z_ISUNDEF(obj->current_id)) {
+        zval_ptr_dtor(&obj->current_id);
+        ZVAL_UNDEF(PCBC_P(obj->current_id));
+    }
+    if (!Z_ISUNDEF(obj->ids)) {
+        zval_ptr_dtor(&obj->ids);
+        ZVAL_UNDEF(PCBC_P(obj->ids));
+    }
+    if (!Z_ISUNDEF(obj->bucket_zval)) {
+        zval_ptr_dtor(&obj->bucket_zval);
+        ZVAL_UNDEF(PCBC_P(obj->bucket_zval));
+    }
+    obj->bucket = NULL;
+
+    zend_object_std_dtor(&obj->std TSRMLS_CC);
+#if PHP_VERSION_ID < 70000
+    efree(obj);
+#endif
+} /* }}} */
+
+static pcbc_create_object_retval get_many_iterator_create_object(zend_class_entry *class_type TSRMLS_DC)
+{
+    pcbc_get_many_iterator_t *obj = NULL;
+
+    obj = PCBC_ALLOC_OBJECT_T(pcbc_get_many_iterator_t, class_type);
+
+    zend_object_std_init(&obj->std, class_type TSRMLS_CC);
+    object_properties_init(&obj->std, class_type);
+
+#if PHP_VERSION_ID >= 70000
+    obj->std.handlers = &pcbc_get_many_iterator_handlers;
+    return &obj->std;
+#else
+    {
+        zend_object_value ret;
+        ret.handle = zend_objects_store_put(obj, (zend_objects_store_dtor_t)get_many_iterator_dtor_object,
+                                            get_many_iterator_free_object, NULL TSRMLS_CC);
+        ret.handlers = &pcbc_get_many_iterator_handlers;
+        return ret;
+    }
+#endif
+}
+
+static HashTable *get_many_iterator_get_debug_info(zval *object, int *is_temp TSRMLS_DC) /* {{{ */
+{
+    pcbc_get_many_iterator_t *obj = NULL;
+#if PHP_VERSION_ID >= 70000
+    zval retval;
+#else
+    zval retval = zval_used_for_init;
+#endif
+
+    *is_temp = 1;
+    obj = Z_GET_MANY_ITERATOR_OBJ_P(object);
+
+    array_init(&retval);
+    ADD_ASSOC_LONG_EX(&retval, "window", obj->window);
+    ADD_ASSOC_LONG_EX(&retval, "position", obj->index);
+    ADD_ASSOC_LONG_EX(&retval, "scheduled", obj->nscheduled);
+    ADD_ASSOC_LONG_EX(&retval, "received", obj->cookie ? obj->cookie->nres : obj->nscheduled);
+
+    return Z_ARRVAL(retval);
+} /* }}} */
+
+PHP_MINIT_FUNCTION(GetManyIterator)
+{
+    zend_class_entry ce;
+
+    INIT_NS_CLASS_ENTRY(ce, "Couchbase", "GetManyIterator", get_many_iterator_methods);
+    pcbc_get_many_iterator_ce = zend_register_internal_class(&ce TSRMLS_CC);
+    pcbc_get_many_iterator_ce->create_object = get_many_iterator_create_object;
+    PCBC_CE_FLAGS_FINAL(pcbc_get_many_iterator_ce);
+    PCBC_CE_DISABLE_SERIALIZATION(pcbc_get_many_iterator_ce);
+    zend_class_implements(pcbc_get_many_iterator_ce TSRMLS_CC, 1, zend_ce_iterator);
+
+    memcpy(&pcbc_get_many_iterator_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    pcbc_get_many_iterator_handlers.get_debug_info = get_many_iterator_get_debug_info;
+#if PHP_VERSION_ID >= 70000
+    pcbc_get_many_iterator_handlers.dtor_obj = get_many_iterator_dtor_object;
+    pcbc_get_many_iterator_handlers.free_obj = get_many_iterator_free_object;
+    pcbc_get_many_iterator_handlers.offset = XtOffsetOf(pcbc_get_many_iterator_t, std);
+#endif
+    return SUCCESS;
+}
@@ -0,0 +1,257 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "couchbase.h"
+
+#define LOGARGS(lvl) LCB_LOG_##lvl, NULL, "pcbc/io", __FILE__, __LINE__
+
+/* The IO plugin is created by the library as usual, but its event and timer procedures are interposed, so that the
+ * sockets and the deadlines the library is waiting for are known to the extension. An external event loop can watch
+ * them (see Bucket::watchers()), and call Bucket::tick() when one of them is ready, instead of blocking in lcb_wait().
+ *
+ * The procedures are the same for every instance of the plugin, so they are kept in the static variables, while the
+ * watchers belong to the IO plugin of the thread. */
+struct pcbc_io_watcher {
+    void *inner; // event or timer of the IO plugin
+    int timer;
+    lcb_socket_t sock;
+    short flags;      // LCB_READ_EVENT and LCB_WRITE_EVENT the event is watching for
+    lcb_U64 deadline; // when the timer fires, see pcbc_metrics_now(), or zero if it is not scheduled
+    lcb_ioE_callback callback;
+    void *uarg;
+    struct pcbc_io_watcher *prev;
+    struct pcbc_io_watcher *next;
+};
+
+static lcb_io_procs_fn orig_get_procs = NULL;
+static lcb_ev_procs orig_ev_procs;
+static lcb_timer_procs orig_timer_procs;
+static int event_model = 0;
+
+static pcbc_io_watcher_t *watcher_new(void *inner, int timer)
+{
+    pcbc_io_watcher_t *watcher;
+    TSRMLS_FETCH();
+
+    watcher = pecalloc(1, sizeof(pcbc_io_watcher_t), 1);
+    watcher->inner = inner;
+    watcher->timer = timer;
+    watcher->next = PCBCG(io_watchers);
+    if (watcher->next) {
+        watcher->next->prev = watcher;
+    }
+    PCBCG(io_watchers) = watcher;
+    return watcher;
+}
+
+static void watcher_free(pcbc_io_watcher_t *watcher)
+{
+    TSRMLS_FETCH();
+
+    if (watcher->prev) {
+        watcher->prev->next = watcher->next;
+    } else {
+        PCBCG(io_watchers) = watcher->next;
+    }
+    if (watcher->next) {
+        watcher->next->prev = watcher->prev;
+    }
+    pefree(watcher, 1);
+}
+
+static void *io_event_create(lcb_io_opt_t iops)
+{
+    void *event = orig_ev_procs.create(iops);
+    if (event == NULL) {
+        return NULL;
+    }
+    return watcher_new(event, 0);
+}
+
+static void io_event_destroy(lcb_io_opt_t iops, void *event)
+{
+    pcbc_io_watcher_t *watcher = event;
+
+    orig_ev_procs.destroy(iops, watcher->inner);
+    watcher_free(watcher);
+}
+
+static void io_event_cancel(lcb_io_opt_t iops, lcb_socket_t sock, void *event)
+{
+    pcbc_io_watcher_t *watcher = event;
+
+    watcher->flags = 0;
+    orig_ev_procs.cancel(iops, sock, watcher->inner);
+}
+
+static int io_event_watch(lcb_io_opt_t iops, lcb_socket_t sock, void *event, short flags, void *uarg,
+                          lcb_ioE_callback callback)
+{
+    pcbc_io_watcher_t *watcher = event;
+
+    watcher->sock = sock;
+    watcher->flags = flags;
+    return orig_ev_procs.watch(iops, sock, watcher->inner, flags, uarg, callback);
+}
+
+static void *io_timer_create(lcb_io_opt_t iops)
+{
+    void *timer = orig_timer_procs.create(iops);
+    if (timer == NULL) {
+        return NULL;
+    }
+    return watcher_new(timer, 1);
+}
+
+static void io_timer_destroy(lcb_io_opt_t iops, void *timer)
+{
+    pcbc_io_watcher_t *watcher = timer;
+
+    orig_timer_procs.destroy(iops, watcher->inner);
+    watcher_free(watcher);
+}
+
+static void io_timer_cancel(lcb_io_opt_t iops, void *timer)
+{
+    pcbc_io_watcher_t *watcher = timer;
+
+    watcher->deadline = 0;
+    orig_timer_procs.cancel(iops, watcher->inner);
+}
+
+static void io_timer_fired(lcb_socket_t sock, short flags, void *arg)
+{
+    pcbc_io_watcher_t *watcher = arg;
+
+    // the callback might destroy the timer
+    watcher->deadline = 0;
+    watcher->callback(sock, flags, watcher->uarg);
+}
+
+static int io_timer_schedule(lcb_io_opt_t iops, void *timer, lcb_U32 usec, void *uarg, lcb_ioE_callback callback)
+{
+    pcbc_io_watcher_t *watcher = timer;
+
+    watcher->deadline = pcbc_metrics_now() + usec;
+    watcher->callback = callback;
+    watcher->uarg = uarg;
+    return orig_timer_procs.schedule(iops, watcher->inner, usec, watcher, io_timer_fired);
+}
+
+static void get_procs(int version, lcb_loop_procs *loop_procs, lcb_timer_procs *timer_procs,
+                      lcb_bsd_procs *bsd_procs, lcb_ev_procs *ev_procs, lcb_completion_procs *completion_procs,
+                      lcb_iomodel_t *iomodel)
+{
+    orig_get_procs(version, loop_procs, timer_procs, bsd_procs, ev_procs, completion_procs, iomodel);
+
+    orig_timer_procs = *timer_procs;
+    timer_procs->create = io_timer_create;
+    timer_procs->destroy = io_timer_destroy;
+    timer_procs->cancel = io_timer_cancel;
+    timer_procs->schedule = io_timer_schedule;
+    if (*iomodel == LCB_IOMODEL_EVENT) {
+        event_model = 1;
+        orig_ev_procs = *ev_procs;
+        ev_procs->create = io_event_create;
+        ev_procs->destroy = io_event_destroy;
+        ev_procs->cancel = io_event_cancel;
+        ev_procs->watch = io_event_watch;
+    }
+}
+
+lcb_error_t pcbc_io_create(lcb_io_opt_t *io TSRMLS_DC)
+{
+    lcb_io_procs_fn *plugin_get_procs;
+    lcb_error_t err;
+
+    err = lcb_create_io_ops(io, NULL);
+    if (err != LCB_SUCCESS) {
+        return err;
+    }
+    // the built-in plugins are of version 3, which keeps get_procs at different offset than version 2
+    switch ((*io)->version) {
+    case 2:
+        plugin_get_procs = &(*io)->v.v2.get_procs;
+        break;
+    case 3:
+        plugin_get_procs = &(*io)->v.v3.get_procs;
+        break;
+    default:
+        pcbc_log(LOGARGS(INFO), "IO plugin of version %d does not allow to track its watchers", (*io)->version);
+        return LCB_SUCCESS;
+    }
+    if (*plugin_get_procs == NULL) {
+        pcbc_log(LOGARGS(INFO), "IO plugin does not export its procedures, watchers will not be tracked");
+        return LCB_SUCCESS;
+    }
+    if (orig_get_procs == NULL) {
+        orig_get_procs = *plugin_get_procs;
+    }
+    *plugin_get_procs = get_procs;
+    return LCB_SUCCESS;
+}
+
+void pcbc_io_destroy(lcb_io_opt_t io, pcbc_io_watcher_t *watchers)
+{
+    // the instances have released their events and timers already, but free anything left just in case
+    while (watchers) {
+        pcbc_io_watcher_t *next = watchers->next;
+        pefree(watchers, 1);
+        watchers = next;
+    }
+    if (io) {
+        lcb_destroy_io_ops(io);
+    }
+}
+
+int pcbc_io_watchers(zval *return_value TSRMLS_DC)
+{
+    pcbc_io_watcher_t *watcher;
+    PCBC_ZVAL read, write;
+    lcb_U64 deadline = 0;
+
+    if (!event_model) {
+        return FAILURE;
+    }
+    array_init(return_value);
+    PCBC_ZVAL_ALLOC(read);
+    array_init(PCBC_P(read));
+    PCBC_ZVAL_ALLOC(write);
+    array_init(PCBC_P(write));
+    for (watcher = PCBCG(io_watchers); watcher; watcher = watcher->next) {
+        if (watcher->timer) {
+            if (watcher->deadline && (deadline == 0 || watcher->deadline < deadline)) {
+                deadline = watcher->deadline;
+            }
+            continue;
+        }
+        if (watcher->flags & LCB_READ_EVENT) {
+            add_next_index_long(PCBC_P(read), (long)watcher->sock);
+        }
+        if (watcher->flags & LCB_WRITE_EVENT) {
+            add_next_index_long(PCBC_P(write), (long)watcher->sock);
+        }
+    }
+    ADD_ASSOC_ZVAL_EX(return_value, "read", PCBC_P(read));
+    ADD_ASSOC_ZVAL_EX(return_value, "write", PCBC_P(write));
+    if (deadline) {
+        lcb_U64 now = pcbc_metrics_now();
+        ADD_ASSOC_DOUBLE_EX(return_value, "timeout", deadline > now ? (deadline - now) / 1000000.0 : 0.0);
+    } else {
+        ADD_ASSOC_NULL_EX(return_value, "timeout");
+    }
+    return SUCCESS;
+}
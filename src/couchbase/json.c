@@ -0,0 +1,164 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "couchbase.h"
+
+#if HAVE_COUCHBASE_YYJSON && PHP_VERSION_ID >= 70000
+#include <yyjson.h>
+#include <math.h>
+
+/* Every construct, for which the result of php_json_decode() might be different (special property names, negative
+ * zero, nesting deeper than the limit), makes the conversion fail, so that the caller decodes the document again with
+ * php_json_decode(), and gets exactly the same value and json_last_error() as without the fast parser */
+static int json_convert(zval *res, yyjson_val *val, int assoc, int depth)
+{
+    switch (yyjson_get_type(val)) {
+    case YYJSON_TYPE_NULL:
+        ZVAL_NULL(res);
+        return SUCCESS;
+
+    case YYJSON_TYPE_BOOL:
+        ZVAL_BOOL(res, yyjson_get_bool(val));
+        return SUCCESS;
+
+    case YYJSON_TYPE_NUM:
+        switch (yyjson_get_subtype(val)) {
+        case YYJSON_SUBTYPE_UINT: {
+            uint64_t num = yyjson_get_uint(val);
+            if (num > (uint64_t)ZEND_LONG_MAX) {
+                /* php_json converts big integers with zend_strtod(), which yields the same double */
+                ZVAL_DOUBLE(res, (double)num);
+            } else {
+                ZVAL_LONG(res, (zend_long)num);
+            }
+            return SUCCESS;
+        }
+        case YYJSON_SUBTYPE_SINT: {
+            int64_t num = yyjson_get_sint(val);
+#if SIZEOF_ZEND_LONG < 8
+            if (num < ZEND_LONG_MIN || num > ZEND_LONG_MAX) {
+                ZVAL_DOUBLE(res, (double)num);
+                return SUCCESS;
+            }
+#endif
+            ZVAL_LONG(res, (zend_long)num);
+            return SUCCESS;
+        }
+        default: {
+            double num = yyjson_get_real(val);
+            if (num == 0.0 && signbit(num)) {
+                /* "-0" is integer zero for php_json, but "-0.0" is a double */
+                return FAILURE;
+            }
+            ZVAL_DOUBLE(res, num);
+            return SUCCESS;
+        }
+        }
+
+    case YYJSON_TYPE_STR:
+        ZVAL_STRINGL(res, yyjson_get_str(val), yyjson_get_len(val));
+        return SUCCESS;
+
+    case YYJSON_TYPE_ARR: {
+        yyjson_arr_iter iter;
+        yyjson_val *item;
+
+        if (++depth > PHP_JSON_PARSER_DEFAULT_DEPTH) {
+            return FAILURE;
+        }
+        array_init_size(res, (uint32_t)yyjson_arr_size(val));
+        yyjson_arr_iter_init(val, &iter);
+        while ((item = yyjson_arr_iter_next(&iter)) != NULL) {
+            zval child;
+            if (json_convert(&child, item, assoc, depth) != SUCCESS) {
+                zval_ptr_dtor(res);
+                return FAILURE;
+            }
+            add_next_index_zval(res, &child);
+        }
+        return SUCCESS;
+    }
+
+    case YYJSON_TYPE_OBJ: {
+        yyjson_obj_iter iter;
+        yyjson_val *key;
+
+        if (++depth > PHP_JSON_PARSER_DEFAULT_DEPTH) {
+            return FAILURE;
+        }
+        if (assoc) {
+            array_init_size(res, (uint32_t)yyjson_obj_size(val));
+        } else {
+            object_init(res);
+        }
+        yyjson_obj_iter_init(val, &iter);
+        while ((key = yyjson_obj_iter_next(&iter)) != NULL) {
+            const char *name = yyjson_get_str(key);
+            size_t name_len = yyjson_get_len(key);
+            zval child;
+
+            if (!assoc) {
+#if PHP_VERSION_ID < 70100
+                if (name_len == 0) {
+                    /* renamed to "_empty_" by php_json */
+                    zval_ptr_dtor(res);
+                    return FAILURE;
+                }
+#endif
+                if (name_len > 0 && name[0] == '\0') {
+                    /* mangled names of the private properties are rejected by php_json */
+                    zval_ptr_dtor(res);
+                    return FAILURE;
+                }
+            }
+            if (json_convert(&child, yyjson_obj_iter_get_val(key), assoc, depth) != SUCCESS) {
+                zval_ptr_dtor(res);
+                return FAILURE;
+            }
+            if (assoc) {
+                zend_symtable_str_update(Z_ARRVAL_P(res), name, name_len, &child);
+            } else {
+                add_property_zval_ex(res, name, name_len, &child);
+                zval_ptr_dtor(&child);
+            }
+        }
+        return SUCCESS;
+    }
+
+    default:
+        return FAILURE;
+    }
+}
+
+int pcbc_json_fast_decode(zval *return_value, const char *src, size_t len, int options)
+{
+    yyjson_doc *doc;
+    int rv;
+
+    if (options & ~PHP_JSON_OBJECT_AS_ARRAY) {
+        /* only default conversion is supported, e.g. JSON_BIGINT_AS_STRING needs the original text */
+        return FAILURE;
+    }
+    doc = yyjson_read(src, len, 0);
+    if (doc == NULL) {
+        /* let php_json_decode() report the error */
+        return FAILURE;
+    }
+    rv = json_convert(return_value, yyjson_doc_get_root(doc), options & PHP_JSON_OBJECT_AS_ARRAY, 0);
+    yyjson_doc_free(doc);
+    return rv;
+}
+#endif
@@ -152,6 +152,22 @@ PHP_METHOD(LookupInBuilder, execute)
     pcbc_bucket_subdoc_request(obj->bucket, obj, 1, return_value TSRMLS_CC);
 } /* }}} */
 
+/* {{{ proto \Couchbase\Future LookupInBuilder::executeAsync() */
+PHP_METHOD(LookupInBuilder, executeAsync)
+{
+    pcbc_lookup_in_builder_t *obj;
+    int rv;
+
+    obj = Z_LOOKUP_IN_BUILDER_OBJ_P(getThis());
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+
+    pcbc_bucket_subdoc_request_async(PCBC_P(obj->bucket_zval), obj, 1, return_value TSRMLS_CC);
+} /* }}} */
+
 ZEND_BEGIN_ARG_INFO_EX(ai_LookupInBuilder_none, 0, 0, 0)
 ZEND_END_ARG_INFO()
 
@@ -167,6 +183,7 @@ zend_function_entry lookup_in_builder_methods[] = {
     PHP_ME(LookupInBuilder, getCount, ai_LookupInBuilder_get, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(LookupInBuilder, exists, ai_LookupInBuilder_get, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_ME(LookupInBuilder, execute, ai_LookupInBuilder_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(LookupInBuilder, executeAsync, ai_LookupInBuilder_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
     PHP_FE_END
 };
 // clang-format on
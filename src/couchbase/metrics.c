@@ -0,0 +1,601 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "couchbase.h"
+#ifdef PHP_WIN32
+#include "win32/time.h"
+#else
+#include <sys/time.h>
+#endif
+#include <time.h>
+
+#define LOGARGS(lvl) LCB_LOG_##lvl, NULL, "pcbc/tracer", __FILE__, __LINE__
+
+#define PCBC_HISTOGRAM_HALF (1 << (PCBC_HISTOGRAM_SUB_BITS - 1))
+#define PCBC_HISTOGRAM_MAX_VALUE ((((lcb_U64)1) << PCBC_HISTOGRAM_MAX_BITS) - 1)
+
+zend_class_entry *pcbc_metrics_ce;
+
+static const char *pcbc_op_names[PCBC_OP__MAX] = {
+    "get", "get_replica", "store", "unlock", "remove", "touch", "counter",
+    "lookup_in", "mutate_in", "http", "n1ql", "view", "search",
+};
+
+/* returns current time in microseconds, monotonic where it is available */
+lcb_U64 pcbc_metrics_now()
+{
+#if defined(CLOCK_MONOTONIC) && !defined(PHP_WIN32)
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+        return (lcb_U64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    }
+#endif
+    {
+        struct timeval tv;
+
+        gettimeofday(&tv, NULL);
+        return (lcb_U64)tv.tv_sec * 1000000 + tv.tv_usec;
+    }
+}
+
+static int histogram_index(lcb_U64 value)
+{
+    int msb = 0, shift;
+
+    if (value < 2 * PCBC_HISTOGRAM_HALF) {
+        return (int)value;
+    }
+    if (value > PCBC_HISTOGRAM_MAX_VALUE) {
+        value = PCBC_HISTOGRAM_MAX_VALUE;
+    }
+    while ((value >> msb) > 1) {
+        msb++;
+    }
+    shift = msb - (PCBC_HISTOGRAM_SUB_BITS - 1);
+    return shift * PCBC_HISTOGRAM_HALF + (int)(value >> shift);
+}
+
+/* highest value which falls into the bucket with given index */
+static lcb_U64 histogram_value(int index)
+{
+    int shift;
+
+    if (index < 2 * PCBC_HISTOGRAM_HALF) {
+        return index;
+    }
+    shift = index / PCBC_HISTOGRAM_HALF - 1;
+    return (((lcb_U64)(index - shift * PCBC_HISTOGRAM_HALF) + 1) << shift) - 1;
+}
+
+static void histogram_record(pcbc_histogram_t *histogram, lcb_U64 value)
+{
+    if (histogram->count == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->count++;
+    histogram->sum += value;
+    histogram->buckets[histogram_index(value)]++;
+}
+
+static lcb_U64 histogram_percentile(const pcbc_histogram_t *histogram, double percentile)
+{
+    lcb_U64 rank, seen = 0;
+    int ii;
+
+    rank = (lcb_U64)(histogram->count * percentile / 100.0 + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+    for (ii = 0; ii < PCBC_HISTOGRAM_SIZE; ++ii) {
+        seen += histogram->buckets[ii];
+        if (seen >= rank) {
+            lcb_U64 value = histogram_value(ii);
+            return value > histogram->max ? histogram->max : value;
+        }
+    }
+    return histogram->max;
+}
+
+void pcbc_metrics_record(pcbc_metrics_t *metrics, int total, pcbc_op_type_t op, lcb_U64 elapsed)
+{
+    pcbc_histogram_t **slot;
+
+    if (metrics == NULL || (int)op < 0 || op >= PCBC_OP__MAX) {
+        return;
+    }
+    slot = total ? &metrics->total[op] : &metrics->service[op];
+    if (*slot == NULL) {
+        *slot = pecalloc(1, sizeof(pcbc_histogram_t), 1);
+    }
+    histogram_record(*slot, elapsed);
+}
+
+/* accounts the response of the operation, started with the cookie. Must be called once per response */
+void pcbc_metrics_service(lcb_t instance, opcookie *cookie, pcbc_op_type_t op)
+{
+    pcbc_connection_t *conn = (pcbc_connection_t *)lcb_get_cookie(instance);
+
+    if (conn == NULL || conn->metrics == NULL || cookie == NULL || cookie->started == 0) {
+        return;
+    }
+    cookie->responded = pcbc_metrics_now();
+    pcbc_metrics_record(conn->metrics, 0, op, cookie->responded - cookie->scheduled);
+    cookie->metrics = conn->metrics;
+    cookie->op = op;
+}
+
+#if PHP_VERSION_ID >= 70000
+static void pcbc_metrics_dtor(zval *el)
+{
+    pcbc_metrics_t *metrics = Z_PTR_P(el);
+#else
+static void pcbc_metrics_dtor(void *el)
+{
+    pcbc_metrics_t *metrics = *(pcbc_metrics_t **)el;
+#endif
+    int ii;
+
+    for (ii = 0; ii < PCBC_OP__MAX; ++ii) {
+        if (metrics->service[ii]) {
+            pefree(metrics->service[ii], 1);
+        }
+        if (metrics->total[ii]) {
+            pefree(metrics->total[ii], 1);
+        }
+    }
+    pefree(metrics->name, 1);
+    pefree(metrics, 1);
+}
+
+void pcbc_metrics_destroy(HashTable *metrics)
+{
+    if (metrics) {
+        zend_hash_destroy(metrics);
+        pefree(metrics, 1);
+    }
+}
+
+/* returns metrics of the bucket, which outlive pooled connections, so that the evicted connection does not lose
+ * its latencies */
+pcbc_metrics_t *pcbc_metrics_get(const char *bucketname TSRMLS_DC)
+{
+    pcbc_metrics_t *metrics = NULL;
+    size_t len;
+
+    if (bucketname == NULL) {
+        bucketname = "";
+    }
+    len = strlen(bucketname);
+    if (PCBCG(metrics) == NULL) {
+        PCBCG(metrics) = pemalloc(sizeof(HashTable), 1);
+        zend_hash_init(PCBCG(metrics), 8, NULL, pcbc_metrics_dtor, 1);
+    }
+#if PHP_VERSION_ID >= 70000
+    metrics = zend_hash_str_find_ptr(PCBCG(metrics), bucketname, len);
+    if (metrics == NULL) {
+        metrics = pecalloc(1, sizeof(pcbc_metrics_t), 1);
+        metrics->name = pestrdup(bucketname, 1);
+        zend_hash_str_add_ptr(PCBCG(metrics), bucketname, len, metrics);
+    }
+#else
+    {
+        pcbc_metrics_t **ptr = NULL;
+        if (zend_hash_find(PCBCG(metrics), bucketname, len + 1, (void **)&ptr) == SUCCESS) {
+            metrics = *ptr;
+        } else {
+            metrics = pecalloc(1, sizeof(pcbc_metrics_t), 1);
+            metrics->name = pestrdup(bucketname, 1);
+            zend_hash_add(PCBCG(metrics), bucketname, len + 1, (void *)&metrics, sizeof(pcbc_metrics_t *), NULL);
+        }
+    }
+#endif
+    return metrics;
+}
+
+static void histogram_to_array(zval *return_value, const pcbc_histogram_t *histogram)
+{
+    array_init(return_value);
+    ADD_ASSOC_LONG_EX(return_value, "count", histogram->count);
+    ADD_ASSOC_LONG_EX(return_value, "min_us", histogram->min);
+    ADD_ASSOC_LONG_EX(return_value, "max_us", histogram->max);
+    ADD_ASSOC_DOUBLE_EX(return_value, "mean_us", (double)histogram->sum / histogram->count);
+    ADD_ASSOC_LONG_EX(return_value, "p50_us", histogram_percentile(histogram, 50));
+    ADD_ASSOC_LONG_EX(return_value, "p90_us", histogram_percentile(histogram, 90));
+    ADD_ASSOC_LONG_EX(return_value, "p99_us", histogram_percentile(histogram, 99));
+    ADD_ASSOC_LONG_EX(return_value, "p999_us", histogram_percentile(histogram, 99.9));
+}
+
+static void metrics_to_array(zval *return_value, pcbc_metrics_t *metrics)
+{
+    int ii;
+
+    array_init(return_value);
+    for (ii = 0; ii < PCBC_OP__MAX; ++ii) {
+        PCBC_ZVAL op;
+
+        if ((metrics->service[ii] == NULL || metrics->service[ii]->count == 0) &&
+            (metrics->total[ii] == NULL || metrics->total[ii]->count == 0)) {
+            continue;
+        }
+        PCBC_ZVAL_ALLOC(op);
+        array_init(PCBC_P(op));
+        if (metrics->service[ii] && metrics->service[ii]->count) {
+            PCBC_ZVAL histogram;
+            PCBC_ZVAL_ALLOC(histogram);
+            histogram_to_array(PCBC_P(histogram), metrics->service[ii]);
+            ADD_ASSOC_ZVAL_EX(PCBC_P(op), "service", PCBC_P(histogram));
+        }
+        if (metrics->total[ii] && metrics->total[ii]->count) {
+            PCBC_ZVAL histogram;
+            PCBC_ZVAL_ALLOC(histogram);
+            histogram_to_array(PCBC_P(histogram), metrics->total[ii]);
+            ADD_ASSOC_ZVAL_EX(PCBC_P(op), "total", PCBC_P(histogram));
+        }
+#if PHP_VERSION_ID >= 70000
+        add_assoc_zval_ex(return_value, pcbc_op_names[ii], strlen(pcbc_op_names[ii]), PCBC_P(op));
+#else
+        add_assoc_zval_ex(return_value, pcbc_op_names[ii], strlen(pcbc_op_names[ii]) + 1, PCBC_P(op));
+#endif
+    }
+}
+
+static void metrics_reset(pcbc_metrics_t *metrics)
+{
+    int ii;
+
+    for (ii = 0; ii < PCBC_OP__MAX; ++ii) {
+        if (metrics->service[ii]) {
+            memset(metrics->service[ii], 0, sizeof(pcbc_histogram_t));
+        }
+        if (metrics->total[ii]) {
+            memset(metrics->total[ii], 0, sizeof(pcbc_histogram_t));
+        }
+    }
+}
+
+typedef enum {
+    PCBC_SERVICE_KV = 0,
+    PCBC_SERVICE_QUERY,
+    PCBC_SERVICE_VIEW,
+    PCBC_SERVICE_SEARCH,
+    PCBC_SERVICE__MAX
+} pcbc_service_t;
+
+static const char *pcbc_service_names[PCBC_SERVICE__MAX] = {"kv", "query", "view", "search"};
+
+typedef struct {
+    pcbc_op_type_t op;
+    char bucket[64];
+    char id[PCBC_TRACER_ID_SIZE];
+    lcb_U64 total_us;
+    lcb_U64 encode_us;
+    lcb_U64 response_us;
+    lcb_U64 decode_us; // excludes values decoded lazily, after the operation has been completed
+    size_t payload;
+} pcbc_trace_t;
+
+struct pcbc_tracer {
+    lcb_U64 flushed_at;
+    struct {
+        lcb_U64 count; // of all operations over threshold, while only the slowest are sampled
+        int nsamples;
+        pcbc_trace_t samples[PCBC_TRACER_SAMPLE_MAX];
+    } services[PCBC_SERVICE__MAX];
+};
+
+static int tracer_service(pcbc_op_type_t op)
+{
+    switch (op) {
+    case PCBC_OP_N1QL:
+        return PCBC_SERVICE_QUERY;
+    case PCBC_OP_VIEW:
+        return PCBC_SERVICE_VIEW;
+    case PCBC_OP_SEARCH:
+        return PCBC_SERVICE_SEARCH;
+    case PCBC_OP_HTTP:
+        return -1;
+    default:
+        return PCBC_SERVICE_KV;
+    }
+}
+
+static lcb_U64 tracer_threshold(int service TSRMLS_DC)
+{
+    switch (service) {
+    case PCBC_SERVICE_QUERY:
+        return (lcb_U64)PCBCG(tracing_threshold_query) * 1000;
+    case PCBC_SERVICE_VIEW:
+        return (lcb_U64)PCBCG(tracing_threshold_view) * 1000;
+    case PCBC_SERVICE_SEARCH:
+        return (lcb_U64)PCBCG(tracing_threshold_search) * 1000;
+    default:
+        return (lcb_U64)PCBCG(tracing_threshold_kv) * 1000;
+    }
+}
+
+static void tracer_flush(pcbc_tracer_t *tracer, int force TSRMLS_DC);
+
+/* reports the operations completed after the last flush, e.g. drained while the persistent connections are closed */
+void pcbc_tracer_destroy(pcbc_tracer_t *tracer)
+{
+    if (tracer) {
+        TSRMLS_FETCH();
+
+        tracer_flush(tracer, 1 TSRMLS_CC);
+        pefree(tracer, 1);
+    }
+}
+
+/* keeps the operation if it exceeded the threshold of its service, and it is one of the slowest in the interval */
+void pcbc_tracer_record(opcookie *cookie, lcb_U64 total TSRMLS_DC)
+{
+    pcbc_tracer_t *tracer;
+    pcbc_trace_t *trace;
+    int service, sample_size, ii;
+    size_t len, pos;
+
+    if (PCBCG(tracing_interval) == 0 || cookie->metrics == NULL) {
+        return;
+    }
+    service = tracer_service(cookie->op);
+    if (service < 0 || total < tracer_threshold(service TSRMLS_CC)) {
+        return;
+    }
+    if (PCBCG(tracer) == NULL) {
+        PCBCG(tracer) = pecalloc(1, sizeof(pcbc_tracer_t), 1);
+        PCBCG(tracer)->flushed_at = pcbc_metrics_now();
+    }
+    tracer = PCBCG(tracer);
+    sample_size = PCBCG(tracing_sample_size);
+    if (sample_size > PCBC_TRACER_SAMPLE_MAX) {
+        sample_size = PCBC_TRACER_SAMPLE_MAX;
+    }
+    tracer->services[service].count++;
+    if (sample_size == 0) {
+        return;
+    }
+
+    // samples are sorted by total latency in descending order
+    ii = tracer->services[service].nsamples;
+    if (ii >= sample_size) {
+        ii = sample_size - 1;
+        if (tracer->services[service].samples[ii].total_us >= total) {
+            return;
+        }
+    } else {
+        tracer->services[service].nsamples++;
+    }
+    for (; ii > 0 && tracer->services[service].samples[ii - 1].total_us < total; --ii) {
+        tracer->services[service].samples[ii] = tracer->services[service].samples[ii - 1];
+    }
+    trace = &tracer->services[service].samples[ii];
+    memset(trace, 0, sizeof(pcbc_trace_t));
+    trace->op = cookie->op;
+    strncpy(trace->bucket, cookie->metrics->name, sizeof(trace->bucket) - 1);
+    if (cookie->trace_id) {
+        len = cookie->trace_id_len;
+        if (len > sizeof(trace->id) - 1) {
+            len = sizeof(trace->id) - 1;
+        }
+        // document IDs are not necessary valid UTF-8, and the report must be valid JSON
+        for (pos = 0; pos < len; ++pos) {
+            unsigned char ch = (unsigned char)cookie->trace_id[pos];
+            trace->id[pos] = (ch < 0x20 || ch > 0x7e) ? '?' : ch;
+        }
+    }
+    trace->total_us = total;
+    trace->encode_us = cookie->scheduled - cookie->started;
+    trace->response_us = cookie->responded - cookie->scheduled;
+    trace->decode_us = total - trace->encode_us - trace->response_us;
+    trace->payload = cookie->payload;
+
+    pcbc_tracer_flush(0 TSRMLS_CC);
+}
+
+/* writes the slowest operations of every service as single JSON line to the log, and starts new interval */
+static void tracer_flush(pcbc_tracer_t *tracer, int force TSRMLS_DC)
+{
+    PCBC_ZVAL report;
+    smart_str buf = {0};
+    lcb_U64 now;
+    int ii, jj, last_error, empty = 1;
+
+    if (tracer == NULL) {
+        return;
+    }
+    now = pcbc_metrics_now();
+    if (!force && now - tracer->flushed_at < (lcb_U64)PCBCG(tracing_interval) * 1000000) {
+        return;
+    }
+    tracer->flushed_at = now;
+
+    PCBC_ZVAL_ALLOC(report);
+    array_init(PCBC_P(report));
+    for (ii = 0; ii < PCBC_SERVICE__MAX; ++ii) {
+        PCBC_ZVAL service, top;
+
+        if (tracer->services[ii].count == 0) {
+            continue;
+        }
+        empty = 0;
+        PCBC_ZVAL_ALLOC(service);
+        array_init(PCBC_P(service));
+        ADD_ASSOC_STRING(PCBC_P(service), "service", pcbc_service_names[ii]);
+        ADD_ASSOC_LONG_EX(PCBC_P(service), "count", tracer->services[ii].count);
+        PCBC_ZVAL_ALLOC(top);
+        array_init(PCBC_P(top));
+        for (jj = 0; jj < tracer->services[ii].nsamples; ++jj) {
+            pcbc_trace_t *trace = &tracer->services[ii].samples[jj];
+            PCBC_ZVAL entry;
+
+            PCBC_ZVAL_ALLOC(entry);
+            array_init(PCBC_P(entry));
+            ADD_ASSOC_STRING(PCBC_P(entry), "operation", pcbc_op_names[trace->op]);
+            ADD_ASSOC_STRING(PCBC_P(entry), "bucket", trace->bucket);
+            ADD_ASSOC_STRING(PCBC_P(entry), "id", trace->id);
+            ADD_ASSOC_LONG_EX(PCBC_P(entry), "total_us", trace->total_us);
+            ADD_ASSOC_LONG_EX(PCBC_P(entry), "encode_us", trace->encode_us);
+            ADD_ASSOC_LONG_EX(PCBC_P(entry), "response_us", trace->response_us);
+            ADD_ASSOC_LONG_EX(PCBC_P(entry), "decode_us", trace->decode_us);
+            ADD_ASSOC_LONG_EX(PCBC_P(entry), "payload_bytes", trace->payload);
+            add_next_index_zval(PCBC_P(top), PCBC_P(entry));
+        }
+        ADD_ASSOC_ZVAL_EX(PCBC_P(service), "top", PCBC_P(top));
+        add_next_index_zval(PCBC_P(report), PCBC_P(service));
+    }
+    memset(tracer->services, 0, sizeof(tracer->services));
+
+    if (!empty) {
+        smart_str_appends(&buf, "Operations over threshold: ");
+        PCBC_JSON_ENCODE(&buf, PCBC_P(report), 0, last_error);
+        if (last_error != 0) {
+            pcbc_log(LOGARGS(WARN), "Failed to encode report of slow operations as JSON: json_last_error=%d",
+                     last_error);
+        } else {
+            smart_str_0(&buf);
+            pcbc_log_raw(LCB_LOG_WARN, "pcbc/tracer", __LINE__, PCBC_SMARTSTR_VAL(buf));
+        }
+        smart_str_free(&buf);
+    }
+    zval_ptr_dtor(&report);
+}
+
+void pcbc_tracer_flush(int force TSRMLS_DC)
+{
+    tracer_flush(PCBCG(tracer), force TSRMLS_CC);
+}
+
+/* {{{ proto void Metrics::__construct() Should not be called directly */
+PHP_METHOD(Metrics, __construct)
+{
+    throw_pcbc_exception("Accessing private constructor.", LCB_EINVAL);
+}
+/* }}} */
+
+/* {{{ proto array Metrics::snapshot()
+   Returns latency percentiles of every operation type for each bucket used by the current process */
+PHP_METHOD(Metrics, snapshot)
+{
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+
+    array_init(return_value);
+    if (PCBCG(metrics) == NULL) {
+        return;
+    }
+#if PHP_VERSION_ID >= 70000
+    {
+        zend_string *name;
+        pcbc_metrics_t *metrics;
+
+        ZEND_HASH_FOREACH_STR_KEY_PTR(PCBCG(metrics), name, metrics)
+        {
+            zval bucket;
+            metrics_to_array(&bucket, metrics);
+            add_assoc_zval_ex(return_value, ZSTR_VAL(name), ZSTR_LEN(name), &bucket);
+        }
+        ZEND_HASH_FOREACH_END();
+    }
+#else
+    {
+        HashPosition pos;
+        pcbc_metrics_t **ptr;
+
+        for (zend_hash_internal_pointer_reset_ex(PCBCG(metrics), &pos);
+             zend_hash_get_current_data_ex(PCBCG(metrics), (void **)&ptr, &pos) == SUCCESS;
+             zend_hash_move_forward_ex(PCBCG(metrics), &pos)) {
+            char *name;
+            uint name_len;
+            ulong idx;
+            zval *bucket;
+
+            zend_hash_get_current_key_ex(PCBCG(metrics), &name, &name_len, &idx, 0, &pos);
+            MAKE_STD_ZVAL(bucket);
+            metrics_to_array(bucket, *ptr);
+            add_assoc_zval_ex(return_value, name, name_len, bucket);
+        }
+    }
+#endif
+} /* }}} */
+
+/* {{{ proto void Metrics::reset()
+   Clears all histograms */
+PHP_METHOD(Metrics, reset)
+{
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    if (PCBCG(metrics) == NULL) {
+        RETURN_NULL();
+    }
+#if PHP_VERSION_ID >= 70000
+    {
+        pcbc_metrics_t *metrics;
+
+        ZEND_HASH_FOREACH_PTR(PCBCG(metrics), metrics)
+        {
+            metrics_reset(metrics);
+        }
+        ZEND_HASH_FOREACH_END();
+    }
+#else
+    {
+        HashPosition pos;
+        pcbc_metrics_t **ptr;
+
+        for (zend_hash_internal_pointer_reset_ex(PCBCG(metrics), &pos);
+             zend_hash_get_current_data_ex(PCBCG(metrics), (void **)&ptr, &pos) == SUCCESS;
+             zend_hash_move_forward_ex(PCBCG(metrics), &pos)) {
+            metrics_reset(*ptr);
+        }
+    }
+#endif
+    RETURN_NULL();
+} /* }}} */
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Metrics_none, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+// clang-format off
+zend_function_entry metrics_methods[] = {
+    PHP_ME(Metrics, __construct, ai_Metrics_none, ZEND_ACC_PRIVATE | ZEND_ACC_FINAL | ZEND_ACC_CTOR)
+    PHP_ME(Metrics, snapshot, ai_Metrics_none, ZEND_ACC_STATIC | ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(Metrics, reset, ai_Metrics_none, ZEND_ACC_STATIC | ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_FE_END
+};
+// clang-format on
+
+PHP_MINIT_FUNCTION(Metrics)
+{
+    zend_class_entry ce;
+
+    INIT_NS_CLASS_ENTRY(ce, "Couchbase", "Metrics", metrics_methods);
+    pcbc_metrics_ce = zend_register_internal_class(&ce TSRMLS_CC);
+    PCBC_CE_FLAGS_FINAL(pcbc_metrics_ce);
+    PCBC_CE_DISABLE_SERIALIZATION(pcbc_metrics_ce);
+    return SUCCESS;
+}
@@ -0,0 +1,384 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "couchbase.h"
+
+#define LOGARGS(stream, lvl) LCB_LOG_##lvl, stream->conn->lcb, "pcbc/n1ql_query_stream", __FILE__, __LINE__
+
+zend_class_entry *pcbc_n1ql_query_stream_ce;
+
+static void n1ql_query_stream_set_meta(pcbc_n1ql_query_stream_t *stream, zval *row TSRMLS_DC)
+{
+    zval *val;
+
+    if (!Z_ISUNDEF(stream->meta)) {
+        zval_ptr_dtor(&stream->meta);
+        ZVAL_UNDEF(PCBC_P(stream->meta));
+    }
+    PCBC_ZVAL_ALLOC(stream->meta);
+    object_init(PCBC_P(stream->meta));
+    if (Z_TYPE_P(row) != IS_ARRAY) {
+        return;
+    }
+    val = php_array_fetch(row, "requestID");
+    if (val) {
+        add_property_zval(PCBC_P(stream->meta), "requestId", val);
+    }
+    val = php_array_fetch(row, "status");
+    if (val) {
+        add_property_zval(PCBC_P(stream->meta), "status", val);
+    }
+    val = php_array_fetch(row, "signature");
+    if (val) {
+        add_property_zval(PCBC_P(stream->meta), "signature", val);
+    }
+    val = php_array_fetch(row, "metrics");
+    if (val) {
+        add_property_zval(PCBC_P(stream->meta), "metrics", val);
+    }
+}
+
+/* moves the stream to the next row, running the event loop only when the local buffer is empty */
+static void n1ql_query_stream_advance(pcbc_n1ql_query_stream_t *stream TSRMLS_DC)
+{
+    opcookie_n1qlrow_res *res;
+
+    if (!Z_ISUNDEF(stream->current)) {
+        zval_ptr_dtor(&stream->current);
+        ZVAL_UNDEF(PCBC_P(stream->current));
+    }
+    res = (opcookie_n1qlrow_res *)stream->cookie->res_head;
+    if (stream->overflow && (res == NULL || (res->rflags & LCB_RESP_F_FINAL))) {
+        // the rows received after the buffered ones have been dropped, so the stream cannot continue
+        if (stream->handle) {
+            lcb_n1ql_cancel(stream->conn->lcb, stream->handle);
+            stream->handle = NULL;
+        }
+        stream->overflow = 0;
+        stream->complete = 1;
+        throw_pcbc_exception("Query stream has exceeded couchbase.n1ql.stream_max_buffered rows, while it was not "
+                             "iterated. The query has been cancelled.",
+                             LCB_CLIENT_ENOMEM);
+        return;
+    }
+    while (stream->cookie->res_head == NULL && !stream->complete) {
+        stream->waiting = 1;
+        lcb_wait(stream->conn->lcb);
+        stream->waiting = 0;
+        if (stream->cookie->res_head == NULL && !stream->complete) {
+            pcbc_log(LOGARGS(stream, ERROR), "Query stream stalled, no rows received after event loop completion");
+            stream->complete = 1;
+        }
+    }
+    res = (opcookie_n1qlrow_res *)opcookie_shift(stream->cookie);
+    if (res == NULL) {
+        return;
+    }
+    if (res->rflags & LCB_RESP_F_FINAL) {
+        n1ql_query_stream_set_meta(stream, PCBC_P(res->row) TSRMLS_CC);
+        if (res->header.err != LCB_SUCCESS) {
+            if (Z_ISUNDEF(stream->cookie->exc)) {
+                throw_lcb_exception(res->header.err);
+            } else {
+                zend_throw_exception_object(PCBC_P(stream->cookie->exc) TSRMLS_CC);
+                ZVAL_UNDEF(PCBC_P(stream->cookie->exc));
+            }
+        }
+        zval_ptr_dtor(&res->row);
+    } else {
+        stream->nbuffered--;
+        stream->index++;
+#if PHP_VERSION_ID >= 70000
+        ZVAL_COPY_VALUE(&stream->current, &res->row);
+#else
+        stream->current = res->row;
+#endif
+    }
+    if (stream->cookie->res_head == NULL) {
+        // all buffered rows are consumed, so the arena can be recycled for the next batch
+        opcookie_arena_reset(stream->cookie);
+    }
+}
+
+static void n1ql_query_stream_start(pcbc_n1ql_query_stream_t *stream TSRMLS_DC)
+{
+    if (!stream->started) {
+        stream->started = 1;
+        n1ql_query_stream_advance(stream TSRMLS_CC);
+    }
+}
+
+/* {{{ proto void N1qlQueryStream::__construct() Should not be called directly */
+PHP_METHOD(N1qlQueryStream, __construct)
+{
+    throw_pcbc_exception("Accessing private constructor.", LCB_EINVAL);
+}
+/* }}} */
+
+/* {{{ proto void N1qlQueryStream::rewind() */
+PHP_METHOD(N1qlQueryStream, rewind)
+{
+    pcbc_n1ql_query_stream_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_N1QL_QUERY_STREAM_OBJ_P(getThis());
+    if (obj->index > 1) {
+        throw_pcbc_exception("Query stream cannot be rewound once iteration has started.", LCB_EINVAL);
+        RETURN_NULL();
+    }
+    n1ql_query_stream_start(obj TSRMLS_CC);
+} /* }}} */
+
+/* {{{ proto boolean N1qlQueryStream::valid() */
+PHP_METHOD(N1qlQueryStream, valid)
+{
+    pcbc_n1ql_query_stream_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_N1QL_QUERY_STREAM_OBJ_P(getThis());
+    n1ql_query_stream_start(obj TSRMLS_CC);
+    RETURN_BOOL(!Z_ISUNDEF(obj->current));
+} /* }}} */
+
+/* {{{ proto mixed N1qlQueryStream::current() */
+PHP_METHOD(N1qlQueryStream, current)
+{
+    pcbc_n1ql_query_stream_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_N1QL_QUERY_STREAM_OBJ_P(getThis());
+    n1ql_query_stream_start(obj TSRMLS_CC);
+    if (Z_ISUNDEF(obj->current)) {
+        RETURN_NULL();
+    }
+    RETURN_ZVAL(PCBC_P(obj->current), 1, 0);
+} /* }}} */
+
+/* {{{ proto int N1qlQueryStream::key() */
+PHP_METHOD(N1qlQueryStream, key)
+{
+    pcbc_n1ql_query_stream_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_N1QL_QUERY_STREAM_OBJ_P(getThis());
+    n1ql_query_stream_start(obj TSRMLS_CC);
+    if (Z_ISUNDEF(obj->current)) {
+        RETURN_NULL();
+    }
+    RETURN_LONG(obj->index - 1);
+} /* }}} */
+
+/* {{{ proto void N1qlQueryStream::next() */
+PHP_METHOD(N1qlQueryStream, next)
+{
+    pcbc_n1ql_query_stream_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_N1QL_QUERY_STREAM_OBJ_P(getThis());
+    if (!obj->started) {
+        n1ql_query_stream_start(obj TSRMLS_CC);
+    }
+    n1ql_query_stream_advance(obj TSRMLS_CC);
+} /* }}} */
+
+/* {{{ proto object N1qlQueryStream::meta()
+   Returns response metadata (requestId, status, signature, metrics), or NULL if rows are not consumed yet */
+PHP_METHOD(N1qlQueryStream, meta)
+{
+    pcbc_n1ql_query_stream_t *obj;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+    obj = Z_N1QL_QUERY_STREAM_OBJ_P(getThis());
+    if (Z_ISUNDEF(obj->meta)) {
+        RETURN_NULL();
+    }
+    RETURN_ZVAL(PCBC_P(obj->meta), 1, 0);
+} /* }}} */
+
+ZEND_BEGIN_ARG_INFO_EX(ai_N1qlQueryStream_none, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+// clang-format off
+zend_function_entry n1ql_query_stream_methods[] = {
+    PHP_ME(N1qlQueryStream, __construct, ai_N1qlQueryStream_none, ZEND_ACC_PRIVATE | ZEND_ACC_FINAL | ZEND_ACC_CTOR)
+    PHP_ME(N1qlQueryStream, rewind, ai_N1qlQueryStream_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(N1qlQueryStream, valid, ai_N1qlQueryStream_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(N1qlQueryStream, current, ai_N1qlQueryStream_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(N1qlQueryStream, key, ai_N1qlQueryStream_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(N1qlQueryStream, next, ai_N1qlQueryStream_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_ME(N1qlQueryStream, meta, ai_N1qlQueryStream_none, ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_FE_END
+};
+// clang-format on
+
+zend_object_handlers pcbc_n1ql_query_stream_handlers;
+
+void pcbc_n1ql_query_stream_init(zval *return_value, zval *bucket, int json_options, int is_cbas TSRMLS_DC)
+{
+    pcbc_n1ql_query_stream_t *stream;
+
+    object_init_ex(return_value, pcbc_n1ql_query_stream_ce);
+    stream = Z_N1QL_QUERY_STREAM_OBJ_P(return_value);
+#if PHP_VERSION_ID >= 70000
+    ZVAL_COPY(&stream->bucket_zval, bucket);
+#else
+    Z_ADDREF_P(bucket);
+    stream->bucket_zval = bucket;
+#endif
+    stream->bucket = Z_BUCKET_OBJ_P(bucket);
+    stream->conn = stream->bucket->conn;
+    pcbc_connection_addref(stream->conn TSRMLS_CC);
+    stream->cookie = opcookie_init();
+    stream->cookie->json_response = 1;
+    stream->cookie->json_options = json_options;
+    stream->cookie->is_cbas = is_cbas;
+    ZVAL_UNDEF(PCBC_P(stream->current));
+    ZVAL_UNDEF(PCBC_P(stream->meta));
+}
+
+static void n1ql_query_stream_free_object(pcbc_free_object_arg *object TSRMLS_DC) /* {{{ */
+{
+    pcbc_n1ql_query_stream_t *obj = Z_N1QL_QUERY_STREAM_OBJ(object);
+
+    if (obj->handle) {
+        pcbc_log(LOGARGS(obj, DEBUG), "Cancel unfinished query stream. S=%p", (void *)obj);
+        // the callback is not invoked after cancellation, so the cookie can be released without running the loop
+        lcb_n1ql_cancel(obj->conn->lcb, obj->handle);
+        obj->handle = NULL;
+    }
+    if (obj->cookie) {
+        opcookie_n1qlrow_res *res;
+
+        FOREACH_OPCOOKIE_RES(opcookie_n1qlrow_res, res, obj->cookie)
+        {
+            zval_ptr_dtor(&res->row);
+        }
+        if (!Z_ISUNDEF(obj->cookie->exc)) {
+            zval_ptr_dtor(&obj->cookie->exc);
+        }
+        // the duration of the whole iteration is not the latency of the query
+        obj->cookie->metrics = NULL;
+        opcookie_destroy(obj->cookie);
+        obj->cookie = NULL;
+    }
+    if (!Z_ISUNDEF(obj->current)) {
+        zval_ptr_dtor(&obj->current);
+        ZVAL_UNDEF(PCBC_P(obj->current));
+    }
+    if (!Z_ISUNDEF(obj->meta)) {
+        zval_ptr_dtor(&obj->meta);
+        ZVAL_UNDEF(PCBC_P(obj->meta));
+    }
+    pcbc_connection_delref(obj->conn TSRMLS_CC);
+    obj->conn = NULL;
+    if (!Z_ISUNDEF(obj->bucket_zval)) {
+        zval_ptr_dtor(&obj->bucket_zval);
+        ZVAL_UNDEF(PCBC_P(obj->bucket_zval));
+    }
+    obj->bucket = NULL;
+
+    zend_object_std_dtor(&obj->std TSRMLS_CC);
+#if PHP_VERSION_ID < 70000
+    efree(obj);
+#endif
+} /* }}} */
+
+static pcbc_create_object_retval n1ql_query_stream_create_object(zend_class_entry *class_type TSRMLS_DC)
+{
+    pcbc_n1ql_query_stream_t *obj = NULL;
+
+    obj = PCBC_ALLOC_OBJECT_T(pcbc_n1ql_query_stream_t, class_type);
+
+    zend_object_std_init(&obj->std, class_type TSRMLS_CC);
+    object_properties_init(&obj->std, class_type);
+
+#if PHP_VERSION_ID >= 70000
+    obj->std.handlers = &pcbc_n1ql_query_stream_handlers;
+    return &obj->std;
+#else
+    {
+        zend_object_value ret;
+        ret.handle = zend_objects_store_put(obj, (zend_objects_store_dtor_t)zend_objects_destroy_object,
+                                            n1ql_query_stream_free_object, NULL TSRMLS_CC);
+        ret.handlers = &pcbc_n1ql_query_stream_handlers;
+        return ret;
+    }
+#endif
+}
+
+static HashTable *n1ql_query_stream_get_debug_info(zval *object, int *is_temp TSRMLS_DC) /* {{{ */
+{
+    pcbc_n1ql_query_stream_t *obj = NULL;
+#if PHP_VERSION_ID >= 70000
+    zval retval;
+#else
+    zval retval = zval_used_for_init;
+#endif
+
+    *is_temp = 1;
+    obj = Z_N1QL_QUERY_STREAM_OBJ_P(object);
+
+    array_init(&retval);
+    ADD_ASSOC_LONG_EX(&retval, "position", obj->index);
+    ADD_ASSOC_LONG_EX(&retval, "buffered", obj->nbuffered);
+    ADD_ASSOC_BOOL_EX(&retval, "complete", obj->complete);
+
+    return Z_ARRVAL(retval);
+} /* }}} */
+
+PHP_MINIT_FUNCTION(N1qlQueryStream)
+{
+    zend_class_entry ce;
+
+    INIT_NS_CLASS_ENTRY(ce, "Couchbase", "N1qlQueryStream", n1ql_query_stream_methods);
+    pcbc_n1ql_query_stream_ce = zend_register_internal_class(&ce TSRMLS_CC);
+    pcbc_n1ql_query_stream_ce->create_object = n1ql_query_stream_create_object;
+    PCBC_CE_FLAGS_FINAL(pcbc_n1ql_query_stream_ce);
+    PCBC_CE_DISABLE_SERIALIZATION(pcbc_n1ql_query_stream_ce);
+    zend_class_implements(pcbc_n1ql_query_stream_ce TSRMLS_CC, 1, zend_ce_iterator);
+
+    memcpy(&pcbc_n1ql_query_stream_handlers, zend_get_std_object_handlers(), sizeof(zend_object_handlers));
+    pcbc_n1ql_query_stream_handlers.get_debug_info = n1ql_query_stream_get_debug_info;
+#if PHP_VERSION_ID >= 70000
+    pcbc_n1ql_query_stream_handlers.free_obj = n1ql_query_stream_free_object;
+    pcbc_n1ql_query_stream_handlers.offset = XtOffsetOf(pcbc_n1ql_query_stream_t, std);
+#endif
+    return SUCCESS;
+}
@@ -16,8 +16,28 @@
 
 #include "couchbase.h"
 #include <ext/standard/url.h>
+#include <ext/standard/md5.h>
+#include <ext/standard/flock_compat.h>
+#include <fcntl.h>
+#ifdef PHP_WIN32
+#include "win32/time.h"
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+/* maximum number of entries in couchbase.pool.prewarm */
+#define PCBC_POOL_PREWARM_MAX 32
+/* maximum number of memoized connection strings, the table is cleared when it is full */
+#define PCBC_CONNSTR_MEMO_MAX 256
+/* how long to wait for the process refreshing the config cache, before bootstrapping from the network */
+#define PCBC_CONFIG_CACHE_LOCK_ATTEMPTS 50
+#define PCBC_CONFIG_CACHE_LOCK_DELAY_US 20000
+/* returned by pcbc_config_cache_lock(), when the lock is held by someone else for too long */
+#define PCBC_CONFIG_CACHE_BUSY -2
 
 static int pcbc_res_couchbase;
+zend_class_entry *pcbc_pool_ce;
 
 extern struct pcbc_logger_st pcbc_logger;
 #define LOGARGS(conn, lvl) LCB_LOG_##lvl, conn, "pcbc/pool", __FILE__, __LINE__
@@ -34,17 +54,300 @@ void subdoc_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb);
 void http_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb);
 void durability_callback(lcb_t instance, const void *cookie, lcb_error_t error, const lcb_durability_resp_t *resp);
 
-static lcb_error_t pcbc_establish_connection(lcb_type_t type, lcb_t *result, const char *connstr,
-                                             lcb_AUTHENTICATOR *auth, char *auth_hash TSRMLS_DC)
+static lcb_RESPCALLBACK pcbc_callbacks[LCB_CALLBACK__MAX];
+static void pcbc_connection_discard(pcbc_connection_t *conn TSRMLS_DC);
+
+static pcbc_op_type_t pcbc_callback_op(int cbtype)
+{
+    switch (cbtype) {
+    case LCB_CALLBACK_GET:
+        return PCBC_OP_GET;
+    case LCB_CALLBACK_GETREPLICA:
+        return PCBC_OP_GET_REPLICA;
+    case LCB_CALLBACK_UNLOCK:
+        return PCBC_OP_UNLOCK;
+    case LCB_CALLBACK_REMOVE:
+        return PCBC_OP_REMOVE;
+    case LCB_CALLBACK_TOUCH:
+        return PCBC_OP_TOUCH;
+    case LCB_CALLBACK_COUNTER:
+        return PCBC_OP_COUNTER;
+    case LCB_CALLBACK_SDLOOKUP:
+        return PCBC_OP_LOOKUP_IN;
+    case LCB_CALLBACK_SDMUTATE:
+        return PCBC_OP_MUTATE_IN;
+    case LCB_CALLBACK_HTTP:
+        return PCBC_OP_HTTP;
+    default:
+        return PCBC_OP_STORE;
+    }
+}
+
+/* accounts the response in the statistics of the pooled connection, and passes it to the handler of the operation.
+ * All operations with dispatched callbacks use opcookie */
+static void pcbc_dispatch_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    pcbc_connection_t *conn = (pcbc_connection_t *)lcb_get_cookie(instance);
+    opcookie *cookie = (opcookie *)rb->cookie;
+
+    if (cookie && cookie->orphaned) {
+        // the owner of the cookie has been freed, so nobody will read the response
+        if (--cookie->orphaned == 0) {
+            opcookie_destroy(cookie);
+            if (conn) {
+                conn->orphans--;
+            }
+        }
+        return;
+    }
+    if (conn) {
+        conn->nops++;
+        pcbc_metrics_service(instance, cookie, pcbc_callback_op(cbtype));
+    }
+    if (cookie) {
+        // the first key identifies the operation in the report of the slow operations
+        if (cookie->trace_id == NULL && rb->nkey > 0 && cbtype != LCB_CALLBACK_HTTP) {
+            cookie->trace_id = opcookie_strndup(cookie, rb->key, rb->nkey);
+            cookie->trace_id_len = rb->nkey;
+        }
+        if (cbtype == LCB_CALLBACK_GET || cbtype == LCB_CALLBACK_GETREPLICA) {
+            cookie->payload += ((const lcb_RESPGET *)rb)->nvalue;
+        } else if (cbtype == LCB_CALLBACK_HTTP) {
+            cookie->payload += ((const lcb_RESPHTTP *)rb)->nbody;
+        }
+    }
+    pcbc_callbacks[cbtype](instance, cbtype, rb);
+}
+
+static void pcbc_install_callback(lcb_t instance, int cbtype, lcb_RESPCALLBACK callback)
+{
+    pcbc_callbacks[cbtype] = callback;
+    lcb_install_callback3(instance, cbtype, pcbc_dispatch_callback);
+}
+
+static double pcbc_elapsed_ms(struct timeval *start)
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return (now.tv_sec - start->tv_sec) * 1000.0 + (now.tv_usec - start->tv_usec) / 1000.0;
+}
+
+#if PHP_VERSION_ID >= 70000
+typedef zend_stat_t pcbc_stat_t;
+#else
+typedef struct stat pcbc_stat_t;
+#endif
+
+static zend_bool pcbc_config_cache_is_fresh(const char *path TSRMLS_DC)
+{
+    pcbc_stat_t st;
+
+    if (VCWD_STAT(path, &st) != 0 || st.st_size == 0) {
+        return 0;
+    }
+    return PCBCG(pool_config_cache_ttl) == 0 || time(NULL) - st.st_mtime < PCBCG(pool_config_cache_ttl);
+}
+
+/* acquires the exclusive lock of the config cache, and returns it as the file descriptor, or -1 if the file has been
+ * refreshed while waiting, or the lock cannot be used at all.
+ *
+ * The lock is never waited for without limit: flock() locks belong to the open file description, so the lock held by
+ * another bootstrap of the same process would never be released while we are waiting. When the holder does not finish
+ * in time, PCBC_CONFIG_CACHE_BUSY is returned, and the caller should bootstrap from the network */
+static int pcbc_config_cache_lock(lcb_t conn, const char *cache_path TSRMLS_DC)
+{
+    char *lock_path = NULL;
+    int fd, attempt;
+
+    spprintf(&lock_path, 0, "%s.lock", cache_path);
+    fd = VCWD_OPEN_MODE(lock_path, O_CREAT | O_RDWR, 0600);
+    if (fd < 0) {
+        pcbc_log(LOGARGS(conn, WARN), "Unable to open config cache lock \"%s\": %s", lock_path, strerror(errno));
+        efree(lock_path);
+        return -1;
+    }
+    for (attempt = 0; attempt < PCBC_CONFIG_CACHE_LOCK_ATTEMPTS; attempt++) {
+        if (php_flock(fd, LOCK_EX | LOCK_NB) == 0) {
+            efree(lock_path);
+            if (pcbc_config_cache_is_fresh(cache_path TSRMLS_CC)) {
+                // another process has refreshed the file while we were waiting for the lock
+                php_flock(fd, LOCK_UN);
+                close(fd);
+                return -1;
+            }
+            return fd;
+        }
+        if (pcbc_config_cache_is_fresh(cache_path TSRMLS_CC)) {
+            efree(lock_path);
+            close(fd);
+            return -1;
+        }
+        usleep(PCBC_CONFIG_CACHE_LOCK_DELAY_US);
+    }
+    pcbc_log(LOGARGS(conn, WARN), "Config cache \"%s\" is locked for more than %d ms, bootstrapping from the network",
+             lock_path, PCBC_CONFIG_CACHE_LOCK_ATTEMPTS * PCBC_CONFIG_CACHE_LOCK_DELAY_US / 1000);
+    efree(lock_path);
+    close(fd);
+    return PCBC_CONFIG_CACHE_BUSY;
+}
+
+/* points the instance to the cluster map file shared by all processes, which is named after the pool key.
+ *
+ * When the file is missing or stale, the exclusive lock is acquired, and returned as the file descriptor, so that only
+ * one process fetches the configuration from the network and writes the file. The others will wait for the lock, and
+ * bootstrap from the fresh file, or from the network if the lock is not released in time. The lock has to be released
+ * by pcbc_finish_connection() */
+static int pcbc_config_cache_attach(lcb_t conn, lcb_type_t type, smart_str *plist_key TSRMLS_DC)
+{
+    PHP_MD5_CTX md5;
+    unsigned char digest[16];
+    char hash[33];
+    char *cache_path = NULL;
+    lcb_error_t err;
+    int fd = -1;
+
+    if (type != LCB_TYPE_BUCKET || PCBCG(pool_config_cache) == NULL || PCBCG(pool_config_cache)[0] == '\0') {
+        return -1;
+    }
+    // the key contains only hash of the credentials, but the file name should not reveal the connection string either
+    PHP_MD5Init(&md5);
+    PHP_MD5Update(&md5, PCBC_SMARTSTR_VAL(*plist_key), PCBC_SMARTSTR_LEN(*plist_key));
+    PHP_MD5Final(digest, &md5);
+    make_digest(hash, digest);
+    spprintf(&cache_path, 0, "%s%cpcbc-%s.cache", PCBCG(pool_config_cache), DEFAULT_SLASH, hash);
+
+    if (!pcbc_config_cache_is_fresh(cache_path TSRMLS_CC)) {
+        fd = pcbc_config_cache_lock(conn, cache_path TSRMLS_CC);
+        if (fd == PCBC_CONFIG_CACHE_BUSY) {
+            // the holder of the lock is going to rewrite the file, so it is not used by this instance at all
+            efree(cache_path);
+            return -1;
+        }
+        if (fd >= 0) {
+            // the library would load stale map, and only refresh it after the first failure
+            VCWD_UNLINK(cache_path);
+        }
+    }
+
+    err = lcb_cntl(conn, LCB_CNTL_SET, LCB_CNTL_CONFIGCACHE, cache_path);
+    if (err != LCB_SUCCESS) {
+        pcbc_log(LOGARGS(conn, WARN), "Failed to configure config cache \"%s\": %s", cache_path,
+                 pcbc_lcb_strerror(err));
+    } else {
+        pcbc_log(LOGARGS(conn, DEBUG), "Using config cache \"%s\"", cache_path);
+    }
+    efree(cache_path);
+    return fd;
+}
+
+static void pcbc_config_cache_release(int fd)
+{
+    if (fd >= 0) {
+        php_flock(fd, LOCK_UN);
+        close(fd);
+    }
+}
+
+/* name of the wire compression mode the connection is using, in the terms of couchbase.network.compression */
+static const char *pcbc_compression_name(lcb_t conn)
+{
+    int opts = LCB_COMPRESS_NONE;
+
+    if (conn == NULL || lcb_cntl(conn, LCB_CNTL_GET, LCB_CNTL_COMPRESSION_OPTS, &opts) != LCB_SUCCESS) {
+        return "unknown";
+    }
+    if (opts & LCB_COMPRESS_FORCE) {
+        return "force";
+    }
+    switch (opts & LCB_COMPRESS_INOUT) {
+    case LCB_COMPRESS_INOUT:
+        return "on";
+    case LCB_COMPRESS_IN:
+        return "inflate_only";
+    case LCB_COMPRESS_OUT:
+        return "deflate_only";
+    default:
+        return "off";
+    }
+}
+
+/* applies the defaults of the wire compression from INI, unless they are set in the connection string of the bucket.
+ *
+ * The library compresses values with Snappy only after the server has agreed on it in HELLO, and marks them with the
+ * datatype bit, so the documents stay JSON for N1QL, views and FTS, unlike the private compression of the encoder */
+static lcb_error_t pcbc_configure_compression(lcb_t conn, const char *connstr TSRMLS_DC)
+{
+    lcb_error_t err;
+
+    if (PCBCG(net_cmpr_i) >= 0 && strstr(connstr, "compression=") == NULL) {
+        int opts = PCBCG(net_cmpr_i);
+
+        err = lcb_cntl(conn, LCB_CNTL_SET, LCB_CNTL_COMPRESSION_OPTS, &opts);
+        if (err != LCB_SUCCESS) {
+            pcbc_log(LOGARGS(conn, ERROR), "Failed to configure compression: %s", pcbc_lcb_strerror(err));
+            return err;
+        }
+    }
+#ifdef LCB_CNTL_COMPRESSION_MIN_SIZE
+    if (PCBCG(net_cmpr_min_size) > 0 && strstr(connstr, "compression_min_size=") == NULL) {
+        lcb_U32 min_size = PCBCG(net_cmpr_min_size);
+
+        err = lcb_cntl(conn, LCB_CNTL_SET, LCB_CNTL_COMPRESSION_MIN_SIZE, &min_size);
+        if (err != LCB_SUCCESS) {
+            pcbc_log(LOGARGS(conn, ERROR), "Failed to configure compression threshold: %s", pcbc_lcb_strerror(err));
+            return err;
+        }
+    }
+    if (PCBCG(net_cmpr_min_ratio) > 0 && strstr(connstr, "compression_min_ratio=") == NULL) {
+        float min_ratio = (float)PCBCG(net_cmpr_min_ratio);
+
+        err = lcb_cntl(conn, LCB_CNTL_SET, LCB_CNTL_COMPRESSION_MIN_RATIO, &min_ratio);
+        if (err != LCB_SUCCESS) {
+            pcbc_log(LOGARGS(conn, ERROR), "Failed to configure compression ratio: %s", pcbc_lcb_strerror(err));
+            return err;
+        }
+    }
+#else
+    if (PCBCG(net_cmpr_min_size) > 0 || PCBCG(net_cmpr_min_ratio) > 0) {
+        pcbc_log(LOGARGS(conn, WARN), "Compression threshold and ratio require libcouchbase 2.9.0 or later");
+    }
+#endif
+    return LCB_SUCCESS;
+}
+
+/* receives responses of the health checks, see pcbc_connection_is_healthy() */
+static void pcbc_noop_callback(lcb_t instance, int cbtype, const lcb_RESPBASE *rb)
+{
+    lcb_error_t *err = (lcb_error_t *)rb->cookie;
+
+    if (rb->rc != LCB_SUCCESS && *err == LCB_SUCCESS) {
+        *err = rb->rc;
+    }
+}
+
+/* creates instance and starts bootstrap, which has to be completed by pcbc_finish_connection() */
+static lcb_error_t pcbc_start_connection(lcb_type_t type, lcb_t *result, const char *connstr, lcb_AUTHENTICATOR *auth,
+                                         char *auth_hash, smart_str *plist_key, int *cache_lock TSRMLS_DC)
 {
     struct lcb_create_st create_options;
     lcb_error_t err;
     lcb_t conn;
 
+    *cache_lock = -1;
+    if (PCBCG(io) == NULL) {
+        err = pcbc_io_create(&PCBCG(io) TSRMLS_CC);
+        if (err != LCB_SUCCESS) {
+            pcbc_log(LOGARGS(NULL, ERROR), "Failed to initialize LCB IO plugin: %s", pcbc_lcb_strerror(err));
+            PCBCG(io) = NULL;
+            return err;
+        }
+    }
     memset(&create_options, 0, sizeof(create_options));
     create_options.version = 3;
     create_options.v.v3.connstr = connstr;
     create_options.v.v3.type = type;
+    create_options.v.v3.io = PCBCG(io);
     err = lcb_create(&conn, &create_options);
     if (err != LCB_SUCCESS) {
         pcbc_log(LOGARGS(NULL, ERROR), "Failed to initialize LCB connection: %s", pcbc_lcb_strerror(err));
@@ -66,6 +369,11 @@ static lcb_error_t pcbc_establish_connection(lcb_type_t type, lcb_t *result, con
         lcb_destroy(conn);
         return err;
     }
+    err = pcbc_configure_compression(conn, connstr TSRMLS_CC);
+    if (err != LCB_SUCCESS) {
+        lcb_destroy(conn);
+        return err;
+    }
 
 #if LCB_VERSION == 0x020800
     // versions higher than 2.8.0 will have error maps enabled by default
@@ -80,37 +388,72 @@ static lcb_error_t pcbc_establish_connection(lcb_type_t type, lcb_t *result, con
     }
 #endif
 
-    lcb_install_callback3(conn, LCB_CALLBACK_GET, get_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_GETREPLICA, get_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_STORE, store_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_STOREDUR, store_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_UNLOCK, unlock_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_REMOVE, remove_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_TOUCH, touch_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_COUNTER, counter_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_SDLOOKUP, subdoc_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_SDMUTATE, subdoc_callback);
-    lcb_install_callback3(conn, LCB_CALLBACK_HTTP, http_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_GET, get_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_GETREPLICA, get_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_STORE, store_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_STOREDUR, store_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_UNLOCK, unlock_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_REMOVE, remove_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_TOUCH, touch_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_COUNTER, counter_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_SDLOOKUP, subdoc_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_SDMUTATE, subdoc_callback);
+    pcbc_install_callback(conn, LCB_CALLBACK_HTTP, http_callback);
+    // installed directly, so that health checks are not accounted as operations
+    lcb_install_callback3(conn, LCB_CALLBACK_NOOP, pcbc_noop_callback);
 
+    *cache_lock = pcbc_config_cache_attach(conn, type, plist_key TSRMLS_CC);
     err = lcb_connect(conn);
     if (err != LCB_SUCCESS) {
         pcbc_log(LOGARGS(conn, ERROR), "Failed to connect LCB connection: %s", pcbc_lcb_strerror(err));
+        pcbc_config_cache_release(*cache_lock);
+        *cache_lock = -1;
         lcb_destroy(conn);
         return err;
     }
+
+    *result = conn;
+    return LCB_SUCCESS;
+}
+
+/* waits for the bootstrap, and destroys the instance on failure */
+static lcb_error_t pcbc_finish_connection(lcb_t conn, int cache_lock TSRMLS_DC)
+{
+    lcb_error_t err;
+    int loaded = 0;
+
     // We use lcb_wait here as no callbacks are invoked by connect.
     lcb_wait(conn);
+    // the library has written the cluster map by now, so the waiting processes could use it
+    pcbc_config_cache_release(cache_lock);
     err = lcb_get_bootstrap_status(conn);
     if (err != LCB_SUCCESS) {
         pcbc_log(LOGARGS(conn, ERROR), "Failed to bootstrap LCB connection: %s", pcbc_lcb_strerror(err));
         lcb_destroy(conn);
         return err;
     }
-
-    *result = conn;
+    if (lcb_cntl(conn, LCB_CNTL_GET, LCB_CNTL_CONFIG_CACHE_LOADED, &loaded) == LCB_SUCCESS && loaded) {
+        PCBCG(pool_config_cache_hits)++;
+        pcbc_log(LOGARGS(conn, DEBUG), "Bootstrapped from config cache");
+    } else {
+        PCBCG(pool_network_bootstraps)++;
+    }
     return LCB_SUCCESS;
 }
 
+static lcb_error_t pcbc_establish_connection(lcb_type_t type, lcb_t *result, const char *connstr,
+                                             lcb_AUTHENTICATOR *auth, char *auth_hash, smart_str *plist_key TSRMLS_DC)
+{
+    lcb_error_t err;
+    int cache_lock = -1;
+
+    err = pcbc_start_connection(type, result, connstr, auth, auth_hash, plist_key, &cache_lock TSRMLS_CC);
+    if (err != LCB_SUCCESS) {
+        return err;
+    }
+    return pcbc_finish_connection(*result, cache_lock TSRMLS_CC);
+}
+
 static lcb_error_t pcbc_normalize_connstr(lcb_type_t type, char *connstr, const char *bucketname,
                                           char **normalized TSRMLS_DC)
 {
@@ -209,6 +552,79 @@ static lcb_error_t pcbc_normalize_connstr(lcb_type_t type, char *connstr, const
     return LCB_SUCCESS;
 }
 
+#if PHP_VERSION_ID >= 70000
+static void pcbc_connstr_memo_dtor(zval *el)
+{
+    pefree(Z_PTR_P(el), 1);
+}
+#else
+static void pcbc_connstr_memo_dtor(void *el)
+{
+    pefree(*(char **)el, 1);
+}
+#endif
+
+void pcbc_connstr_memo_destroy(HashTable *memo)
+{
+    if (memo) {
+        zend_hash_destroy(memo);
+        pefree(memo, 1);
+    }
+}
+
+/* same as pcbc_normalize_connstr(), but remembers the result, because applications usually open the same buckets
+ * on every request, and parsing the URL costs more than the pool lookup itself */
+static lcb_error_t pcbc_normalize_connstr_memo(lcb_type_t type, const char *connstr, const char *bucketname,
+                                               char **normalized TSRMLS_DC)
+{
+    smart_str key = {0};
+    char *found = NULL;
+    lcb_error_t err;
+
+    if (PCBCG(connstr_memo) == NULL) {
+        PCBCG(connstr_memo) = pemalloc(sizeof(HashTable), 1);
+        zend_hash_init(PCBCG(connstr_memo), 16, NULL, pcbc_connstr_memo_dtor, 1);
+    }
+    smart_str_append_long(&key, type);
+    smart_str_appendc(&key, '|');
+    smart_str_appends(&key, connstr);
+    if (bucketname) {
+        smart_str_appendc(&key, '|');
+        smart_str_appends(&key, bucketname);
+    }
+    smart_str_0(&key);
+#if PHP_VERSION_ID >= 70000
+    found = zend_hash_str_find_ptr(PCBCG(connstr_memo), PCBC_SMARTSTR_VAL(key), PCBC_SMARTSTR_LEN(key));
+#else
+    {
+        char **ptr = NULL;
+        if (zend_hash_find(PCBCG(connstr_memo), key.c, key.len, (void **)&ptr) == SUCCESS) {
+            found = *ptr;
+        }
+    }
+#endif
+    if (found) {
+        smart_str_free(&key);
+        *normalized = estrdup(found);
+        return LCB_SUCCESS;
+    }
+
+    err = pcbc_normalize_connstr(type, (char *)connstr, bucketname, normalized TSRMLS_CC);
+    if (err == LCB_SUCCESS) {
+        char *dup = pestrdup(*normalized, 1);
+        if (zend_hash_num_elements(PCBCG(connstr_memo)) >= PCBC_CONNSTR_MEMO_MAX) {
+            zend_hash_clean(PCBCG(connstr_memo));
+        }
+#if PHP_VERSION_ID >= 70000
+        zend_hash_str_update_ptr(PCBCG(connstr_memo), PCBC_SMARTSTR_VAL(key), PCBC_SMARTSTR_LEN(key), dup);
+#else
+        zend_hash_update(PCBCG(connstr_memo), key.c, key.len, (void *)&dup, sizeof(char *), NULL);
+#endif
+    }
+    smart_str_free(&key);
+    return err;
+}
+
 void pcbc_connection_addref(pcbc_connection_t *conn TSRMLS_DC)
 {
     if (conn) {
@@ -226,10 +642,32 @@ void pcbc_connection_delref(pcbc_connection_t *conn TSRMLS_DC)
                  conn->connstr, conn->bucketname, conn->auth_hash, conn->lcb, conn->refs);
         if (conn->refs == 0) {
             conn->idle_at = time(NULL);
+            if (conn->orphans > 0) {
+                // the instance still refers to the cookies, which will be freed at the end of the request
+                pcbc_log(LOGARGS(conn->lcb, WARN), "Discarding connection with %d abandoned operations",
+                         conn->orphans);
+                pcbc_connection_discard(conn TSRMLS_CC);
+            }
         }
     }
 }
 
+/* detaches the cookie with pending responses from its freed owner. The responses are dropped without running the
+ * event loop or any user code, and the cookie is destroyed with the last of them */
+void pcbc_connection_orphan(pcbc_connection_t *conn, void *cookie, int pending TSRMLS_DC)
+{
+    opcookie *orphan = cookie;
+
+    // the total latency would include the lifetime of the owner
+    orphan->metrics = NULL;
+    if (pending <= 0) {
+        opcookie_destroy(orphan);
+        return;
+    }
+    orphan->orphaned = pending;
+    conn->orphans++;
+}
+
 #if PHP_VERSION_ID >= 70000
 static pcbc_connection_t *pcbc_connection_lookup(smart_str *plist_key TSRMLS_DC)
 {
@@ -258,6 +696,12 @@ static lcb_error_t pcbc_connection_cache(smart_str *plist_key, pcbc_connection_t
              conn->connstr, conn->bucketname, conn->auth_hash, conn->lcb, conn->refs);
     return LCB_SUCCESS;
 }
+
+/* removes the connection from the persistent list, which destroys it */
+static void pcbc_connection_forget(smart_str *plist_key TSRMLS_DC)
+{
+    zend_hash_str_del(&EG(persistent_list), PCBC_SMARTSTR_VAL(*plist_key), PCBC_SMARTSTR_LEN(*plist_key));
+}
 #else
 static pcbc_connection_t *pcbc_connection_lookup(smart_str *plist_key TSRMLS_DC)
 {
@@ -286,6 +730,11 @@ static lcb_error_t pcbc_connection_cache(smart_str *plist_key, pcbc_connection_t
     }
     return LCB_SUCCESS;
 }
+
+static void pcbc_connection_forget(smart_str *plist_key TSRMLS_DC)
+{
+    zend_hash_del(&EG(persistent_list), plist_key->c, plist_key->len);
+}
 #endif
 
 static void pcbc_destroy_connection_resource(
@@ -317,33 +766,192 @@ static void pcbc_destroy_connection_resource(
     }
 }
 
+static int pcbc_discard_connection_resource(
+#if PHP_VERSION_ID >= 70000
+    zval *el, void *arg
+#else
+    zend_rsrc_list_entry *res, void *arg TSRMLS_DC
+#endif
+    )
+{
+#if PHP_VERSION_ID >= 70000
+    zend_resource *res = Z_RES_P(el);
+
+    if (res->type != pcbc_res_couchbase) {
+        return ZEND_HASH_APPLY_KEEP;
+    }
+#else
+    if (Z_TYPE_P(res) != pcbc_res_couchbase) {
+        return ZEND_HASH_APPLY_KEEP;
+    }
+#endif
+    if (res->ptr == arg) {
+        // like the idle connections, the entry is left without the connection, and replaced by the next one
+        pcbc_destroy_connection_resource(res);
+        return ZEND_HASH_APPLY_STOP;
+    }
+    return ZEND_HASH_APPLY_KEEP;
+}
+
+/* destroys the instance right away, instead of keeping it in the pool */
+static void pcbc_connection_discard(pcbc_connection_t *conn TSRMLS_DC)
+{
+    zend_hash_apply_with_argument(&EG(persistent_list), (apply_func_arg_t)pcbc_discard_connection_resource,
+                                  conn TSRMLS_CC);
+}
+
+static void pcbc_connection_key(smart_str *plist_key, lcb_type_t type, const char *cstr, const char *auth_hash)
+{
+    smart_str_append_long(plist_key, type);
+    smart_str_appendc(plist_key, '|');
+    smart_str_appends(plist_key, cstr);
+    smart_str_appendc(plist_key, '|');
+    smart_str_appends(plist_key, auth_hash);
+}
+
+/* wraps bootstrapped instance, and registers it in the persistent list */
+static lcb_error_t pcbc_connection_register(pcbc_connection_t **result, lcb_t lcb, lcb_type_t type, const char *cstr,
+                                            const char *auth_hash, double bootstrap_ms, smart_str *plist_key TSRMLS_DC)
+{
+    pcbc_connection_t *conn;
+    zend_bool is_persistent = 1; // always persistent connections
+
+    conn = pemalloc(sizeof(pcbc_connection_t), is_persistent);
+    conn->refs = 1;
+    conn->idle_at = 0;
+    conn->created_at = time(NULL);
+    conn->bootstrap_ms = bootstrap_ms;
+    conn->nhits = 0;
+    conn->nops = 0;
+    conn->orphans = 0;
+    conn->type = type;
+    conn->connstr = pestrdup(cstr, is_persistent);
+    conn->bucketname = NULL;
+    conn->auth_hash = pestrdup(auth_hash, is_persistent);
+    if (type == LCB_TYPE_BUCKET) {
+        char *tmp;
+        lcb_cntl(lcb, LCB_CNTL_GET, LCB_CNTL_BUCKETNAME, &tmp);
+        if (tmp) {
+            conn->bucketname = pestrdup(tmp, is_persistent);
+        }
+    }
+    conn->lcb = lcb;
+    conn->metrics = pcbc_metrics_get(conn->bucketname TSRMLS_CC);
+    lcb_set_cookie(lcb, conn);
+    *result = conn;
+    return pcbc_connection_cache(plist_key, conn TSRMLS_CC);
+}
+
+/* sends NOOP to every data node of the idle connection, to detect broken connection before handing it to the caller */
+static zend_bool pcbc_connection_is_healthy(pcbc_connection_t *conn TSRMLS_DC)
+{
+    lcb_CMDNOOP cmd = {0};
+    lcb_error_t err, status = LCB_SUCCESS;
+    lcb_U32 op_timeout = 0, check_timeout;
+
+    if (conn->type != LCB_TYPE_BUCKET || PCBCG(pool_health_check_idle) == 0 || conn->idle_at == 0 ||
+        time(NULL) - conn->idle_at < PCBCG(pool_health_check_idle)) {
+        return 1;
+    }
+    // dead node should not stall the request for the whole operation timeout, so the check has its own timeout
+    if (PCBCG(pool_health_check_timeout) > 0 &&
+        lcb_cntl(conn->lcb, LCB_CNTL_GET, LCB_CNTL_OP_TIMEOUT, &op_timeout) == LCB_SUCCESS) {
+        check_timeout = (lcb_U32)PCBCG(pool_health_check_timeout) * 1000;
+        if (check_timeout < op_timeout) {
+            lcb_cntl(conn->lcb, LCB_CNTL_SET, LCB_CNTL_OP_TIMEOUT, &check_timeout);
+        } else {
+            op_timeout = 0;
+        }
+    }
+    lcb_sched_enter(conn->lcb);
+    err = lcb_noop3(conn->lcb, &status, &cmd);
+    if (err != LCB_SUCCESS) {
+        lcb_sched_fail(conn->lcb);
+        status = err;
+    } else {
+        lcb_sched_leave(conn->lcb);
+        lcb_wait(conn->lcb);
+    }
+    if (op_timeout > 0) {
+        lcb_cntl(conn->lcb, LCB_CNTL_SET, LCB_CNTL_OP_TIMEOUT, &op_timeout);
+    }
+    if (status != LCB_SUCCESS) {
+        pcbc_log(LOGARGS(conn->lcb, WARN), "Health check of idle connection to \"%s\" failed, reconnecting: %s",
+                 conn->connstr, pcbc_lcb_strerror(status));
+        return 0;
+    }
+    return 1;
+}
+
+/* builds key of the pool slot, the first slot uses the key itself */
+static void pcbc_connection_slot_key(smart_str *slot_key, smart_str *plist_key, long slot)
+{
+    smart_str_appendl(slot_key, PCBC_SMARTSTR_VAL(*plist_key), PCBC_SMARTSTR_LEN(*plist_key));
+    if (slot > 0) {
+        smart_str_appendc(slot_key, '#');
+        smart_str_append_long(slot_key, slot);
+    }
+    smart_str_0(slot_key);
+}
+
 lcb_error_t pcbc_connection_get(pcbc_connection_t **result, lcb_type_t type, const char *connstr,
                                 const char *bucketname, lcb_AUTHENTICATOR *auth, char *auth_hash TSRMLS_DC)
 {
     char *cstr = NULL;
     lcb_error_t rv;
     lcb_t lcb;
-    pcbc_connection_t *conn = NULL;
+    pcbc_connection_t *conn = NULL, *least_used = NULL;
     smart_str plist_key = {0};
-    zend_bool is_persistent = 1; // always persistent connections
+    long slot, free_slot = -1, max_instances = PCBCG(pool_max_instances);
+    struct timeval start;
 
-    rv = pcbc_normalize_connstr(type, (char *)connstr, bucketname, &cstr TSRMLS_CC);
+    rv = pcbc_normalize_connstr_memo(type, connstr, bucketname, &cstr TSRMLS_CC);
     if (rv != LCB_SUCCESS) {
         pcbc_log(LOGARGS(NULL, ERROR), "Failed to normalize connection string: %s", connstr);
+        lcbauth_unref(auth);
         return rv;
     }
 
-    smart_str_append_long(&plist_key, type);
-    smart_str_appendc(&plist_key, '|');
-    smart_str_appends(&plist_key, cstr);
-    smart_str_appendc(&plist_key, '|');
-    smart_str_appends(&plist_key, auth_hash);
+    pcbc_connection_key(&plist_key, type, cstr, auth_hash);
+    if (max_instances < 1) {
+        max_instances = 1;
+    }
+    // check out the idle instance if any, otherwise open new one in the free slot, and only when the limit is reached,
+    // share the least used instance
+    for (slot = 0; slot < max_instances; ++slot) {
+        smart_str slot_key = {0};
+        pcbc_connection_t *candidate;
 
-    conn = pcbc_connection_lookup(&plist_key TSRMLS_CC);
+        pcbc_connection_slot_key(&slot_key, &plist_key, slot);
+        candidate = pcbc_connection_lookup(&slot_key TSRMLS_CC);
+        if (candidate && candidate->refs == 0 && !pcbc_connection_is_healthy(candidate TSRMLS_CC)) {
+            pcbc_connection_forget(&slot_key TSRMLS_CC);
+            PCBCG(pool_reconnects)++;
+            candidate = NULL;
+        }
+        smart_str_free(&slot_key);
+        if (candidate == NULL) {
+            if (free_slot < 0) {
+                free_slot = slot;
+            }
+        } else if (candidate->refs == 0) {
+            conn = candidate;
+            break;
+        } else if (least_used == NULL || candidate->refs < least_used->refs) {
+            least_used = candidate;
+        }
+    }
+    if (conn == NULL && free_slot < 0) {
+        conn = least_used;
+    }
     if (conn) {
         efree(cstr);
         smart_str_free(&plist_key);
+        // the authenticator is only needed to establish new connection
+        lcbauth_unref(auth);
         pcbc_connection_addref(conn TSRMLS_CC);
+        conn->nhits++;
+        PCBCG(pool_hits)++;
         pcbc_log(LOGARGS(conn->lcb, DEBUG),
                  "cachehit: type=%d, connstr=%s, bucketname=%s, auth_hash=%s, lcb=%p, refs=%d", conn->type,
                  conn->connstr, conn->bucketname, conn->auth_hash, conn->lcb, conn->refs);
@@ -351,30 +959,18 @@ lcb_error_t pcbc_connection_get(pcbc_connection_t **result, lcb_type_t type, con
         return LCB_SUCCESS;
     }
 
-    rv = pcbc_establish_connection(type, &lcb, cstr, auth, auth_hash TSRMLS_CC);
-    if (rv != LCB_SUCCESS) {
-        efree(cstr);
-        smart_str_free(&plist_key);
-        return rv;
-    }
+    PCBCG(pool_misses)++;
+    gettimeofday(&start, NULL);
+    rv = pcbc_establish_connection(type, &lcb, cstr, auth, auth_hash, &plist_key TSRMLS_CC);
+    if (rv == LCB_SUCCESS) {
+        smart_str slot_key = {0};
 
-    conn = pemalloc(sizeof(pcbc_connection_t), is_persistent);
-    conn->refs = 1;
-    conn->idle_at = 0;
-    conn->type = type;
-    conn->connstr = pestrdup(cstr, is_persistent);
-    efree(cstr);
-    conn->bucketname = NULL;
-    conn->auth_hash = pestrdup(auth_hash, is_persistent);
-    if (type == LCB_TYPE_BUCKET) {
-        char *tmp;
-        lcb_cntl(lcb, LCB_CNTL_GET, LCB_CNTL_BUCKETNAME, &tmp);
-        if (tmp) {
-            conn->bucketname = pestrdup(tmp, is_persistent);
-        }
+        pcbc_connection_slot_key(&slot_key, &plist_key, free_slot);
+        rv = pcbc_connection_register(&conn, lcb, type, cstr, auth_hash, pcbc_elapsed_ms(&start),
+                                      &slot_key TSRMLS_CC);
+        smart_str_free(&slot_key);
     }
-    conn->lcb = lcb;
-    rv = pcbc_connection_cache(&plist_key, conn TSRMLS_CC);
+    efree(cstr);
     smart_str_free(&plist_key);
     if (rv != LCB_SUCCESS) {
         return rv;
@@ -384,6 +980,172 @@ lcb_error_t pcbc_connection_get(pcbc_connection_t **result, lcb_type_t type, con
     return LCB_SUCCESS;
 }
 
+typedef struct {
+    lcb_t lcb;
+    char *cstr;
+    char *auth_hash;
+    smart_str plist_key;
+    int cache_lock;
+} pcbc_prewarm_entry;
+
+/* several entries might resolve to the same pool key, but the connections are registered in the pool only after all
+ * of them have been started, so pcbc_connection_lookup() does not see the duplicates */
+static int pcbc_prewarm_is_started(smart_str *plist_key, pcbc_prewarm_entry *started, int nstarted)
+{
+    int ii;
+
+    for (ii = 0; ii < nstarted; ++ii) {
+        if (PCBC_SMARTSTR_LEN(started[ii].plist_key) == PCBC_SMARTSTR_LEN(*plist_key) &&
+            memcmp(PCBC_SMARTSTR_VAL(started[ii].plist_key), PCBC_SMARTSTR_VAL(*plist_key),
+                   PCBC_SMARTSTR_LEN(*plist_key)) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* parses "couchbase://[user:password@]host[:port]/bucket[?options]", and starts bootstrap of the connection, unless
+ * it is in the pool already, or it is one of the entries started before. Without credentials, the classic
+ * authentication is used, like openBucket() would do without authenticator */
+static lcb_error_t pcbc_prewarm_start(char *spec, pcbc_prewarm_entry *entry, pcbc_prewarm_entry *started,
+                                      int nstarted TSRMLS_DC)
+{
+    php_url *url;
+    lcb_AUTHENTICATOR *auth = NULL;
+    const char *bucketname;
+    smart_str connstr = {0};
+    lcb_error_t err;
+
+    memset(entry, 0, sizeof(pcbc_prewarm_entry));
+    url = php_url_parse(spec);
+    if (!url) {
+        return LCB_EINVAL;
+    }
+    if (url->host == NULL || url->path == NULL || url->path[0] != '/' || url->path[1] == '\0') {
+        php_url_free(url);
+        return LCB_EINVAL;
+    }
+    bucketname = url->path + 1;
+
+    if (url->user) {
+        PCBC_ZVAL authenticator;
+        char *password = "";
+
+        php_raw_url_decode(url->user, strlen(url->user));
+        // the decoder terminates the string in place, so the literal must not be passed to it
+        if (url->pass) {
+            password = url->pass;
+            php_raw_url_decode(password, strlen(password));
+        }
+        PCBC_ZVAL_ALLOC(authenticator);
+        pcbc_password_authenticator_init(PCBC_P(authenticator), url->user, strlen(url->user), password,
+                                         strlen(password) TSRMLS_CC);
+        pcbc_generate_password_lcb_auth(Z_PASSWORD_AUTHENTICATOR_OBJ_P(PCBC_P(authenticator)), &auth,
+                                        LCB_TYPE_BUCKET, bucketname, NULL, &entry->auth_hash TSRMLS_CC);
+        zval_ptr_dtor(&authenticator);
+    } else {
+        pcbc_generate_classic_lcb_auth(NULL, &auth, LCB_TYPE_BUCKET, bucketname, NULL, &entry->auth_hash TSRMLS_CC);
+    }
+
+    // the same connection string as application would pass to Cluster, so that the pool keys match
+    if (url->scheme) {
+        smart_str_appends(&connstr, url->scheme);
+        smart_str_appendl(&connstr, "://", 3);
+    }
+    smart_str_appends(&connstr, url->host);
+    if (url->port) {
+        smart_str_appendc(&connstr, ':');
+        smart_str_append_long(&connstr, (long)url->port);
+    }
+    if (url->query) {
+        smart_str_appendc(&connstr, '?');
+        smart_str_appends(&connstr, url->query);
+    }
+    smart_str_0(&connstr);
+    err = pcbc_normalize_connstr_memo(LCB_TYPE_BUCKET, PCBC_SMARTSTR_VAL(connstr), bucketname, &entry->cstr TSRMLS_CC);
+    smart_str_free(&connstr);
+    php_url_free(url);
+    if (err != LCB_SUCCESS) {
+        lcbauth_unref(auth);
+        efree(entry->auth_hash);
+        return err;
+    }
+
+    pcbc_connection_key(&entry->plist_key, LCB_TYPE_BUCKET, entry->cstr, entry->auth_hash);
+    if (pcbc_connection_lookup(&entry->plist_key TSRMLS_CC) ||
+        pcbc_prewarm_is_started(&entry->plist_key, started, nstarted)) {
+        err = LCB_KEY_EEXISTS;
+    } else {
+        // the authenticator is consumed by the connection
+        err = pcbc_start_connection(LCB_TYPE_BUCKET, &entry->lcb, entry->cstr, auth, entry->auth_hash,
+                                    &entry->plist_key, &entry->cache_lock TSRMLS_CC);
+        auth = NULL;
+    }
+    if (err != LCB_SUCCESS) {
+        if (auth) {
+            lcbauth_unref(auth);
+        }
+        efree(entry->cstr);
+        efree(entry->auth_hash);
+        smart_str_free(&entry->plist_key);
+    }
+    return err;
+}
+
+/* bootstraps connections listed in couchbase.pool.prewarm, and leaves them in the pool as idle */
+void pcbc_connection_prewarm(TSRMLS_D)
+{
+    pcbc_prewarm_entry entries[PCBC_POOL_PREWARM_MAX];
+    int ii, nentries = 0, nspecs = 0, nready = 0;
+    char *list, *spec, *state = NULL;
+    struct timeval start;
+
+    if (PCBCG(pool_prewarm) == NULL || PCBCG(pool_prewarm)[0] == '\0') {
+        return;
+    }
+    gettimeofday(&start, NULL);
+    list = estrdup(PCBCG(pool_prewarm));
+    for (spec = php_strtok_r(list, "; \t\r\n", &state); spec; spec = php_strtok_r(NULL, "; \t\r\n", &state)) {
+        lcb_error_t err;
+
+        if (nentries == PCBC_POOL_PREWARM_MAX) {
+            pcbc_log(LOGARGS(NULL, WARN), "Too many entries in couchbase.pool.prewarm, only first %d are used",
+                     PCBC_POOL_PREWARM_MAX);
+            break;
+        }
+        nspecs++;
+        err = pcbc_prewarm_start(spec, &entries[nentries], entries, nentries TSRMLS_CC);
+        if (err == LCB_SUCCESS) {
+            nentries++;
+        } else if (err != LCB_KEY_EEXISTS) {
+            // the entry is not logged, as it might contain password
+            pcbc_log(LOGARGS(NULL, WARN), "Failed to pre-warm connection #%d from couchbase.pool.prewarm: %s", nspecs,
+                     pcbc_lcb_strerror(err));
+        }
+    }
+    efree(list);
+
+    // all instances share the IO plugin, so the bootstraps progress concurrently while waiting for each of them
+    for (ii = 0; ii < nentries; ++ii) {
+        pcbc_prewarm_entry *entry = &entries[ii];
+        pcbc_connection_t *conn = NULL;
+
+        if (pcbc_finish_connection(entry->lcb, entry->cache_lock TSRMLS_CC) == LCB_SUCCESS &&
+            pcbc_connection_register(&conn, entry->lcb, LCB_TYPE_BUCKET, entry->cstr, entry->auth_hash,
+                                     pcbc_elapsed_ms(&start), &entry->plist_key TSRMLS_CC) == LCB_SUCCESS) {
+            pcbc_log(LOGARGS(entry->lcb, INFO), "Pre-warmed connection to \"%s\" in %.3f ms", entry->cstr,
+                     conn->bootstrap_ms);
+            pcbc_connection_delref(conn TSRMLS_CC);
+            nready++;
+        }
+        efree(entry->cstr);
+        efree(entry->auth_hash);
+        smart_str_free(&entry->plist_key);
+    }
+    pcbc_log(LOGARGS(NULL, INFO), "Pre-warmed %d out of %d connections in %.3f ms", nready, nspecs,
+             pcbc_elapsed_ms(&start));
+}
+
 static int pcbc_destroy_idle_connections(
 #if PHP_VERSION_ID >= 70000
     zval *el
@@ -416,6 +1178,7 @@ static int pcbc_destroy_idle_connections(
         }
         now = time(NULL);
         if ((now - conn->idle_at) > PCBCG(pool_max_idle_time)) {
+            PCBCG(pool_evictions)++;
             pcbc_destroy_connection_resource(res);
         }
     }
@@ -443,9 +1206,106 @@ ZEND_RSRC_DTOR_FUNC(pcbc_connection_dtor)
 #endif
 }
 
+static int pcbc_connection_stats(
+#if PHP_VERSION_ID >= 70000
+    zval *el, void *arg
+#else
+    zend_rsrc_list_entry *res, void *arg TSRMLS_DC
+#endif
+    )
+{
+    zval *connections = arg;
+    pcbc_connection_t *conn;
+    PCBC_ZVAL entry;
+#if PHP_VERSION_ID >= 70000
+    zend_resource *res = Z_RES_P(el);
+
+    if (res->type != pcbc_res_couchbase) {
+        return ZEND_HASH_APPLY_KEEP;
+    }
+#else
+    if (Z_TYPE_P(res) != pcbc_res_couchbase) {
+        return ZEND_HASH_APPLY_KEEP;
+    }
+#endif
+    conn = res->ptr;
+    if (conn == NULL) {
+        return ZEND_HASH_APPLY_KEEP;
+    }
+
+    PCBC_ZVAL_ALLOC(entry);
+    array_init(PCBC_P(entry));
+    ADD_ASSOC_STRING(PCBC_P(entry), "type", conn->type == LCB_TYPE_BUCKET ? "bucket" : "cluster");
+    ADD_ASSOC_STRING(PCBC_P(entry), "connstr", conn->connstr);
+    if (conn->bucketname) {
+        ADD_ASSOC_STRING(PCBC_P(entry), "bucket", conn->bucketname);
+    }
+    ADD_ASSOC_STRING(PCBC_P(entry), "auth_hash", conn->auth_hash);
+    ADD_ASSOC_LONG_EX(PCBC_P(entry), "refs", conn->refs);
+    ADD_ASSOC_LONG_EX(PCBC_P(entry), "created_at", conn->created_at);
+    ADD_ASSOC_LONG_EX(PCBC_P(entry), "idle_at", conn->idle_at);
+    ADD_ASSOC_DOUBLE_EX(PCBC_P(entry), "bootstrap_ms", conn->bootstrap_ms);
+    ADD_ASSOC_LONG_EX(PCBC_P(entry), "hits", conn->nhits);
+    ADD_ASSOC_LONG_EX(PCBC_P(entry), "operations", conn->nops);
+    ADD_ASSOC_STRING(PCBC_P(entry), "compression", pcbc_compression_name(conn->lcb));
+    add_next_index_zval(connections, PCBC_P(entry));
+    return ZEND_HASH_APPLY_KEEP;
+}
+
+/* {{{ proto void Pool::__construct() Should not be called directly */
+PHP_METHOD(Pool, __construct)
+{
+    throw_pcbc_exception("Accessing private constructor.", LCB_EINVAL);
+}
+/* }}} */
+
+/* {{{ proto array Pool::stats()
+   Returns counters of the connection pool of the current process, and the state of every pooled connection */
+PHP_METHOD(Pool, stats)
+{
+    PCBC_ZVAL connections;
+    int rv;
+
+    rv = zend_parse_parameters_none();
+    if (rv == FAILURE) {
+        RETURN_NULL();
+    }
+
+    array_init(return_value);
+    ADD_ASSOC_LONG_EX(return_value, "hits", PCBCG(pool_hits));
+    ADD_ASSOC_LONG_EX(return_value, "misses", PCBCG(pool_misses));
+    ADD_ASSOC_LONG_EX(return_value, "evictions", PCBCG(pool_evictions));
+    ADD_ASSOC_LONG_EX(return_value, "reconnects", PCBCG(pool_reconnects));
+    ADD_ASSOC_LONG_EX(return_value, "config_cache_hits", PCBCG(pool_config_cache_hits));
+    ADD_ASSOC_LONG_EX(return_value, "network_bootstraps", PCBCG(pool_network_bootstraps));
+    PCBC_ZVAL_ALLOC(connections);
+    array_init(PCBC_P(connections));
+    zend_hash_apply_with_argument(&EG(persistent_list), (apply_func_arg_t)pcbc_connection_stats,
+                                  PCBC_P(connections) TSRMLS_CC);
+    ADD_ASSOC_ZVAL_EX(return_value, "connections", PCBC_P(connections));
+} /* }}} */
+
+ZEND_BEGIN_ARG_INFO_EX(ai_Pool_none, 0, 0, 0)
+ZEND_END_ARG_INFO()
+
+// clang-format off
+zend_function_entry pool_methods[] = {
+    PHP_ME(Pool, __construct, ai_Pool_none, ZEND_ACC_PRIVATE | ZEND_ACC_FINAL | ZEND_ACC_CTOR)
+    PHP_ME(Pool, stats, ai_Pool_none, ZEND_ACC_STATIC | ZEND_ACC_PUBLIC | ZEND_ACC_FINAL)
+    PHP_FE_END
+};
+// clang-format on
+
 PHP_MINIT_FUNCTION(CouchbasePool)
 {
+    zend_class_entry ce;
+
     pcbc_res_couchbase =
         zend_register_list_destructors_ex(NULL, pcbc_connection_dtor, "Couchbase persistent connection", module_number);
+
+    INIT_NS_CLASS_ENTRY(ce, "Couchbase", "Pool", pool_methods);
+    pcbc_pool_ce = zend_register_internal_class(&ce TSRMLS_CC);
+    PCBC_CE_FLAGS_FINAL(pcbc_pool_ce);
+    PCBC_CE_DISABLE_SERIALIZATION(pcbc_pool_ce);
     return SUCCESS;
 }
@@ -0,0 +1,314 @@
+/**
+ *     Copyright 2017 Couchbase, Inc.
+ *
+ *   Licensed under the Apache License, Version 2.0 (the "License");
+ *   you may not use this file except in compliance with the License.
+ *   You may obtain a copy of the License at
+ *
+ *       http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *   Unless required by applicable law or agreed to in writing, software
+ *   distributed under the License is distributed on an "AS IS" BASIS,
+ *   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *   See the License for the specific language governing permissions and
+ *   limitations under the License.
+ */
+
+#include "couchbase.h"
+
+#if HAVE_COUCHBASE_ZSTD
+#include <zstd.h>
+#include <errno.h>
+
+#define LOGARGS(lvl) LCB_LOG_##lvl, NULL, "pcbc/zstd", __FILE__, __LINE__
+
+/* 4 bytes for original size and 4 bytes for dictionary id (zero if the value compressed without dictionary) */
+#define PCBC_ZSTD_PREAMBLE_SIZE 8
+#define PCBC_ZSTD_DICTIONARIES_MAX 16
+/* the original size comes from the stored value, so it is checked before allocating the buffer */
+#define PCBC_ZSTD_MAX_SIZE (256 * 1024 * 1024)
+
+typedef struct {
+    unsigned id;
+    ZSTD_DDict *ddict;
+} pcbc_zstd_dict_t;
+
+/* dictionaries are loaded once in MINIT, and shared by all threads in read-only mode */
+static pcbc_zstd_dict_t pcbc_zstd_dicts[PCBC_ZSTD_DICTIONARIES_MAX];
+static int pcbc_zstd_ndicts = 0;
+/* the contents of the encoder dictionary, the digested version depends on compression level, so it is built by
+ * threads on demand */
+static char *pcbc_zstd_cdict_buf = NULL;
+static size_t pcbc_zstd_cdict_len = 0;
+static unsigned pcbc_zstd_cdict_id = 0;
+
+struct pcbc_zstd_ctx {
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    ZSTD_CDict *cdict;
+    int cdict_level;
+};
+
+static char *zstd_read_file(const char *path, size_t *len TSRMLS_DC)
+{
+    FILE *fp;
+    char *buf = NULL;
+    size_t cap = 0, nr;
+
+    fp = VCWD_FOPEN(path, "rb");
+    if (fp == NULL) {
+        return NULL;
+    }
+    *len = 0;
+    do {
+        if (*len == cap) {
+            cap = cap ? cap * 2 : 65536;
+            buf = perealloc(buf, cap, 1);
+        }
+        nr = fread(buf + *len, 1, cap - *len, fp);
+        *len += nr;
+    } while (nr > 0);
+    fclose(fp);
+    return buf;
+}
+
+static void zstd_load_dictionary(const char *path, int encoder TSRMLS_DC)
+{
+    char *buf;
+    size_t len = 0;
+    unsigned id;
+    int ii;
+
+    buf = zstd_read_file(path, &len TSRMLS_CC);
+    if (buf == NULL) {
+        pcbc_log(LOGARGS(ERROR), "Unable to read zstd dictionary \"%s\": %s", path, strerror(errno));
+        return;
+    }
+    id = ZSTD_getDictID_fromDict(buf, len);
+    if (id == 0) {
+        pcbc_log(LOGARGS(ERROR), "File \"%s\" is not a trained zstd dictionary (use \"zstd --train\" to build one)",
+                 path);
+        pefree(buf, 1);
+        return;
+    }
+    for (ii = 0; ii < pcbc_zstd_ndicts; ii++) {
+        if (pcbc_zstd_dicts[ii].id == id) {
+            break;
+        }
+    }
+    if (ii == pcbc_zstd_ndicts) {
+        ZSTD_DDict *ddict;
+
+        if (pcbc_zstd_ndicts == PCBC_ZSTD_DICTIONARIES_MAX) {
+            pcbc_log(LOGARGS(ERROR), "Too many zstd dictionaries, skipping \"%s\" (max %d)", path,
+                     PCBC_ZSTD_DICTIONARIES_MAX);
+            pefree(buf, 1);
+            return;
+        }
+        ddict = ZSTD_createDDict(buf, len);
+        if (ddict == NULL) {
+            pcbc_log(LOGARGS(ERROR), "Unable to load zstd dictionary \"%s\"", path);
+            pefree(buf, 1);
+            return;
+        }
+        pcbc_zstd_dicts[pcbc_zstd_ndicts].id = id;
+        pcbc_zstd_dicts[pcbc_zstd_ndicts].ddict = ddict;
+        pcbc_zstd_ndicts++;
+    }
+    pcbc_log(LOGARGS(INFO), "Loaded zstd dictionary \"%s\", id=%u, size=%d", path, id, (int)len);
+    if (encoder) {
+        pcbc_zstd_cdict_buf = buf;
+        pcbc_zstd_cdict_len = len;
+        pcbc_zstd_cdict_id = id;
+    } else {
+        pefree(buf, 1);
+    }
+}
+
+void pcbc_zstd_init(TSRMLS_D)
+{
+    const char *path = PCBCG(enc_zstd_dictionary);
+    const char *paths = PCBCG(dec_zstd_dictionaries);
+
+    if (path && path[0]) {
+        zstd_load_dictionary(path, 1 TSRMLS_CC);
+    }
+    if (paths && paths[0]) {
+        char *copy, *token, *saveptr = NULL;
+        char sep[2] = {DEFAULT_DIR_SEPARATOR, '\0'};
+
+        copy = pestrdup(paths, 1);
+        for (token = php_strtok_r(copy, sep, &saveptr); token; token = php_strtok_r(NULL, sep, &saveptr)) {
+            zstd_load_dictionary(token, 0 TSRMLS_CC);
+        }
+        pefree(copy, 1);
+    }
+}
+
+void pcbc_zstd_shutdown()
+{
+    int ii;
+
+    for (ii = 0; ii < pcbc_zstd_ndicts; ii++) {
+        ZSTD_freeDDict(pcbc_zstd_dicts[ii].ddict);
+    }
+    pcbc_zstd_ndicts = 0;
+    if (pcbc_zstd_cdict_buf) {
+        pefree(pcbc_zstd_cdict_buf, 1);
+        pcbc_zstd_cdict_buf = NULL;
+    }
+    pcbc_zstd_cdict_len = 0;
+    pcbc_zstd_cdict_id = 0;
+}
+
+unsigned pcbc_zstd_dictionary_id()
+{
+    return pcbc_zstd_cdict_id;
+}
+
+void pcbc_zstd_ctx_destroy(pcbc_zstd_ctx_t *ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    if (ctx->cctx) {
+        ZSTD_freeCCtx(ctx->cctx);
+    }
+    if (ctx->dctx) {
+        ZSTD_freeDCtx(ctx->dctx);
+    }
+    if (ctx->cdict) {
+        ZSTD_freeCDict(ctx->cdict);
+    }
+    pefree(ctx, 1);
+}
+
+/* contexts keep their working memory between the calls, so they are allocated once per thread */
+static pcbc_zstd_ctx_t *zstd_context(TSRMLS_D)
+{
+    pcbc_zstd_ctx_t *ctx = PCBCG(zstd_ctx);
+
+    if (ctx == NULL) {
+        ctx = pecalloc(1, sizeof(pcbc_zstd_ctx_t), 1);
+        ctx->cctx = ZSTD_createCCtx();
+        ctx->dctx = ZSTD_createDCtx();
+        PCBCG(zstd_ctx) = ctx;
+    }
+    return ctx;
+}
+
+int pcbc_zstd_compress(const char *input, size_t input_size, char **output, size_t *output_size TSRMLS_DC)
+{
+    pcbc_zstd_ctx_t *ctx = zstd_context(TSRMLS_C);
+    int level = (int)PCBCG(enc_zstd_level);
+    unsigned dict_id = 0;
+    size_t bound, rv;
+    char *buf;
+
+    if (ctx->cctx == NULL) {
+        pcbc_log(LOGARGS(WARN), "Failed to allocate zstd compression context");
+        return FAILURE;
+    }
+    if (input_size > PCBC_ZSTD_MAX_SIZE) {
+        pcbc_log(LOGARGS(WARN), "Value is too large to compress with zstd: %lu bytes", (unsigned long)input_size);
+        return FAILURE;
+    }
+    if (pcbc_zstd_cdict_buf) {
+        if (ctx->cdict == NULL || ctx->cdict_level != level) {
+            if (ctx->cdict) {
+                ZSTD_freeCDict(ctx->cdict);
+            }
+            ctx->cdict = ZSTD_createCDict(pcbc_zstd_cdict_buf, pcbc_zstd_cdict_len, level);
+            ctx->cdict_level = level;
+        }
+        if (ctx->cdict) {
+            dict_id = pcbc_zstd_cdict_id;
+        }
+    }
+
+    bound = ZSTD_compressBound(input_size);
+    /* preamble and 1 byte for zero terminator */
+    buf = emalloc(PCBC_ZSTD_PREAMBLE_SIZE + bound + 1);
+    if (dict_id) {
+        rv = ZSTD_compress_usingCDict(ctx->cctx, buf + PCBC_ZSTD_PREAMBLE_SIZE, bound, input, input_size, ctx->cdict);
+    } else {
+        rv = ZSTD_compressCCtx(ctx->cctx, buf + PCBC_ZSTD_PREAMBLE_SIZE, bound, input, input_size, level);
+    }
+    if (ZSTD_isError(rv)) {
+        efree(buf);
+        pcbc_log(LOGARGS(WARN), "Failed to compress data with zstd: %s", ZSTD_getErrorName(rv));
+        return FAILURE;
+    }
+    *(uint32_t *)buf = (uint32_t)input_size;
+    *(uint32_t *)(buf + 4) = dict_id;
+    rv += PCBC_ZSTD_PREAMBLE_SIZE;
+    buf[rv] = '\0';
+
+    *output = buf;
+    *output_size = rv;
+    return SUCCESS;
+}
+
+int pcbc_zstd_decompress(const char *input, size_t input_size, char **output, size_t *output_size TSRMLS_DC)
+{
+    pcbc_zstd_ctx_t *ctx = zstd_context(TSRMLS_C);
+    ZSTD_DDict *ddict = NULL;
+    uint32_t size, dict_id;
+    unsigned long long frame_size;
+    size_t rv;
+    char *buf;
+
+    if (ctx->dctx == NULL) {
+        pcbc_log(LOGARGS(WARN), "Failed to allocate zstd decompression context");
+        return FAILURE;
+    }
+    if (input_size < PCBC_ZSTD_PREAMBLE_SIZE) {
+        pcbc_log(LOGARGS(WARN), "Failed to uncompress data with zstd: preamble is truncated");
+        return FAILURE;
+    }
+    size = *(uint32_t *)input;
+    dict_id = *(uint32_t *)(input + 4);
+    if (dict_id) {
+        int ii;
+
+        for (ii = 0; ii < pcbc_zstd_ndicts; ii++) {
+            if (pcbc_zstd_dicts[ii].id == dict_id) {
+                ddict = pcbc_zstd_dicts[ii].ddict;
+                break;
+            }
+        }
+        if (ddict == NULL) {
+            pcbc_log(LOGARGS(WARN), "Failed to uncompress data with zstd: dictionary %u is not loaded, "
+                                    "check couchbase.decoder.zstd_dictionaries",
+                     dict_id);
+            return FAILURE;
+        }
+    }
+
+    frame_size = ZSTD_getFrameContentSize(input + PCBC_ZSTD_PREAMBLE_SIZE, input_size - PCBC_ZSTD_PREAMBLE_SIZE);
+    if (size > PCBC_ZSTD_MAX_SIZE || frame_size == ZSTD_CONTENTSIZE_ERROR ||
+        (frame_size != ZSTD_CONTENTSIZE_UNKNOWN && frame_size != size)) {
+        pcbc_log(LOGARGS(WARN), "Failed to uncompress data with zstd: invalid original size %u", size);
+        return FAILURE;
+    }
+
+    buf = emalloc((size_t)size + 1);
+    if (ddict) {
+        rv = ZSTD_decompress_usingDDict(ctx->dctx, buf, size, input + PCBC_ZSTD_PREAMBLE_SIZE,
+                                        input_size - PCBC_ZSTD_PREAMBLE_SIZE, ddict);
+    } else {
+        rv = ZSTD_decompressDCtx(ctx->dctx, buf, size, input + PCBC_ZSTD_PREAMBLE_SIZE,
+                                 input_size - PCBC_ZSTD_PREAMBLE_SIZE);
+    }
+    if (ZSTD_isError(rv)) {
+        efree(buf);
+        pcbc_log(LOGARGS(WARN), "Failed to uncompress data with zstd: %s", ZSTD_getErrorName(rv));
+        return FAILURE;
+    }
+    buf[rv] = '\0';
+
+    *output = buf;
+    *output_size = rv;
+    return SUCCESS;
+}
+#endif
@@ -169,6 +169,35 @@ class BucketTest extends CouchbaseTestCase {
         $this->assertErrorMetaDoc($res[$keys[1]], '\Couchbase\Exception', COUCHBASE_KEYNOTFOUND);
     }
 
+    /**
+     * Test multi operations with results and keys, which fill several arena blocks of the same operation
+     *
+     * @depends testConnect
+     */
+    function testMultiLongKeys($b) {
+        $docs = [];
+        for ($i = 0; $i < 1000; $i++) {
+            $key = $this->makeKey(sprintf('%04d', $i));
+            $docs[$key . str_repeat('k', 250 - strlen($key))] = ['value' => str_repeat('v', $i)];
+        }
+        $keys = array_keys($docs);
+
+        $res = $b->upsert($docs);
+        $this->assertCount(1000, $res);
+        foreach ($keys as $key) {
+            $this->assertValidMetaDoc($res[$key], 'cas');
+        }
+
+        $res = $b->get($keys);
+        $this->assertCount(1000, $res);
+        foreach ($keys as $i => $key) {
+            $this->assertEquals(str_repeat('v', $i), $res[$key]->value);
+        }
+
+        $res = $b->remove($keys);
+        $this->assertCount(1000, $res);
+    }
+
     /**
      * Test basic counter operations w/ an initial value
      *
@@ -213,6 +242,456 @@ class BucketTest extends CouchbaseTestCase {
         $this->assertValidMetaDoc($res, 'cas');
     }
 
+    /**
+     * @test
+     * Test asynchronous operations with explicit wait point
+     *
+     * @depends testConnect
+     */
+    function testAsyncOperations($b) {
+        $key1 = $this->makeKey('async1');
+        $key2 = $this->makeKey('async2');
+        $ckey = $this->makeKey('asyncCounter');
+
+        $f1 = $b->upsertAsync($key1, 'foo');
+        $f2 = $b->upsertAsync($key2, 'bar');
+        $fc = $b->counterAsync($ckey, +1, ['initial' => 42]);
+        $b->waitAll();
+        $this->assertTrue($f1->isReady());
+        $this->assertTrue($f2->isReady());
+        $this->assertValidMetaDoc($f1->wait(), 'cas');
+        $this->assertValidMetaDoc($f2->wait(), 'cas');
+        $this->assertEquals(42, $fc->wait()->value);
+
+        $fm = $b->getAsync([$key1, $key2]);
+        $fs = $b->getAsync($key1);
+        $res = $fm->wait();
+        $this->assertCount(2, $res);
+        $this->assertEquals('foo', $res[$key1]->value);
+        $this->assertEquals('bar', $res[$key2]->value);
+        $this->assertEquals('foo', $fs->wait()->value);
+
+        $fr = $b->removeAsync([$key1, $key2, $ckey]);
+        $this->assertCount(3, $fr->wait());
+
+        $f = $b->getAsync($key1);
+        $this->wrapException(function() use($f) {
+            $f->wait();
+        }, '\Couchbase\Exception', COUCHBASE_KEYNOTFOUND);
+    }
+
+    /**
+     * @test
+     * Test driving asynchronous operations without blocking
+     *
+     * @depends testConnect
+     */
+    function testTick($b) {
+        $key = $this->makeKey('tick');
+
+        $f = $b->upsertAsync($key, 'foo');
+        $deadline = microtime(true) + 5;
+        while (!$f->isReady() && microtime(true) < $deadline) {
+            $b->tick();
+            usleep(1000);
+        }
+        $this->assertTrue($f->isReady());
+        $this->assertValidMetaDoc($f->wait(), 'cas');
+        $b->remove($key);
+    }
+
+    /**
+     * @test
+     * Test that operations are accounted in latency metrics
+     *
+     * @depends testConnect
+     */
+    function testMetrics($b) {
+        $key = $this->makeKey('metrics');
+
+        \Couchbase\Metrics::reset();
+        $b->upsert($key, 'foo');
+        $b->get($key);
+        $b->remove($key);
+
+        $snapshot = \Couchbase\Metrics::snapshot();
+        $this->assertArrayHasKey($this->testBucket, $snapshot);
+        $metrics = $snapshot[$this->testBucket];
+        foreach (['store', 'get', 'remove'] as $op) {
+            $this->assertEquals(1, $metrics[$op]['service']['count']);
+            $this->assertEquals(1, $metrics[$op]['total']['count']);
+            $this->assertLessThanOrEqual($metrics[$op]['total']['max_us'], $metrics[$op]['service']['max_us']);
+        }
+
+        \Couchbase\Metrics::reset();
+        $snapshot = \Couchbase\Metrics::snapshot();
+        $this->assertArrayNotHasKey('get', $snapshot[$this->testBucket]);
+    }
+
+    /**
+     * @test
+     * Test that the slowest operations are reported to the error log
+     *
+     * @depends testConnect
+     */
+    function testTracer($b) {
+        if (ini_get('couchbase.log_target')) {
+            $this->markTestSkipped('Tracer report is written to couchbase.log_target instead of PHP error log');
+        }
+        $log = tempnam(sys_get_temp_dir(), 'pcbc-tracer');
+        $settings = [
+            'error_log' => $log,
+            'couchbase.log_level' => 'WARN',
+            'couchbase.log_subsystem_levels' => '',
+            'couchbase.tracing.interval_sec' => '1',
+            'couchbase.tracing.sample_size' => '3',
+            'couchbase.tracing.threshold_kv_ms' => '0',
+        ];
+        $orig = [];
+        foreach ($settings as $name => $value) {
+            $orig[$name] = ini_get($name);
+            ini_set($name, $value);
+        }
+        try {
+            $keys = [];
+            for ($i = 0; $i < 5; $i++) {
+                $keys[] = $this->makeKey('tracer');
+            }
+            // report everything collected before, so that the next report has only the operations below
+            $b->upsert($keys[0], 'warmup');
+            usleep(1100000);
+            $b->upsert($keys[0], 'warmup');
+            file_put_contents($log, '');
+
+            foreach ($keys as $key) {
+                $b->upsert($key, str_repeat('x', 1024));
+            }
+            usleep(1100000);
+            // the interval has elapsed, so this operation writes the report
+            $b->get($keys[0]);
+
+            $lines = preg_grep('/Operations over threshold: /', file($log));
+            $this->assertCount(1, $lines);
+            $this->assertEquals(1, preg_match('/Operations over threshold: (.*)$/', array_shift($lines), $m));
+            $report = json_decode($m[1], true);
+            $this->assertNotNull($report);
+            $this->assertCount(1, $report);
+            $this->assertEquals('kv', $report[0]['service']);
+            $this->assertEquals(6, $report[0]['count']);
+            $top = $report[0]['top'];
+            $this->assertCount(3, $top);
+            for ($i = 0; $i < count($top); $i++) {
+                $this->assertContains($top[$i]['id'], $keys);
+                $this->assertContains($top[$i]['operation'], ['store', 'get']);
+                $this->assertEquals($this->testBucket, $top[$i]['bucket']);
+                $this->assertEquals($top[$i]['total_us'],
+                                    $top[$i]['encode_us'] + $top[$i]['response_us'] + $top[$i]['decode_us']);
+                if ($top[$i]['operation'] == 'get') {
+                    $this->assertEquals(0, $top[$i]['encode_us']);
+                }
+                if ($i > 0) {
+                    $this->assertGreaterThanOrEqual($top[$i]['total_us'], $top[$i - 1]['total_us']);
+                }
+            }
+        } finally {
+            foreach ($orig as $name => $value) {
+                ini_set($name, $value);
+            }
+            unlink($log);
+            foreach ($keys as $key) {
+                try {
+                    $b->remove($key);
+                } catch (\Couchbase\Exception $e) {
+                }
+            }
+        }
+    }
+
+    /**
+     * @test
+     * Test that the value is decoded only when it is accessed
+     *
+     * @depends testConnect
+     */
+    function testLazyDecoding($b) {
+        $key1 = $this->makeKey('lazy1');
+        $key2 = $this->makeKey('lazy2');
+        $b->upsert($key1, ['name' => 'bob']);
+        $b->upsert($key2, ['name' => 'joe']);
+
+        $decoded = 0;
+        $b->setTranscoder('\Couchbase\defaultEncoder', function ($bytes, $flags, $datatype) use (&$decoded) {
+            $decoded++;
+            return \Couchbase\defaultDecoder($bytes, $flags, $datatype);
+        });
+        $res = $b->get([$key1, $key2]);
+        $this->assertNotNull($res[$key1]->cas);
+        $this->assertEquals(0, $decoded);
+
+        $this->assertEquals('bob', $res[$key1]->value->name);
+        $this->assertEquals('bob', $res[$key1]->value->name);
+        $this->assertEquals(1, $decoded);
+
+        $res[$key2]->value = 'overwritten';
+        $this->assertEquals('overwritten', $res[$key2]->value);
+        $this->assertEquals(1, $decoded);
+
+        $doc = $b->get($key2);
+        $copy = clone $doc;
+        $this->assertEquals(2, $decoded);
+        $this->assertEquals('joe', $copy->value->name);
+        $this->assertEquals('joe', $doc->value->name);
+        $this->assertEquals(2, $decoded);
+
+        $b->setTranscoder('\Couchbase\defaultEncoder', '\Couchbase\defaultDecoder');
+        $doc = $b->get($key1);
+        $this->assertArrayHasKey('value', get_object_vars($doc));
+        $this->assertEquals('bob', get_object_vars($doc)['value']->name);
+    }
+
+    function openBucketWithParams($params) {
+        $dsn = $this->testDsn . (strpos($this->testDsn, '?') === false ? '?' : '&') . $params;
+        $h = new \Couchbase\Cluster($dsn);
+        $h->authenticate($this->testAuthenticator);
+        $b = $h->openBucket($this->testBucket);
+        $this->setTimeouts($b);
+        return $b;
+    }
+
+    function connectionCompression($params) {
+        foreach (\Couchbase\Pool::stats()['connections'] as $conn) {
+            if ($conn['type'] == 'bucket' && $conn['refs'] > 0 && strpos($conn['connstr'], $params) !== false) {
+                return $conn['compression'];
+            }
+        }
+        $this->fail("Connection with \"$params\" is not in the pool");
+    }
+
+    /**
+     * @test
+     * Test that documents written with compression on the wire remain JSON
+     */
+    function testNetworkCompression() {
+        $b = $this->openBucketWithParams('compression=force');
+        $this->assertEquals('force', $this->connectionCompression('compression=force'));
+
+        $key = $this->makeKey('snappy');
+        $value = ['items' => array_fill(0, 200, ['name' => 'widget', 'price' => 42])];
+        $b->upsert($key, $value);
+
+        $doc = $b->get($key);
+        $this->assertEquals(COUCHBASE_CFFMT_JSON, $doc->flags & COUCHBASE_CFFMT_MASK);
+        $this->assertCount(200, $doc->value->items);
+        $this->assertEquals('widget', $doc->value->items[199]->name);
+    }
+
+    /**
+     * @test
+     * Test that couchbase.network.compression is applied unless the connection string sets compression
+     */
+    function testNetworkCompressionIni() {
+        $orig = ini_get('couchbase.network.compression');
+        try {
+            $this->assertNotSame(false, ini_set('couchbase.network.compression', 'inflate_only'));
+
+            // distinct parameters, so that the connections are not reused from the pool
+            $params = 'operation_timeout=' . (2.5 + mt_rand(1, 1000) / 1000000);
+            $b = $this->openBucketWithParams($params);
+            $this->assertEquals('inflate_only', $this->connectionCompression($params));
+            $b->upsert($this->makeKey('snappyIni'), ['name' => 'widget']);
+
+            $params = 'compression=deflate_only&operation_timeout=' . (2.5 + mt_rand(1, 1000) / 1000000);
+            $this->openBucketWithParams($params);
+            $this->assertEquals('deflate_only', $this->connectionCompression($params));
+        } finally {
+            ini_set('couchbase.network.compression', $orig);
+        }
+    }
+
+    /**
+     * @test
+     * Test that invalid values of couchbase.network.compression are rejected
+     */
+    function testNetworkCompressionIniValidation() {
+        $orig = ini_get('couchbase.network.compression');
+        try {
+            foreach (['', 'off', 'on', 'inflate_only', 'deflate_only', 'force', 'FORCE'] as $value) {
+                $this->assertNotSame(false, ini_set('couchbase.network.compression', $value), "\"$value\" is valid");
+                $this->assertEquals($value, ini_get('couchbase.network.compression'));
+            }
+            ini_set('couchbase.network.compression', 'on');
+            foreach (['snappy', 'yes', '1', 'Force', 'on,force'] as $value) {
+                $this->assertFalse(ini_set('couchbase.network.compression', $value), "\"$value\" is invalid");
+                $this->assertEquals('on', ini_get('couchbase.network.compression'));
+            }
+        } finally {
+            ini_set('couchbase.network.compression', $orig);
+        }
+    }
+
+    /**
+     * @test
+     * Test exposing sockets and timers of the library to an external event loop
+     *
+     * @depends testConnect
+     */
+    function testWatchers($b) {
+        $key = $this->makeKey('watchers');
+
+        if (strtoupper(substr(PHP_OS, 0, 3)) === 'WIN' || getenv('LIBCOUCHBASE_EVENT_PLUGIN_NAME')) {
+            $this->markTestSkipped('Only the default event-based IO plugin is expected to expose its watchers');
+        }
+        // the default plugin (libevent, libev or select) must be tracked
+        $w = $b->watchers();
+        $this->assertInternalType('array', $w['read']);
+        $this->assertInternalType('array', $w['write']);
+        $this->assertArrayHasKey('timeout', $w);
+
+        $f = $b->upsertAsync($key, 'foo');
+        $w = $b->watchers();
+        foreach (array_merge($w['read'], $w['write']) as $fd) {
+            $this->assertInternalType('int', $fd);
+        }
+        if ($w['timeout'] !== null) {
+            $this->assertInternalType('float', $w['timeout']);
+            $this->assertGreaterThanOrEqual(0, $w['timeout']);
+        }
+        // pending operation always has either socket or timer to wait for
+        $this->assertTrue(count($w['read']) + count($w['write']) > 0 || $w['timeout'] !== null);
+
+        $deadline = microtime(true) + 5;
+        while (!$f->isReady() && microtime(true) < $deadline) {
+            $w = $b->watchers();
+            usleep($w['timeout'] === null ? 1000 : (int)min($w['timeout'] * 1e6, 1000));
+            $b->tick();
+        }
+        $this->assertTrue($f->isReady());
+        $this->assertValidMetaDoc($f->wait(), 'cas');
+        $b->remove($key);
+    }
+
+    /**
+     * @test
+     * Test batch of operations of different types
+     *
+     * @depends testConnect
+     */
+    function testBatch($b) {
+        $key1 = $this->makeKey('batch1');
+        $key2 = $this->makeKey('batch2');
+        $ckey = $this->makeKey('batchCounter');
+        $b->upsert($key1, ['name' => 'foo']);
+
+        $res = $b->batch()
+            ->get($key1)
+            ->upsert($key2, 'bar')
+            ->counter($ckey, +1, ['initial' => 10])
+            ->touch($key1, 30)
+            ->lookupIn($b->lookupIn($key1)->get('name'))
+            ->remove($this->makeKey('batchMissing'))
+            ->execute();
+
+        $this->assertCount(6, $res);
+        $this->assertEquals(['name' => 'foo'], (array)$res[0]->value);
+        $this->assertValidMetaDoc($res[1], 'cas');
+        $this->assertEquals(10, $res[2]->value);
+        $this->assertValidMetaDoc($res[3], 'cas');
+        $this->assertEquals('foo', $res[4]->value[0]['value']);
+        $this->assertInstanceOf('\Couchbase\Exception', $res[5]);
+        $this->assertEquals(COUCHBASE_KEYNOTFOUND, $res[5]->getCode());
+
+        $batch = $b->batch()->replace($key2, 'baz', ['cas' => $res[1]->cas])->remove([$key1, $ckey]);
+        $this->assertEquals(2, $batch->count());
+        $res = $batch->execute();
+        $this->assertEquals(0, $batch->count());
+        $this->assertValidMetaDoc($res[0], 'cas');
+        $this->assertCount(2, $res[1]);
+        $b->remove($key2);
+    }
+
+    /**
+     * @test
+     * Test retrieval of many documents with bounded window
+     *
+     * @depends testConnect
+     */
+    function testGetMany($b) {
+        $docs = [];
+        for ($i = 0; $i < 50; $i++) {
+            $docs[$this->makeKey('getMany')] = ['value' => $i];
+        }
+        $b->upsert($docs);
+        $ids = array_keys($docs);
+        $ids[] = $this->makeKey('getManyMissing');
+
+        $seen = [];
+        foreach ($b->getMany($ids, ['window' => 8]) as $id => $doc) {
+            if (array_key_exists($id, $docs)) {
+                $this->assertNull($doc->error);
+                $this->assertEquals($docs[$id]['value'], $doc->value);
+            } else {
+                $this->assertEquals(COUCHBASE_KEYNOTFOUND, $doc->error->getCode());
+            }
+            $seen[$id] = true;
+        }
+        $this->assertCount(count($ids), $seen);
+
+        $this->wrapException(function() use($b) {
+            $b->getMany(['foo'], ['window' => 0]);
+        }, '\Couchbase\Exception', COUCHBASE_EINVAL);
+        if (PHP_INT_SIZE > 4) {
+            $this->wrapException(function() use($b) {
+                $b->getMany(['foo'], ['window' => 0x80000000]);
+            }, '\Couchbase\Exception', COUCHBASE_EINVAL);
+        }
+        $b->remove(array_keys($docs));
+    }
+
+    /**
+     * @test
+     * Test storing documents pulled from generator
+     *
+     * @depends testConnect
+     */
+    function testUpsertStream($b) {
+        $prefix = $this->makeKey('upsertStream');
+        $generate = function($n) use($prefix) {
+            for ($i = 0; $i < $n; $i++) {
+                yield "$prefix-$i" => ['value' => $i];
+            }
+        };
+
+        $res = $b->upsertStream($generate(50), ['window' => 8]);
+        $this->assertEquals(50, $res['success']);
+        $this->assertEquals(0, $res['failure']);
+        $this->assertEmpty($res['errors']);
+        $this->assertEquals(['value' => 7], (array)$b->get("$prefix-7")->value);
+
+        $failed = [];
+        $b->upsertStream(["$prefix-0" => str_repeat('x', 21 * 1024 * 1024)], [
+            'onError' => function($id, $e) use(&$failed) {
+                $failed[$id] = $e->getCode();
+            }
+        ]);
+        $this->assertEquals(["$prefix-0" => COUCHBASE_E2BIG], $failed);
+
+        $this->wrapException(function() use($b, $generate) {
+            $b->upsertStream($generate(1), ['window' => 0]);
+        }, '\Couchbase\Exception', COUCHBASE_EINVAL);
+        if (PHP_INT_SIZE > 4) {
+            // larger window would be truncated, when it is narrowed to int
+            $this->wrapException(function() use($b, $generate) {
+                $b->upsertStream($generate(1), ['window' => 0x80000000]);
+            }, '\Couchbase\Exception', COUCHBASE_EINVAL);
+        }
+
+        $ids = [];
+        foreach ($generate(50) as $id => $value) {
+            $ids[] = $id;
+        }
+        $b->remove($ids);
+    }
+
     /**
      * Test expiry operations on keys
      *
@@ -292,6 +771,14 @@ class BucketTest extends CouchbaseTestCase {
 
         $this->assertValidMetaDoc($res, 'cas');
 
+        $res = $b->get($key);
+        $this->assertEquals($v, $res->value);
+
+        $v = array_fill(0, 0x4000, str_repeat("*", 20));
+        $b->upsert($key, $v);
+        $res = $b->get($key);
+        $this->assertEquals($v, $res->value);
+
         $b->remove($key);
 
         return $key;
@@ -355,6 +842,36 @@ class BucketTest extends CouchbaseTestCase {
         $this->assertEquals($res->value, 'key3');
     }
 
+    /**
+     * @test
+     * Test that default transcoder gives the same results when invoked natively and through PHP function
+     */
+    function testDefaultTranscoder() {
+        $h = new \Couchbase\Cluster($this->testDsn);
+        $h->authenticate($this->testAuthenticator);
+        $b = $h->openBucket($this->testBucket);
+        $this->setTimeouts($b);
+
+        $key = $this->makeKey('defaultTranscoder');
+        $values = [42, 3.14, true, 'foo', ['foo', 'bar', [1, 2, 3]]];
+        foreach ($values as $value) {
+            // built-in transcoder via native path
+            $b->upsert($key, $value);
+            $this->assertEquals($value, $b->get($key)->value);
+
+            // the same transcoder wrapped into closure goes through call_user_function()
+            $b->setTranscoder(
+                function ($value) { return \Couchbase\defaultEncoder($value); },
+                function ($bytes, $flags, $datatype) { return \Couchbase\defaultDecoder($bytes, $flags, $datatype); }
+            );
+            $this->assertEquals($value, $b->get($key)->value);
+            $b->upsert($key, $value);
+            $b->setTranscoder('\Couchbase\defaultEncoder', '\Couchbase\defaultDecoder');
+            $this->assertEquals($value, $b->get($key)->value);
+        }
+        $b->remove($key);
+    }
+
     /**
      * Test all option values to make sure they save/load
      * We open a new bucket for this test to make sure our settings
@@ -25,4 +25,50 @@ class ClusterTest extends CouchbaseTestCase {
         $h = new \Couchbase\Cluster($this->testDsn);
         $h->openBucket('default', 'badpass');
     }
+
+    /**
+     * @test
+     * Test that batches of several buckets are executed together.
+     */
+    function testMultiExecute() {
+        $h = new \Couchbase\Cluster($this->testDsn);
+        $h->authenticate($this->testAuthenticator);
+        $b1 = $h->openBucket($this->testBucket);
+        $b2 = $h->openBucket($this->testBucket);
+        $key = $this->makeKey('multiExecute');
+
+        $res = $h->multiExecute([
+            'first' => $b1->batch()->upsert($key, 'foo'),
+            'second' => $b2->batch()->counter($key . '-counter', +1, ['initial' => 5]),
+        ]);
+        $this->assertEquals(['first', 'second'], array_keys($res));
+        $this->assertNotNull($res['first'][0]->cas);
+        $this->assertEquals(5, $res['second'][0]->value);
+
+        $res = $h->multiExecute([$b1->batch()->get($key), $b2->batch()->remove([$key, $key . '-counter'])]);
+        $this->assertEquals('foo', $res[0][0]->value);
+        $this->assertCount(2, $res[1][0]);
+    }
+
+    /**
+     * @test
+     * Test that pool statistics describe opened connections.
+     */
+    function testPoolStats() {
+        $h = new \Couchbase\Cluster($this->testDsn);
+        $h->authenticate($this->testAuthenticator);
+        $before = \Couchbase\Pool::stats();
+        $b = $h->openBucket($this->testBucket);
+        $b->upsert($this->makeKey('poolStats'), 'foo');
+
+        $stats = \Couchbase\Pool::stats();
+        $this->assertEquals($before['hits'] + $before['misses'] + 1, $stats['hits'] + $stats['misses']);
+        $buckets = array_filter($stats['connections'], function ($conn) {
+            return $conn['type'] == 'bucket' && $conn['bucket'] == $this->testBucket && $conn['refs'] > 0;
+        });
+        $this->assertNotEmpty($buckets);
+        $conn = array_shift($buckets);
+        $this->assertGreaterThan(0, $conn['operations']);
+        $this->assertGreaterThan(0, $conn['created_at']);
+    }
 }
@@ -0,0 +1,66 @@
+<?php
+require_once('CouchbaseTestCase.php');
+
+/**
+ * Checks that the fast JSON parser yields exactly the same values and errors as json_decode()
+ */
+class JsonParserTest extends CouchbaseTestCase {
+    protected function setUp() {
+        if (!\Couchbase\HAVE_YYJSON) {
+            $this->markTestSkipped('Extension does not support yyjson parser');
+        }
+        $this->origParser = ini_get('couchbase.decoder.json_parser');
+        ini_set('couchbase.decoder.json_parser', 'yyjson');
+    }
+
+    protected function tearDown() {
+        if (isset($this->origParser)) {
+            ini_set('couchbase.decoder.json_parser', $this->origParser);
+        }
+    }
+
+    function documents() {
+        $nested = str_repeat('[', 512) . str_repeat(']', 512);
+        $tooDeep = str_repeat('[', 513) . str_repeat(']', 513);
+        return [
+            ['null'], ['true'], ['false'], ['0'], ['-0'], ['-0.0'], ['0.0'], ['1'], ['-1'],
+            ['9223372036854775807'], ['-9223372036854775808'], ['9223372036854775808'], ['-9223372036854775809'],
+            ['18446744073709551616'], ['123456789012345678901234567890'], ['1e2'], ['1E-2'], ['0.1'], ['-1.5e+300'],
+            ['1.7976931348623157e308'], ['1e400'], ['4.9e-324'], ['3.141592653589793238462643383279'],
+            ['""'], ['"foo"'], ['"é中😀"'], ['"a\"b\\\\c\/d\b\f\n\r\t"'], ['"\u0000"'],
+            ['"' . "\xc3\xa9" . '"'], ['"' . "\xff" . '"'], ['"' . "\xed\xa0\x80" . '"'], ['"\ud800"'],
+            ['[]'], ['{}'], ['[1,"2",3.0,null,true,[],{}]'], [' { "a" : 1 , "b" : [ 2 ] } '],
+            ['{"a":1,"a":2}'], ['{"1":"one","01":"zero-one","-1":"minus"}'], ['{"":1}'], ['{"\u0000a":1}'],
+            ['{"a\u0000":1}'], ['{"x":{"y":{"z":[{"k":"v"}]}}}'],
+            [$nested], [$tooDeep],
+            [''], [' '], ['['], ['[1,]'], ['{"a":1,}'], ['{a:1}'], ["{'a':1}"], ['01'], ['1.'], ['.5'], ['+1'],
+            ['NaN'], ['Infinity'], ['[1] [2]'], ['"unterminated'], ["\"tab\tin string\""], ['/* c */ 1'],
+            ['{"name":"widget","tags":["a","b"],"price":12.5,"stock":{"warehouse":3,"store":null},"active":true}'],
+        ];
+    }
+
+    /**
+     * @dataProvider documents
+     */
+    function testCompatibility($json) {
+        foreach ([false, true] as $assoc) {
+            $expected = json_decode($json, $assoc);
+            $expectedError = json_last_error();
+
+            $actual = \Couchbase\basicDecoderV1($json, 0x02000006, 0, ['jsonassoc' => $assoc]);
+            $actualError = json_last_error();
+
+            $this->assertSame($expectedError, $actualError);
+            if ($expectedError == JSON_ERROR_NONE) {
+                $this->assertSame(serialize($expected), serialize($actual));
+            } else {
+                $this->assertNull($actual);
+            }
+        }
+    }
+
+    function testParserSettingIsValidated() {
+        $this->assertFalse(ini_set('couchbase.decoder.json_parser', 'simdjson'));
+        $this->assertEquals('yyjson', ini_get('couchbase.decoder.json_parser'));
+    }
+}
@@ -0,0 +1,179 @@
+<?php
+require_once('CouchbaseTestCase.php');
+
+/**
+ * Checks per-subsystem levels, rate limit and buffered JSON target of the logger. The messages are produced by the
+ * default decoder, which logs invalid JSON with WARN level as "pcbc/ext" subsystem.
+ */
+class LogTest extends CouchbaseTestCase {
+    protected function setUp() {
+        if (ini_get('couchbase.log_target')) {
+            $this->markTestSkipped('Messages are written to couchbase.log_target instead of PHP error log');
+        }
+        $this->log = tempnam(sys_get_temp_dir(), 'pcbc-log');
+        $this->orig = [];
+        $this->setIni([
+            'error_log' => $this->log,
+            'couchbase.log_level' => 'WARN',
+            'couchbase.log_subsystem_levels' => '',
+            'couchbase.log_rate_limit' => '0',
+        ]);
+    }
+
+    protected function tearDown() {
+        if (isset($this->orig)) {
+            foreach ($this->orig as $name => $value) {
+                ini_set($name, $value);
+            }
+        }
+        if (isset($this->log)) {
+            unlink($this->log);
+        }
+    }
+
+    function setIni($settings) {
+        foreach ($settings as $name => $value) {
+            if (!array_key_exists($name, $this->orig)) {
+                $this->orig[$name] = ini_get($name);
+            }
+            ini_set($name, $value);
+        }
+    }
+
+    function logInvalidJson($times = 1) {
+        for ($i = 0; $i < $times; $i++) {
+            \Couchbase\basicDecoderV1('{"invalid', 0x02000006, 0, []);
+        }
+    }
+
+    function logged() {
+        $lines = preg_grep('/pcbc\/ext.*Failed to decode value as JSON/', file($this->log));
+        file_put_contents($this->log, '');
+        return count($lines);
+    }
+
+    function testSubsystemLevelsValidation() {
+        $valid = [
+            '',
+            'pcbc/ext=DEBUG',
+            'pcbc/pool=DEBUG,lcb/=ERROR',
+            ' pcbc/ext=TRACE , pcbc/=FATL ',
+            'pcbc/ext=WARN,',
+        ];
+        foreach ($valid as $spec) {
+            $this->assertNotSame(false, ini_set('couchbase.log_subsystem_levels', $spec), "\"$spec\" is valid");
+            $this->assertEquals($spec, ini_get('couchbase.log_subsystem_levels'));
+        }
+
+        ini_set('couchbase.log_subsystem_levels', 'pcbc/ext=INFO');
+        $invalid = [
+            'pcbc/ext',
+            '=DEBUG',
+            'pcbc/ext=',
+            'pcbc/ext=LOUD',
+            'pcbc/ext=DEBUG,pcbc/pool',
+            str_repeat('x', 32) . '=DEBUG',
+            implode(',', array_map(function ($i) { return "s$i=DEBUG"; }, range(1, 17))),
+        ];
+        foreach ($invalid as $spec) {
+            $this->assertFalse(ini_set('couchbase.log_subsystem_levels', $spec), "\"$spec\" is invalid");
+            $this->assertEquals('pcbc/ext=INFO', ini_get('couchbase.log_subsystem_levels'));
+        }
+        $this->assertNotSame(false, ini_set('couchbase.log_subsystem_levels', str_repeat('x', 31) . '=DEBUG'));
+        $this->assertNotSame(false, ini_set('couchbase.log_subsystem_levels',
+                                            implode(',', array_map(function ($i) { return "s$i=DEBUG"; },
+                                                                   range(1, 16)))));
+    }
+
+    function testSubsystemLevels() {
+        $this->logInvalidJson();
+        $this->assertEquals(1, $this->logged());
+
+        $this->setIni(['couchbase.log_subsystem_levels' => 'pcbc/ext=ERROR']);
+        $this->logInvalidJson();
+        $this->assertEquals(0, $this->logged());
+
+        // the name ending with slash is prefix
+        $this->setIni(['couchbase.log_subsystem_levels' => 'pcbc/=ERROR']);
+        $this->logInvalidJson();
+        $this->assertEquals(0, $this->logged());
+
+        // other names must match exactly
+        $this->setIni(['couchbase.log_subsystem_levels' => 'pcbc/e=ERROR,pcbc/ext/=ERROR,pcbc/transcoding=ERROR']);
+        $this->logInvalidJson();
+        $this->assertEquals(1, $this->logged());
+
+        // the first matching entry wins
+        $this->setIni(['couchbase.log_subsystem_levels' => 'pcbc/ext=WARN,pcbc/=ERROR']);
+        $this->logInvalidJson();
+        $this->assertEquals(1, $this->logged());
+
+        // subsystem level is used even when it is more verbose than the global level
+        $this->setIni(['couchbase.log_level' => 'ERROR', 'couchbase.log_subsystem_levels' => 'pcbc/ext=WARN']);
+        $this->logInvalidJson();
+        $this->assertEquals(1, $this->logged());
+
+        $this->setIni(['couchbase.log_subsystem_levels' => '']);
+        $this->logInvalidJson();
+        $this->assertEquals(0, $this->logged());
+    }
+
+    function testRateLimit() {
+        $this->setIni(['couchbase.log_rate_limit' => '2']);
+
+        // start at the beginning of the second, so that all messages below fall into the same window
+        $now = time();
+        while (time() == $now) {
+            usleep(10000);
+        }
+        $this->logInvalidJson(5);
+        $this->assertEquals(2, $this->logged());
+
+        $now = time();
+        while (time() == $now) {
+            usleep(10000);
+        }
+        $this->logInvalidJson();
+        $lines = file($this->log);
+        $this->assertCount(1, preg_grep('/pcbc\/ext.*3 messages suppressed by couchbase\.log_rate_limit/', $lines));
+        $this->assertEquals(1, $this->logged());
+    }
+
+    function testFileTarget() {
+        if (strtoupper(substr(PHP_OS, 0, 3)) === 'WIN') {
+            $this->markTestSkipped('couchbase.log_target is not available on Windows');
+        }
+        // couchbase.log_target can be set only at startup, so the messages are written by the child process
+        $target = tempnam(sys_get_temp_dir(), 'pcbc-target');
+        $code = 'if (!extension_loaded("couchbase")) { echo "skip"; exit; }' .
+              'for ($i = 0; $i < 3; $i++) { \Couchbase\basicDecoderV1("{\"invalid", 0x02000006, 0, []); }' .
+              'echo "done";';
+        $php = escapeshellarg(PHP_BINARY);
+        if (php_ini_loaded_file()) {
+            $php .= ' -c ' . escapeshellarg(php_ini_loaded_file());
+        }
+        $output = shell_exec(sprintf('%s -d %s -d couchbase.log_level=WARN -r %s', $php,
+                                     escapeshellarg("couchbase.log_target=file://$target"), escapeshellarg($code)));
+        $lines = file($target);
+        unlink($target);
+        if (trim($output) == 'skip') {
+            $this->markTestSkipped('Couchbase extension is not loaded by php.ini');
+        }
+        $this->assertEquals('done', trim($output));
+
+        // the records are written at the end of the request as JSON lines
+        $lines = preg_grep('/Failed to decode value as JSON/', $lines);
+        $this->assertCount(3, $lines);
+        foreach ($lines as $line) {
+            $record = json_decode($line, true);
+            $this->assertNotNull($record, "valid JSON: $line");
+            $this->assertRegExp('/^\d{4}-\d\d-\d\dT\d\d:\d\d:\d\d\.\d{6}Z$/', $record['time']);
+            $this->assertInternalType('int', $record['pid']);
+            $this->assertEquals('WARN', $record['level']);
+            $this->assertEquals('pcbc/ext', $record['subsys']);
+            $this->assertInternalType('int', $record['line']);
+            $this->assertStringStartsWith('Failed to decode value as JSON: json_last_error=', $record['msg']);
+        }
+        $this->assertEquals(0, $this->logged(), 'nothing is written to PHP error log');
+    }
+}
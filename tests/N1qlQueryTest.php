@@ -42,6 +42,62 @@ class N1qlQueryTest extends CouchbaseTestCase {
         $this->assertEquals(42, $res->rows[0][$this->testBucket]['bar']);
     }
 
+    function testStreamRows() {
+        if ($this->usingMock()) {
+            $this->markTestSkipped('N1QL queries are not supported by the CouchbaseMock');
+        }
+        $key = $this->makeKey("n1qlStreamRows");
+        $this->bucket->upsert($key, ["bar" => 42]);
+        $query = \Couchbase\N1qlQuery::fromString("SELECT * FROM `{$this->testBucket}` USE KEYS \"$key\"");
+        $query->consistency(\Couchbase\N1qlQuery::REQUEST_PLUS);
+        $stream = $this->bucket->queryStream($query);
+        $this->assertInstanceOf('\Couchbase\N1qlQueryStream', $stream);
+        $this->assertNull($stream->meta());
+        $rows = [];
+        foreach ($stream as $idx => $row) {
+            $rows[$idx] = $row;
+        }
+        $this->assertCount(1, $rows);
+        $this->assertEquals(42, $rows[0]->{$this->testBucket}->bar);
+        $meta = $stream->meta();
+        $this->assertNotNull($meta->requestId);
+        $this->assertEquals("success", $meta->status);
+
+        $stream = $this->bucket->queryStream($query, true); // with arrays instead of stdObject
+        $stream->rewind();
+        $this->assertTrue($stream->valid());
+        $row = $stream->current();
+        $this->assertEquals(42, $row[$this->testBucket]['bar']);
+    }
+
+    function testStreamMaxBuffered() {
+        if ($this->usingMock()) {
+            $this->markTestSkipped('N1QL queries are not supported by the CouchbaseMock');
+        }
+        $key = $this->makeKey("n1qlStreamMaxBuffered");
+        $this->bucket->upsert($key, ["bar" => 42]);
+        $orig = ini_get('couchbase.n1ql.stream_max_buffered');
+        ini_set('couchbase.n1ql.stream_max_buffered', 10);
+        try {
+            $query = \Couchbase\N1qlQuery::fromString("SELECT RAW i FROM ARRAY_RANGE(0, 1000) AS i");
+            $stream = $this->bucket->queryStream($query);
+            // the rows are received while other operations run the event loop, and the stream is not iterated
+            for ($i = 0; $i < 20; $i++) {
+                $this->bucket->get($key);
+                usleep(50000);
+            }
+            $rows = [];
+            $this->wrapException(function() use($stream, &$rows) {
+                foreach ($stream as $row) {
+                    $rows[] = $row;
+                }
+            }, '\Couchbase\Exception', COUCHBASE_CLIENT_ENOMEM);
+            $this->assertEquals(range(0, 9), $rows);
+        } finally {
+            ini_set('couchbase.n1ql.stream_max_buffered', $orig);
+        }
+    }
+
     function testParameters() {
         if ($this->usingMock()) {
             $this->markTestSkipped('N1QL queries are not supported by the CouchbaseMock');
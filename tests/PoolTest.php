@@ -0,0 +1,213 @@
+<?php
+require_once('CouchbaseTestCase.php');
+
+/**
+ * Checks pre-warming, config cache, multiple instances per key and health checks of the connection pool. Most of the
+ * settings can be set only at startup, so every case runs in the child process, which prints Pool::stats().
+ */
+class PoolTest extends CouchbaseTestCase {
+    protected function setUp() {
+        parent::setUp();
+        if ($this->usingMock()) {
+            $this->markTestSkipped('Child processes cannot use the mock of the parent process');
+        }
+        if (strtoupper(substr(PHP_OS, 0, 3)) === 'WIN') {
+            $this->markTestSkipped('Pool settings are tested with POSIX shell');
+        }
+    }
+
+    /**
+     * Runs the code with the settings in the child process, and returns the list of the stats printed by it
+     */
+    function runChild($settings, $code) {
+        list($output, $status) = $this->execChild($settings, $code . ' echo json_encode($stats);');
+        $stats = json_decode($output, true);
+        $this->assertInternalType('array', $stats, "child process output: $output");
+        return $stats;
+    }
+
+    /**
+     * Runs the code in the child process, and returns its output and exit status
+     */
+    function execChild($settings, $code) {
+        $php = escapeshellarg(PHP_BINARY);
+        if (php_ini_loaded_file()) {
+            $php .= ' -c ' . escapeshellarg(php_ini_loaded_file());
+        }
+        foreach ($settings as $name => $value) {
+            $php .= ' -d ' . escapeshellarg("$name=$value");
+        }
+        $prologue = 'if (!extension_loaded("couchbase")) { echo "skip"; exit; }' .
+                  '$stats = [];' .
+                  sprintf('function openBucket() { $h = new \Couchbase\Cluster(%s); %s; return $h->openBucket(%s); }',
+                          var_export($this->testDsn, true), $this->authenticateCode(),
+                          var_export($this->testBucket, true));
+        exec(sprintf('%s -d display_errors=stderr -r %s 2>/dev/null', $php, escapeshellarg($prologue . $code)), $lines,
+             $status);
+        $output = implode("\n", $lines);
+        if (trim($output) == 'skip') {
+            $this->markTestSkipped('Couchbase extension is not loaded by php.ini');
+        }
+        return [$output, $status];
+    }
+
+    function authenticateCode() {
+        if ($this->serverVersion() >= 5.0) {
+            return sprintf('$h->authenticate((new \Couchbase\PasswordAuthenticator())->username(%s)->password(%s))',
+                           var_export($this->testUser, true), var_export($this->testPassword, true));
+        }
+        return sprintf('$a = new \Couchbase\ClassicAuthenticator(); $a->bucket(%s, %s); $h->authenticate($a)',
+                       var_export($this->testBucket, true), var_export($this->testPassword, true));
+    }
+
+    function prewarmSpec($withPassword = true) {
+        if ($this->serverVersion() < 5.0) {
+            $this->markTestSkipped('Pre-warm specification has credentials of RBAC user');
+        }
+        $url = parse_url($this->testDsn);
+        if (!$url || !isset($url['host'])) {
+            $this->markTestSkipped("Connection string \"{$this->testDsn}\" cannot be used for pre-warm");
+        }
+        $spec = (isset($url['scheme']) ? $url['scheme'] : 'couchbase') . '://' . rawurlencode($this->testUser);
+        if ($withPassword) {
+            $spec .= ':' . rawurlencode($this->testPassword);
+        }
+        $spec .= '@' . $url['host'] . (isset($url['port']) ? ':' . $url['port'] : '') . '/' . $this->testBucket;
+        if (isset($url['query'])) {
+            $spec .= '?' . $url['query'];
+        }
+        return $spec;
+    }
+
+    function bucketConnections($stats) {
+        return array_values(array_filter($stats['connections'], function ($conn) {
+            return $conn['type'] == 'bucket' && $conn['bucket'] == $this->testBucket;
+        }));
+    }
+
+    function testPrewarm() {
+        $spec = $this->prewarmSpec();
+        // duplicates resolve to the same pool key, and must be bootstrapped only once
+        $stats = $this->runChild(['couchbase.pool.prewarm' => "$spec; $spec"],
+                                 '$stats[] = \Couchbase\Pool::stats();' .
+                                 '$b = openBucket();' .
+                                 '$stats[] = \Couchbase\Pool::stats();');
+
+        $this->assertEquals(0, $stats[0]['misses']);
+        $this->assertEquals(0, $stats[0]['hits']);
+        $conns = $this->bucketConnections($stats[0]);
+        $this->assertCount(1, $conns);
+        $this->assertEquals(0, $conns[0]['refs']);
+        $this->assertGreaterThan(0, $conns[0]['bootstrap_ms']);
+
+        // the application gets the pre-warmed connection
+        $this->assertEquals(0, $stats[1]['misses']);
+        $this->assertEquals(1, $stats[1]['hits']);
+        $conns = $this->bucketConnections($stats[1]);
+        $this->assertCount(1, $conns);
+        $this->assertEquals(1, $conns[0]['refs']);
+    }
+
+    function testPrewarmUserWithoutPassword() {
+        // the worker must survive the entry without password, even if the server refuses the credentials
+        $spec = $this->prewarmSpec(false);
+        $stats = $this->runChild(['couchbase.pool.prewarm' => $spec], '$stats[] = \Couchbase\Pool::stats();');
+        $this->assertCount(1, $stats);
+        $this->assertEquals(0, $stats[0]['misses']);
+        $this->assertLessThanOrEqual(1, count($this->bucketConnections($stats[0])));
+    }
+
+    function testConfigCache() {
+        $dir = tempnam(sys_get_temp_dir(), 'pcbc-cache');
+        unlink($dir);
+        mkdir($dir);
+        try {
+            $settings = ['couchbase.pool.config_cache' => $dir];
+            $code = '$b = openBucket(); $b->upsert("pcbc-config-cache", "foo"); $stats[] = \Couchbase\Pool::stats();';
+
+            $stats = $this->runChild($settings, $code);
+            $this->assertEquals(1, $stats[0]['network_bootstraps']);
+            $this->assertEquals(0, $stats[0]['config_cache_hits']);
+
+            // the next process bootstraps from the file written by the first one
+            $stats = $this->runChild($settings, $code);
+            $this->assertEquals(0, $stats[0]['network_bootstraps']);
+            $this->assertEquals(1, $stats[0]['config_cache_hits']);
+        } finally {
+            foreach (glob("$dir/*") as $file) {
+                unlink($file);
+            }
+            rmdir($dir);
+        }
+    }
+
+    function testMaxInstancesPerKey() {
+        $stats = $this->runChild(['couchbase.pool.max_instances_per_key' => 2],
+                                 '$b1 = openBucket(); $b2 = openBucket();' .
+                                 '$stats[] = \Couchbase\Pool::stats();' .
+                                 // the limit is reached, so the least used instance is shared
+                                 '$b3 = openBucket();' .
+                                 '$stats[] = \Couchbase\Pool::stats();' .
+                                 // the idle instance is checked out before the busy ones
+                                 'unset($b1, $b3); $b4 = openBucket();' .
+                                 '$stats[] = \Couchbase\Pool::stats();');
+
+        $this->assertEquals(2, $stats[0]['misses']);
+        $this->assertCount(2, $this->bucketConnections($stats[0]));
+
+        $this->assertEquals(2, $stats[1]['misses']);
+        $this->assertEquals(1, $stats[1]['hits']);
+        $refs = array_map(function ($conn) { return $conn['refs']; }, $this->bucketConnections($stats[1]));
+        sort($refs);
+        $this->assertEquals([1, 2], $refs);
+
+        $this->assertEquals(2, $stats[2]['misses']);
+        $this->assertEquals(2, $stats[2]['hits']);
+        $refs = array_map(function ($conn) { return $conn['refs']; }, $this->bucketConnections($stats[2]));
+        $this->assertEquals([1, 1], $refs);
+    }
+
+    function testHealthCheck() {
+        $stats = $this->runChild(['couchbase.pool.health_check_idle_sec' => 1,
+                                  'couchbase.pool.health_check_timeout_ms' => 2000],
+                                 '$b = openBucket(); unset($b); sleep(2);' .
+                                 // the connection has been idle long enough, so it is checked before reuse
+                                 '$b = openBucket(); $b->upsert("pcbc-health-check", "foo");' .
+                                 '$stats[] = \Couchbase\Pool::stats();');
+
+        $this->assertEquals(1, $stats[0]['misses']);
+        $this->assertEquals(1, $stats[0]['hits']);
+        $this->assertEquals(0, $stats[0]['reconnects']);
+        $conns = $this->bucketConnections($stats[0]);
+        $this->assertCount(1, $conns);
+        $this->assertGreaterThan(0, $conns[0]['operations']);
+    }
+
+    function testAbandonedOperations() {
+        // the fatal error skips destructors, so the futures and the iterator are freed with the operations in flight
+        list($output, $status) = $this->execChild([], '
+            $b = openBucket();
+            $f = $b->upsertAsync("pcbc-abandoned", str_repeat("x", 1024));
+            $it = $b->getMany(array_fill(0, 100, "pcbc-abandoned"));
+            $it->valid();
+            $g = $b->getAsync("pcbc-abandoned");
+            register_shutdown_function(function () { echo "shutdown"; });
+            trigger_error("abandon", E_USER_ERROR);');
+        $this->assertEquals('shutdown', trim($output));
+        $this->assertEquals(255, $status, 'the process is terminated by the fatal error, not by a signal');
+
+        // without fatal error, the destructor drains the operations, and the connection stays in the pool
+        $stats = $this->runChild([], '
+            $b = openBucket();
+            $f = $b->upsertAsync("pcbc-abandoned", "foo");
+            unset($f);
+            $it = $b->getMany(array_fill(0, 100, "pcbc-abandoned"), ["window" => 10]);
+            $it->valid();
+            unset($it);
+            $stats[] = $b->get("pcbc-abandoned")->value;
+            unset($b);
+            $stats[] = \Couchbase\Pool::stats();');
+        $this->assertEquals('foo', $stats[0]);
+        $this->assertCount(1, $this->bucketConnections($stats[1]));
+    }
+}
@@ -376,4 +376,100 @@ class TranscoderTest extends CouchbaseTestCase {
 
         ini_set('couchbase.decoder.json_arrays', $orig);
     }
+
+    function testZstdCompression() {
+        if (!\Couchbase\HAVE_ZSTD) {
+            $this->markTestSkipped('Extension does not support zstd compressor');
+        }
+        $value = [];
+        for ($i = 0; $i < 50; $i++) {
+            $value[] = ["id" => $i, "name" => "user$i", "active" => true];
+        }
+        $options = ['sertype' => COUCHBASE_SERTYPE_JSON, 'cmprtype' => COUCHBASE_CMPRTYPE_ZSTD,
+                    'cmprthresh' => 0, 'cmprfactor' => 1.0];
+        $res = \Couchbase\basicEncoderV1($value, $options);
+        $this->assertEquals(COUCHBASE_COMPRESSION_ZSTD, $res[1] & COUCHBASE_COMPRESSION_MASK);
+        $this->assertEquals(COUCHBASE_COMPRESSION_MCISCOMPRESSED, $res[1] & COUCHBASE_COMPRESSION_MCISCOMPRESSED);
+        $this->assertEquals(COUCHBASE_CFFMT_PRIVATE, $res[1] & COUCHBASE_CFFMT_MASK);
+        $this->assertLessThan(strlen(json_encode($value)), strlen($res[0]));
+        $preamble = unpack('Vsize/Vdict', substr($res[0], 0, 8));
+        $this->assertEquals(strlen(json_encode($value)), $preamble['size']);
+
+        $decoded = \Couchbase\basicDecoderV1($res[0], $res[1], $res[2], ['jsonassoc' => true]);
+        $this->assertEquals($value, $decoded);
+
+        $data = str_repeat("foobar", 100);
+        $compressed = \Couchbase\zstdCompress($data);
+        $this->assertEquals($data, \Couchbase\zstdDecompress($compressed));
+
+        // the original size in the preamble must match the frame
+        $frame = substr($compressed, 8);
+        foreach ([0xFFFFFFFF, 0x7FFFFFFF, strlen($data) + 1, strlen($data) - 1, 0] as $size) {
+            $this->assertNull(@\Couchbase\zstdDecompress(pack('VV', $size, 0) . $frame));
+        }
+        $this->assertNull(@\Couchbase\zstdDecompress(pack('VV', strlen($data), 0) . 'garbage'));
+    }
+
+    function testAdaptiveCompression() {
+        $origAdaptive = ini_get('couchbase.encoder.compression_adaptive');
+        $origInterval = ini_get('couchbase.encoder.compression_probe_interval');
+        ini_set('couchbase.encoder.compression_adaptive', true);
+        ini_set('couchbase.encoder.compression_probe_interval', 4);
+
+        // zero factor keeps compressed values even if they are larger, so that the attempts are visible in flags
+        $options = ['cmprtype' => COUCHBASE_CMPRTYPE_FASTLZ, 'cmprthresh' => 0, 'cmprfactor' => 0.0];
+        $compressed = [];
+        for ($i = 0; $i < 16; $i++) {
+            $value = '';
+            for ($j = 0; $j < 1000; $j++) {
+                $value .= chr(mt_rand(0, 255));
+            }
+            $res = \Couchbase\basicEncoderV1($value, $options);
+            $compressed[] = ($res[1] & COUCHBASE_COMPRESSION_MASK) == COUCHBASE_COMPRESSION_FASTLZ;
+        }
+        $this->assertEquals(array_fill(0, 8, true), array_slice($compressed, 0, 8));
+        // after eight attempts without gain, only every fourth value is compressed
+        $this->assertEquals([false, false, false, true, false, false, false, true], array_slice($compressed, 8));
+
+        // other classes of values are not affected
+        $res = \Couchbase\basicEncoderV1(str_repeat('a', 3000), $options);
+        $this->assertEquals(COUCHBASE_COMPRESSION_FASTLZ, $res[1] & COUCHBASE_COMPRESSION_MASK);
+
+        ini_set('couchbase.encoder.compression_adaptive', $origAdaptive);
+        ini_set('couchbase.encoder.compression_probe_interval', $origInterval);
+    }
+
+    function testLz4Compression() {
+        if (!\Couchbase\HAVE_LZ4) {
+            $this->markTestSkipped('Extension does not support lz4 compressor');
+        }
+        $value = str_repeat('{"session":"abcdef","ttl":3600}', 20);
+        foreach ([COUCHBASE_CMPRTYPE_LZ4, COUCHBASE_CMPRTYPE_LZ4HC] as $cmprtype) {
+            $options = ['cmprtype' => $cmprtype, 'cmprthresh' => 0, 'cmprfactor' => 1.0];
+            $res = \Couchbase\basicEncoderV1($value, $options);
+            $this->assertEquals(COUCHBASE_COMPRESSION_LZ4, $res[1] & COUCHBASE_COMPRESSION_MASK);
+            $this->assertEquals(COUCHBASE_COMPRESSION_MCISCOMPRESSED, $res[1] & COUCHBASE_COMPRESSION_MCISCOMPRESSED);
+            $this->assertLessThan(strlen($value), strlen($res[0]));
+            $this->assertEquals($value, \Couchbase\basicDecoderV1($res[0], $res[1], $res[2], []));
+        }
+
+        $compressed = \Couchbase\lz4Compress($value);
+        $this->assertEquals($value, \Couchbase\lz4Decompress($compressed));
+
+        // truncated preamble
+        foreach (['', 'a', substr($compressed, 0, 3)] as $bad) {
+            $this->assertNull(@\Couchbase\lz4Decompress($bad));
+        }
+        // the original size is zero, too large or cannot be produced by the payload
+        $payload = substr($compressed, 4);
+        foreach ([0, 0xFFFFFFFF, 0x7FFFFFFF, 0x7E000001, strlen($payload) * 255 + 1] as $size) {
+            $this->assertNull(@\Couchbase\lz4Decompress(pack('V', $size) . $payload));
+        }
+        // the decoder does not return the value, but survives
+        $res = \Couchbase\basicEncoderV1($value, ['cmprtype' => COUCHBASE_CMPRTYPE_LZ4, 'cmprthresh' => 0,
+                                                   'cmprfactor' => 1.0]);
+        foreach (['abc', pack('V', 0xFFFFFFFF) . $payload] as $bad) {
+            $this->assertNotEquals($value, @\Couchbase\basicDecoderV1($bad, $res[1], $res[2], []));
+        }
+    }
 }
@@ -18,34 +18,77 @@
 
 #define LOGARGS(lvl) LCB_LOG_##lvl, NULL, "pcbc/transcoding", __FILE__, __LINE__
 
-int pcbc_decode_value(zval *return_value, pcbc_bucket_t *bucket, const char *bytes, int bytes_len, lcb_U32 flags,
+/* checks if the callable refers to the default transcoder function, which can be invoked natively */
+int pcbc_transcoder_is_default(zval *callable, int is_encoder)
+{
+    const char *name;
+    int name_len;
+
+    if (Z_TYPE_P(callable) != IS_STRING) {
+        return 0;
+    }
+    name = Z_STRVAL_P(callable);
+    name_len = Z_STRLEN_P(callable);
+    if (name_len > 0 && name[0] == '\\') {
+        name++;
+        name_len--;
+    }
+    if (is_encoder) {
+        return (name_len == sizeof("couchbase\\defaultencoder") - 1 &&
+                strncasecmp(name, "couchbase\\defaultencoder", name_len) == 0) ||
+               (name_len == sizeof("couchbase_default_encoder") - 1 &&
+                strncasecmp(name, "couchbase_default_encoder", name_len) == 0);
+    }
+    return (name_len == sizeof("couchbase\\defaultdecoder") - 1 &&
+            strncasecmp(name, "couchbase\\defaultdecoder", name_len) == 0) ||
+           (name_len == sizeof("couchbase_default_decoder") - 1 &&
+            strncasecmp(name, "couchbase_default_decoder", name_len) == 0);
+}
+
+int pcbc_decode_value(zval *return_value, pcbc_bucket_t *bucket, zval *bytes, lcb_U32 flags,
                       lcb_datatype_t datatype TSRMLS_DC)
+{
+    return pcbc_decode_value_ex(return_value, bucket->native_decoder ? NULL : PCBC_P(bucket->decoder), bytes, flags,
+                                datatype TSRMLS_CC);
+}
+
+/* decodes the value with given callable, or with the default decoder, when the callable is NULL */
+int pcbc_decode_value_ex(zval *return_value, zval *decoder, zval *bytes, lcb_U32 flags,
+                         lcb_datatype_t datatype TSRMLS_DC)
 {
     int rv;
     PCBC_ZVAL params[3];
 
-    PCBC_ZVAL_ALLOC(params[0]);
+    if (decoder == NULL) {
+        pcbc_default_decode(return_value, bytes, flags, datatype TSRMLS_CC);
+        return SUCCESS;
+    }
+
     PCBC_ZVAL_ALLOC(params[1]);
     PCBC_ZVAL_ALLOC(params[2]);
 
-    PCBC_STRINGL(params[0], bytes, bytes_len);
+    // the bytes are passed by reference, without copying
+    params[0] = PCBC_D(bytes);
     ZVAL_LONG(PCBC_P(params[1]), flags);
     ZVAL_LONG(PCBC_P(params[2]), datatype);
 
-    rv = call_user_function(CG(function_table), NULL, PCBC_P(bucket->decoder), return_value, 3, params TSRMLS_CC);
+    rv = call_user_function(CG(function_table), NULL, decoder, return_value, 3, params TSRMLS_CC);
 
-    zval_ptr_dtor(&params[0]);
     zval_ptr_dtor(&params[1]);
     zval_ptr_dtor(&params[2]);
     return rv;
 }
 
-int pcbc_encode_value(pcbc_bucket_t *bucket, zval *value, void **bytes, lcb_size_t *nbytes, lcb_uint32_t *flags,
+int pcbc_encode_value(pcbc_bucket_t *bucket, zval *value, PCBC_ZVAL *bytes, lcb_uint32_t *flags,
                       lcb_uint8_t *datatype TSRMLS_DC)
 {
     PCBC_ZVAL retval;
     int rv;
 
+    if (bucket->native_encoder) {
+        return pcbc_default_encode(value, bytes, flags, datatype TSRMLS_CC);
+    }
+
     PCBC_ZVAL_ALLOC(retval);
     ZVAL_NULL(PCBC_P(retval));
 
@@ -78,8 +121,9 @@ int pcbc_encode_value(pcbc_bucket_t *bucket, zval *value, void **bytes, lcb_size
             return FAILURE;
         }
 
-        *nbytes = Z_STRLEN_P(zbytes);
-        *bytes = estrndup(Z_STRVAL_P(zbytes), *nbytes);
+        // shares the string with the array returned by the encoder, which is released below
+        PCBC_ADDREF_P(zbytes);
+        *bytes = PCBC_D(zbytes);
         *flags = Z_LVAL_P(zflags);
         *datatype = (lcb_uint8_t)Z_LVAL_P(zdatatype);
     }